@@ -8,13 +8,22 @@
 #include <mdspan-stable/include/mdspan/mdspan.hpp>
 #include <settings.hpp>
 
+#include <fs/lbm/layout.hpp>
+
 namespace fs {
 
     namespace lbm {
 
         using T = double;
 
-        using D2Q9_view = Kokkos::mdspan<double, Kokkos::extents<size_t, settings::ydim, settings::xdim, 9>>;
+        template<typename Layout = layout_aos>
+        using D2Q9_view_t = Kokkos::mdspan<double, Kokkos::extents<size_t, settings::ydim, settings::xdim, 9>, Layout>;
+
+        using D2Q9_view = D2Q9_view_t<>;
+
+        // same as D2Q9_view_t, for grids whose dimensions are only known at run-time
+        template<typename Layout = layout_aos>
+        using D2Q9_dview_t = Kokkos::mdspan<double, Kokkos::extents<size_t, Kokkos::dynamic_extent, Kokkos::dynamic_extent, 9>, Layout>;
 
     } // lbm
 
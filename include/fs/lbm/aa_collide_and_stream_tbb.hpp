@@ -0,0 +1,260 @@
+#ifndef LBM_AA_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_AA_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <cstddef>
+
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+
+/*
+    in-place streaming with the AA access pattern.
+
+    a single grid is updated in place by alternating two kinds of time-step:
+    ( 1 ) even: each cell reads its own distributions, collides them and writes each one back into
+          its own cell in the slot of the opposite direction.
+    ( 2 ) odd: each cell reads the distributions its neighbours left facing it, collides them and
+          writes each one into the neighbour it streams to, in the slot of its own direction.
+    every cell only touches the same nine locations during a step, so cells can be updated in any
+    order without a second grid. after an odd step the grid is back in its natural layout ( slot q
+    of a cell holds the pre-collision distribution moving in direction q ), after an even step it
+    isn't, so the grid should only be read after an even number of steps.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        inline bool is_near_obstacle( const unsigned char* obstacle, const size_t x, const size_t y, const size_t xdim ) {
+
+            const unsigned char* obstacle_s = obstacle + ( y - 1 ) * xdim;
+            const unsigned char* obstacle_c = obstacle + y * xdim;
+            const unsigned char* obstacle_n = obstacle + ( y + 1 ) * xdim;
+
+            return obstacle_s[ x - 1 ] | obstacle_s[ x ] | obstacle_s[ x + 1 ] |
+                   obstacle_c[ x - 1 ] | obstacle_c[ x + 1 ] |
+                   obstacle_n[ x - 1 ] | obstacle_n[ x ] | obstacle_n[ x + 1 ];
+        }
+
+        template<typename Collision = collision_BGK, typename View>
+        void aa_even_step_rows( const View& D2Q9, const unsigned char* obstacle,
+                                const size_t y_begin, const size_t y_end, const T omega ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            for ( size_t y = y_begin; y < y_end; ++y ) {
+
+                const unsigned char* obstacle_c = obstacle + y * xdim;
+
+                for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                    if ( obstacle_c[ x ] )
+                        continue;
+
+                    T f[ 9 ];
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        f[ q ] = D2Q9[ y, x, q ];
+
+                    Collision::collide( f, omega );
+
+                    D2Q9[ y, x, 0 ] = f[ 0 ];
+                    D2Q9[ y, x, 1 ] = f[ 3 ];
+                    D2Q9[ y, x, 2 ] = f[ 4 ];
+                    D2Q9[ y, x, 3 ] = f[ 1 ];
+                    D2Q9[ y, x, 4 ] = f[ 2 ];
+                    D2Q9[ y, x, 5 ] = f[ 7 ];
+                    D2Q9[ y, x, 6 ] = f[ 8 ];
+                    D2Q9[ y, x, 7 ] = f[ 5 ];
+                    D2Q9[ y, x, 8 ] = f[ 6 ];
+
+                    if ( is_near_obstacle( obstacle, x, y, xdim ) ) {
+
+                        /*
+                            a distribution heading into an obstacle is parked in the obstacle cell, where
+                            the next odd step pulls it back out as the reflected distribution
+                        */
+                        for ( size_t q = 1; q < 9; ++q ) {
+
+                            const size_t x_n = x + e[ q ].first;
+                            const size_t y_n = y + e[ q ].second;
+
+                            if ( obstacle[ x_n + y_n * xdim ] )
+                                D2Q9[ y_n, x_n, q ] = f[ q ];
+                        }
+                    }
+                }
+            }
+        }
+
+        template<typename Collision = collision_BGK, typename View>
+        void aa_odd_step_rows( const View& D2Q9, const unsigned char* obstacle,
+                               const size_t y_begin, const size_t y_end, const T omega ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            for ( size_t y = y_begin; y < y_end; ++y ) {
+
+                const unsigned char* obstacle_c = obstacle + y * xdim;
+
+                for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                    if ( obstacle_c[ x ] )
+                        continue;
+
+                    T f[ 9 ];
+
+                    // the distributions the neighbours left facing this cell
+                    f[ 0 ] = D2Q9[ y, x, 0 ];
+                    f[ 1 ] = D2Q9[ y, x - 1, 3 ];
+                    f[ 2 ] = D2Q9[ y - 1, x, 4 ];
+                    f[ 3 ] = D2Q9[ y, x + 1, 1 ];
+                    f[ 4 ] = D2Q9[ y + 1, x, 2 ];
+                    f[ 5 ] = D2Q9[ y - 1, x - 1, 7 ];
+                    f[ 6 ] = D2Q9[ y - 1, x + 1, 8 ];
+                    f[ 7 ] = D2Q9[ y + 1, x + 1, 5 ];
+                    f[ 8 ] = D2Q9[ y + 1, x - 1, 6 ];
+
+                    Collision::collide( f, omega );
+
+                    if ( is_near_obstacle( obstacle, x, y, xdim ) ) {
+
+                        for ( size_t q = 0; q < 9; ++q ) {
+
+                            const size_t x_n = x + e[ q ].first;
+                            const size_t y_n = y + e[ q ].second;
+
+                            // a distribution heading into an obstacle comes straight back as the opposite direction
+                            if ( obstacle[ x_n + y_n * xdim ] )
+                                D2Q9[ y, x, opposite_q[ q ] ] = f[ q ];
+                            else
+                                D2Q9[ y_n, x_n, q ] = f[ q ];
+                        }
+
+                        continue;
+                    }
+
+                    D2Q9[ y, x, 0 ] = f[ 0 ];
+                    D2Q9[ y, x + 1, 1 ] = f[ 1 ];
+                    D2Q9[ y + 1, x, 2 ] = f[ 2 ];
+                    D2Q9[ y, x - 1, 3 ] = f[ 3 ];
+                    D2Q9[ y - 1, x, 4 ] = f[ 4 ];
+                    D2Q9[ y + 1, x + 1, 5 ] = f[ 5 ];
+                    D2Q9[ y + 1, x - 1, 6 ] = f[ 6 ];
+                    D2Q9[ y - 1, x - 1, 7 ] = f[ 7 ];
+                    D2Q9[ y - 1, x + 1, 8 ] = f[ 8 ];
+                }
+            }
+        }
+
+        template<typename Collision = collision_BGK, typename View>
+        void aa_even_step_tbb( const View& D2Q9, const unsigned char* obstacle, const T omega ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, D2Q9.extent( 0 ) - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    aa_even_step_rows<Collision>( D2Q9, obstacle, r.begin(), r.end(), omega );
+                }
+            );
+        }
+
+        template<typename Collision = collision_BGK, typename View>
+        void aa_odd_step_tbb( const View& D2Q9, const unsigned char* obstacle, const T omega ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, D2Q9.extent( 0 ) - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    aa_odd_step_rows<Collision>( D2Q9, obstacle, r.begin(), r.end(), omega );
+                }
+            );
+        }
+
+        /*
+            the edge-cells aren't updated, so between steps they hold their boundary values in the
+            natural layout. the odd step reads them as if they had been through an even step and
+            writes the distributions leaving the grid into them, so they are swapped into the even
+            layout before the odd step and restored after it.
+        */
+        inline std::vector<size_t> get_edge_cells( const size_t ydim, const size_t xdim ) {
+
+            std::vector<size_t> edge_cells;
+
+            for ( size_t x = 0; x < xdim; ++x ) {
+
+                edge_cells.push_back( x );
+                edge_cells.push_back( x + ( ydim - 1 ) * xdim );
+            }
+
+            for ( size_t y = 1; y < ydim - 1; ++y ) {
+
+                edge_cells.push_back( y * xdim );
+                edge_cells.push_back( ( xdim - 1 ) + y * xdim );
+            }
+
+            return edge_cells;
+        }
+
+        template<typename View>
+        void save_edge_cells( const View& D2Q9, const std::vector<size_t>& edge_cells, std::vector<T>& edge_states ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            edge_states.resize( edge_cells.size() * 9 );
+
+            for ( size_t i = 0; i < edge_cells.size(); ++i )
+                for ( size_t q = 0; q < 9; ++q )
+                    edge_states[ i * 9 + q ] = D2Q9[ edge_cells[ i ] / xdim, edge_cells[ i ] % xdim, q ];
+        }
+
+        template<typename View>
+        void restore_edge_cells( const View& D2Q9, const std::vector<size_t>& edge_cells, const std::vector<T>& edge_states,
+                                 const bool swapped ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            for ( size_t i = 0; i < edge_cells.size(); ++i )
+                for ( size_t q = 0; q < 9; ++q )
+                    D2Q9[ edge_cells[ i ] / xdim, edge_cells[ i ] % xdim, swapped ? opposite_q[ q ] : q ] = edge_states[ i * 9 + q ];
+        }
+
+        /*
+            the odd step leaves each interior cell with the distributions pushed into it by its
+            neighbours, which the edge-cells don't do, so they are pushed in after the odd step
+        */
+        template<typename View>
+        void stream_edge_cells( const View& D2Q9, const unsigned char* obstacle,
+                                const std::vector<size_t>& edge_cells, const std::vector<T>& edge_states ) {
+
+            const size_t ydim = D2Q9.extent( 0 );
+            const size_t xdim = D2Q9.extent( 1 );
+
+            for ( size_t i = 0; i < edge_cells.size(); ++i ) {
+
+                const size_t x = edge_cells[ i ] % xdim;
+                const size_t y = edge_cells[ i ] / xdim;
+
+                for ( size_t q = 1; q < 9; ++q ) {
+
+                    const size_t x_n = x + e[ q ].first;
+                    const size_t y_n = y + e[ q ].second;
+
+                    // size_t wraps around for x_n, y_n < 0
+                    if ( x_n < 1 || x_n > xdim - 2 || y_n < 1 || y_n > ydim - 2 )
+                        continue;
+
+                    if ( !obstacle[ x_n + y_n * xdim ] )
+                        D2Q9[ y_n, x_n, q ] = edge_states[ i * 9 + q ];
+                }
+            }
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
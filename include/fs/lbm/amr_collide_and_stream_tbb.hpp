@@ -0,0 +1,1051 @@
+#ifndef LBM_AMR_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_AMR_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+#include <fs/lbm/multiblock_collide_and_stream_tbb.hpp>
+
+/*
+    dynamic refinement: a quadtree of square blocks of cells, refined where the flow has vorticity
+    and coarsened where it has none.
+
+    level 0 tiles the grid with blocks of block_size x block_size cells. refining a block replaces it
+    with four blocks of the next level, each cell split into four, so a level has twice the cells
+    along each side of the one above and takes two steps for each of its steps, with tau - 1/2
+    doubled for the same viscosity ( see multiblock_collide_and_stream_tbb.hpp ). neighbouring
+    blocks, diagonals included, are at most a level apart.
+
+    a block stores its cells with a ring of ghost cells around them, and is run by the fused pull
+    kernel. each step of a level, the ghost cells of its blocks are filled from the cell in the same
+    place of whichever block covers it:
+    ( 1 ) a block of the same level: copied.
+    ( 2 ) a level finer: the pre-collision distributions of the four cells, averaged.
+    ( 3 ) a level coarser: the pre-collision distributions of the cell, gathered by each step of the
+          coarse level and interpolated in time for the second fine step.
+    distributions crossing between levels have their non-equilibrium part rescaled for the other
+    level and are collided on the level they're written to, as across the interfaces of the
+    multi-block engine. the edge-cells of the grid belong to the blocks of level 0 along it, which are
+    never refined, and the boundary conditions are applied to them after each step of level 0. the
+    blocks under a sponge layer aren't refined either.
+
+    every "period" steps of level 0 the grid is regridded from the velocity change across a cell, the
+    curl of calculate_curl_v_tbb, largest over a block. a block above "refine" is split, four blocks
+    all below "coarsen" are merged. the cells of a new block are set from the pre-collision
+    distributions of the cells they replace, copied when refining and averaged when coarsening, so
+    the mass and momentum of the grid are conserved. the blocks are set in parallel.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        constexpr size_t amr_block_size = 16;
+
+        struct amr_criterion {
+
+            // largest velocity change across a cell of a block, in the units of its level, to split it
+            T refine = 0.02;
+
+            // of each of four blocks to merge them
+            T coarsen = 0.005;
+
+            // finest level
+            size_t max_level = 2;
+
+            // steps of level 0 between regrids
+            size_t period = 100;
+        };
+
+        struct amr_block {
+
+            size_t level;
+
+            // position in the blocks of its level
+            size_t by;
+            size_t bx;
+
+            // whether the block holds its cells rather than four blocks of the next level
+            bool leaf;
+
+            // regrid the block was made by, it isn't merged again in the same one
+            size_t regrid;
+
+            std::vector<T> D2Q9_a;
+            std::vector<T> D2Q9_b;
+
+            // current cells, with the ghost cells
+            T* D2Q9;
+            // cells being streamed into
+            T* D2Q9_n;
+
+            std::vector<unsigned char> obstacle;
+
+            /*
+                pre-collision distributions of the coarser cells covering ghost cells, in the order of
+                amr_ghost_cell, gathered the step before and this step of the coarser level
+            */
+            std::vector<T> interface_prev;
+            std::vector<T> interface_next;
+
+            // false until the first gather after a regrid
+            bool interface_valid;
+
+            T indicator;
+        };
+
+        struct amr_cs_state_tbb {
+
+            size_t ydim;
+            size_t xdim;
+
+            size_t block_size;
+
+            // in the units of level 0
+            T viscosity;
+
+            amr_criterion criterion;
+
+            // of level 0
+            boundary_conditions boundaries = make_boundary_conditions();
+
+            // of each level
+            std::vector<T> tau;
+            std::vector<T> omega;
+
+            // the blocks of each level, null where the level above isn't refined
+            std::vector<std::vector<std::unique_ptr<amr_block>>> blocks;
+
+            // the leaves of each level
+            std::vector<std::vector<amr_block*>> leaves;
+
+            // obstacle of level 0, and of the finer levels without "inside"
+            std::vector<unsigned char> obstacle;
+
+            // whether a point, in the cells of level 0, is inside an obstacle
+            std::function<bool( T, T )> inside;
+
+            size_t steps;
+            size_t regrids;
+
+            size_t blocks_y( const size_t l ) const { return ( ydim / block_size ) << l; }
+            size_t blocks_x( const size_t l ) const { return ( xdim / block_size ) << l; }
+
+            // block ( by, bx ) of level l, null if there isn't one
+            amr_block* block( const size_t l, const std::ptrdiff_t by, const std::ptrdiff_t bx ) const {
+
+                if ( by < 0 || bx < 0 || by >= static_cast<std::ptrdiff_t>( blocks_y( l ) ) || bx >= static_cast<std::ptrdiff_t>( blocks_x( l ) ) )
+                    return nullptr;
+
+                return blocks[ l ][ bx + by * blocks_x( l ) ].get();
+            }
+
+            auto view( T* D2Q9_data ) const {
+
+                return make_lattice_view<layout_aos>( D2Q9_data, block_size + 2, block_size + 2 );
+            }
+        };
+
+        /*
+            the grid of level 0 by cell ( y, x ), for the boundary conditions, over the current cells of
+            its blocks or, if "previous", the cells they were streamed from. every cell it's indexed at
+            is of a leaf, the edge-cells and the sponge layer aren't refined.
+        */
+        struct amr_grid_view {
+
+            const amr_cs_state_tbb* cs;
+            bool previous;
+
+            size_t extent( const size_t d ) const { return d == 0 ? cs->ydim : ( d == 1 ? cs->xdim : 9 ); }
+
+            T& operator[]( const size_t y, const size_t x, const size_t q ) const {
+
+                const size_t bs = cs->block_size;
+
+                const amr_block* b = cs->block( 0, y / bs, x / bs );
+
+                return cs->view( previous ? b->D2Q9_n : b->D2Q9 )[ y % bs + 1, x % bs + 1, q ];
+            }
+        };
+
+        // ghost cells of a block, a ring around its cells
+        inline size_t amr_ghost_cells( const size_t block_size ) {
+
+            return 4 * block_size + 4;
+        }
+
+        // position of ghost cell k in the cells of a block, ghost cells included
+        inline std::pair<size_t, size_t> amr_ghost_cell( const size_t block_size, size_t k ) {
+
+            const size_t n = block_size + 2;
+
+            if ( k < n )
+                return { 0, k };
+
+            k -= n;
+
+            if ( k < n )
+                return { n - 1, k };
+
+            k -= n;
+
+            if ( k < n - 2 )
+                return { k + 1, 0 };
+
+            return { k - ( n - 2 ) + 1, n - 1 };
+        }
+
+        // whether cell ( y, x ) of level l is an obstacle, not outside the grid
+        inline unsigned char amr_obstacle( const amr_cs_state_tbb& cs, const size_t l, const std::ptrdiff_t y, const std::ptrdiff_t x ) {
+
+            if ( y < 0 || x < 0 || y >= static_cast<std::ptrdiff_t>( cs.ydim << l ) || x >= static_cast<std::ptrdiff_t>( cs.xdim << l ) )
+                return 0;
+
+            if ( l > 0 && cs.inside ) {
+
+                // cell centres of level l in the cells of level 0
+                const T spacing = 1.0 / static_cast<T>( size_t{ 1 } << l );
+
+                return cs.inside( ( y + 0.5 ) * spacing - 0.5, ( x + 0.5 ) * spacing - 0.5 );
+            }
+
+            return cs.obstacle[ ( x >> l ) + ( y >> l ) * cs.xdim ];
+        }
+
+        // whether block bx of level l ends before the sponge layer
+        inline bool amr_clear_of_sponge( const amr_cs_state_tbb& cs, const sponge_layer& sponge, const size_t l, const size_t bx ) {
+
+            const size_t width = std::min( sponge.width, cs.xdim - 2 );
+
+            return ( ( ( bx + 1 ) * cs.block_size ) >> l ) + width < cs.xdim - 1;
+        }
+
+        // whether a block is clear of the edge-cells of the grid and the sponge layer, so it can be refined
+        inline bool amr_refinable( const amr_cs_state_tbb& cs, const amr_block& b ) {
+
+            return b.level < cs.criterion.max_level &&
+                   b.by > 0 && b.by + 1 < cs.blocks_y( b.level ) && b.bx > 0 && b.bx + 1 < cs.blocks_x( b.level ) &&
+                   amr_clear_of_sponge( cs, cs.boundaries.sponge, b.level, b.bx );
+        }
+
+        inline std::unique_ptr<amr_block> make_amr_block( const amr_cs_state_tbb& cs, const size_t l, const size_t by, const size_t bx ) {
+
+            const size_t n = cs.block_size + 2;
+
+            auto b = std::make_unique<amr_block>();
+
+            b->level = l;
+            b->by = by;
+            b->bx = bx;
+            b->leaf = true;
+            b->regrid = cs.regrids;
+            b->D2Q9_a.resize( n * n * 9 );
+            b->D2Q9_b.resize( n * n * 9 );
+            b->D2Q9 = b->D2Q9_a.data();
+            b->D2Q9_n = b->D2Q9_b.data();
+            b->obstacle.resize( n * n );
+            b->interface_prev.resize( amr_ghost_cells( cs.block_size ) * 9 );
+            b->interface_next.resize( amr_ghost_cells( cs.block_size ) * 9 );
+            b->interface_valid = false;
+            b->indicator = 0.0;
+
+            for ( size_t y = 0; y < n; ++y )
+                for ( size_t x = 0; x < n; ++x )
+                    b->obstacle[ x + y * n ] = amr_obstacle( cs, l, static_cast<std::ptrdiff_t>( by * cs.block_size + y ) - 1,
+                                                                    static_cast<std::ptrdiff_t>( bx * cs.block_size + x ) - 1 );
+
+            return b;
+        }
+
+        // the cells of a block no longer a leaf aren't kept
+        inline void release_amr_block( amr_block& b ) {
+
+            b.leaf = false;
+
+            std::vector<T>().swap( b.D2Q9_a );
+            std::vector<T>().swap( b.D2Q9_b );
+
+            b.D2Q9 = nullptr;
+            b.D2Q9_n = nullptr;
+        }
+
+        /*
+            the pre-collision distributions of cell ( y, x ) of level l, pulled from the state of the leaf
+            holding it before its last step
+        */
+        inline void pull_amr_cell( const amr_cs_state_tbb& cs, const size_t l, const size_t y, const size_t x, T ( &f )[ 9 ] ) {
+
+            const size_t bs = cs.block_size;
+
+            const amr_block* b = cs.block( l, y / bs, x / bs );
+
+            pull_cell( cs.view( b->D2Q9_n ), b->obstacle.data(), y % bs + 1, x % bs + 1, f );
+        }
+
+        // the same for cell ( y, x ) of level l from the four cells of level l + 1 it's split into, rescaled
+        inline void restrict_amr_cell( const amr_cs_state_tbb& cs, const size_t l, const size_t y, const size_t x, T ( &f )[ 9 ] ) {
+
+            for ( size_t q = 0; q < 9; ++q )
+                f[ q ] = 0.0;
+
+            for ( size_t i = 0; i < 2; ++i ) {
+                for ( size_t j = 0; j < 2; ++j ) {
+
+                    T f_fine[ 9 ];
+
+                    pull_amr_cell( cs, l + 1, 2 * y + i, 2 * x + j, f_fine );
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        f[ q ] += 0.25 * f_fine[ q ];
+                }
+            }
+
+            rescale_non_equilibrium( f, 2.0 * cs.tau[ l ] / cs.tau[ l + 1 ] );
+        }
+
+        /*
+            fill the ghost cells of the current cells of a leaf, "t" the fraction of the step of the
+            coarser level this step of the leaf starts at
+        */
+        template<typename Collision = collision_BGK>
+        void fill_ghost_cells( const amr_cs_state_tbb& cs, amr_block& b, const T t ) {
+
+            const size_t bs = cs.block_size;
+            const size_t l = b.level;
+
+            auto D2Q9 = cs.view( b.D2Q9 );
+
+            for ( size_t k = 0; k < amr_ghost_cells( bs ); ++k ) {
+
+                const auto [ y_l, x_l ] = amr_ghost_cell( bs, k );
+
+                const std::ptrdiff_t y = static_cast<std::ptrdiff_t>( b.by * bs + y_l ) - 1;
+                const std::ptrdiff_t x = static_cast<std::ptrdiff_t>( b.bx * bs + x_l ) - 1;
+
+                // outside the grid, next to the edge-cells, which aren't updated
+                if ( y < 0 || x < 0 || y >= static_cast<std::ptrdiff_t>( cs.ydim << l ) || x >= static_cast<std::ptrdiff_t>( cs.xdim << l ) )
+                    continue;
+
+                const amr_block* s = cs.block( l, y / bs, x / bs );
+
+                T f[ 9 ];
+
+                if ( s && s->leaf ) {
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        f[ q ] = cs.view( s->D2Q9 )[ y % bs + 1, x % bs + 1, q ];
+
+                } else if ( s ) {
+
+                    restrict_amr_cell( cs, l, y, x, f );
+
+                    Collision::collide( f, cs.omega[ l ] );
+
+                } else {
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        f[ q ] = ( 1.0 - t ) * b.interface_prev[ k * 9 + q ] + t * b.interface_next[ k * 9 + q ];
+
+                    rescale_non_equilibrium( f, cs.tau[ l ] / ( 2.0 * cs.tau[ l - 1 ] ) );
+
+                    Collision::collide( f, cs.omega[ l ] );
+                }
+
+                for ( size_t q = 0; q < 9; ++q )
+                    D2Q9[ y_l, x_l, q ] = f[ q ];
+            }
+        }
+
+        // gather the coarser cells covering ghost cells of a leaf, after a step of the coarser level
+        inline void gather_ghost_cells( const amr_cs_state_tbb& cs, amr_block& b ) {
+
+            const size_t bs = cs.block_size;
+            const size_t l = b.level;
+
+            for ( size_t k = 0; k < amr_ghost_cells( bs ); ++k ) {
+
+                const auto [ y_l, x_l ] = amr_ghost_cell( bs, k );
+
+                // a refined block is clear of the edge of the grid, so its ghost cells are inside it
+                const size_t y = b.by * bs + y_l - 1;
+                const size_t x = b.bx * bs + x_l - 1;
+
+                if ( cs.block( l, y / bs, x / bs ) )
+                    continue;
+
+                T f[ 9 ];
+
+                pull_amr_cell( cs, l - 1, y / 2, x / 2, f );
+
+                for ( size_t q = 0; q < 9; ++q )
+                    b.interface_next[ k * 9 + q ] = f[ q ];
+            }
+
+            if ( !b.interface_valid ) {
+
+                b.interface_prev = b.interface_next;
+                b.interface_valid = true;
+            }
+        }
+
+        template<typename Collision = collision_BGK>
+        void collide_and_stream_amr_block( const amr_cs_state_tbb& cs, amr_block& b ) {
+
+            const size_t bs = cs.block_size;
+
+            // blocks of level 0 along the edge of the grid leave its edge-cells
+            const bool base = b.level == 0;
+
+            const size_t y_begin = base && b.by == 0 ? 2 : 1;
+            const size_t x_begin = base && b.bx == 0 ? 2 : 1;
+            const size_t y_end = base && b.by + 1 == cs.blocks_y( 0 ) ? bs : bs + 1;
+            const size_t x_end = base && b.bx + 1 == cs.blocks_x( 0 ) ? bs : bs + 1;
+
+            fused_collide_and_stream_tile<Collision>( cs.view( b.D2Q9 ), cs.view( b.D2Q9_n ), b.obstacle.data(),
+                                                      y_begin, y_end, x_begin, x_end, cs.omega[ b.level ] );
+
+            std::swap( b.D2Q9, b.D2Q9_n );
+        }
+
+        // a step of level l, "t" the fraction of the step of level l - 1 it starts at, and two of the level below for each
+        template<typename Collision = collision_BGK>
+        void collide_and_stream_amr_level( amr_cs_state_tbb& cs, const size_t l, const T t ) {
+
+            auto& leaves = cs.leaves[ l ];
+
+            auto for_each_leaf = [&]( std::vector<amr_block*>& level_leaves, const auto& f ) {
+
+                tbb::parallel_for( tbb::blocked_range<size_t>( 0, level_leaves.size() ),
+                    [&]( const tbb::blocked_range<size_t>& r ) {
+
+                        for ( size_t i = r.begin(); i < r.end(); ++i )
+                            f( *level_leaves[ i ] );
+                    }
+                );
+            };
+
+            for_each_leaf( leaves, [&]( amr_block& b ) { fill_ghost_cells<Collision>( cs, b, t ); } );
+            for_each_leaf( leaves, [&]( amr_block& b ) { collide_and_stream_amr_block<Collision>( cs, b ); } );
+
+            if ( l == 0 && !cs.boundaries.equilibrium() )
+                apply_boundary_conditions<Collision>( amr_grid_view{ &cs, true }, amr_grid_view{ &cs, false },
+                                                      cs.obstacle.data(), cs.boundaries, cs.omega[ 0 ], true );
+
+            if ( l + 1 == cs.leaves.size() || cs.leaves[ l + 1 ].empty() )
+                return;
+
+            for_each_leaf( cs.leaves[ l + 1 ], [&]( amr_block& b ) { gather_ghost_cells( cs, b ); } );
+
+            collide_and_stream_amr_level<Collision>( cs, l + 1, 0.0 );
+            collide_and_stream_amr_level<Collision>( cs, l + 1, 0.5 );
+
+            for_each_leaf( cs.leaves[ l + 1 ], [&]( amr_block& b ) { std::swap( b.interface_prev, b.interface_next ); } );
+        }
+
+        /*
+            largest velocity change across a cell of a leaf, the curl of calculate_curl_v_tbb, away from
+            the obstacles
+        */
+        inline T calculate_amr_indicator( const amr_cs_state_tbb& cs, const amr_block& b ) {
+
+            const size_t n = cs.block_size + 2;
+
+            auto D2Q9 = cs.view( b.D2Q9 );
+
+            std::vector<T> u_x( n * n );
+            std::vector<T> u_y( n * n );
+
+            for ( size_t y = 1; y < n - 1; ++y ) {
+                for ( size_t x = 1; x < n - 1; ++x ) {
+
+                    T rho = 0.0, m_x = 0.0, m_y = 0.0;
+
+                    for ( size_t q = 0; q < 9; ++q ) {
+
+                        const T f = D2Q9[ y, x, q ];
+
+                        rho += f;
+                        m_x += f * e[ q ].first;
+                        m_y += f * e[ q ].second;
+                    }
+
+                    u_x[ x + y * n ] = m_x / rho;
+                    u_y[ x + y * n ] = m_y / rho;
+                }
+            }
+
+            const unsigned char* obstacle = b.obstacle.data();
+
+            T indicator = 0.0;
+
+            // the ghost cells aren't current, the stencil stays inside
+            for ( size_t y = 2; y < n - 2; ++y ) {
+                for ( size_t x = 2; x < n - 2; ++x ) {
+
+                    const size_t i = x + y * n;
+
+                    if ( obstacle[ i ] | obstacle[ i - 1 ] | obstacle[ i + 1 ] | obstacle[ i - n ] | obstacle[ i + n ] )
+                        continue;
+
+                    const T curl = u_y[ i + 1 ] - u_y[ i - 1 ] - u_x[ i + n ] + u_x[ i - n ];
+
+                    indicator = std::max( indicator, std::abs( curl ) );
+                }
+            }
+
+            return indicator;
+        }
+
+        inline void update_amr_leaves( amr_cs_state_tbb& cs ) {
+
+            for ( size_t l = 0; l < cs.blocks.size(); ++l ) {
+
+                cs.leaves[ l ].clear();
+
+                for ( const auto& b : cs.blocks[ l ] )
+                    if ( b && b->leaf )
+                        cs.leaves[ l ].push_back( b.get() );
+            }
+        }
+
+        /*
+            the other buffer of a new block, what it streamed from, as its cells with the ghost cells
+            copied from the nearest of them. only pulled from before the block's first step.
+        */
+        inline void set_amr_previous_cells( const amr_cs_state_tbb& cs, amr_block& b ) {
+
+            const size_t n = cs.block_size + 2;
+
+            auto D2Q9 = cs.view( b.D2Q9 );
+            auto D2Q9_n = cs.view( b.D2Q9_n );
+
+            for ( size_t y = 0; y < n; ++y ) {
+                for ( size_t x = 0; x < n; ++x ) {
+
+                    const size_t y_s = std::clamp<size_t>( y, 1, n - 2 );
+                    const size_t x_s = std::clamp<size_t>( x, 1, n - 2 );
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        D2Q9_n[ y, x, q ] = D2Q9[ y_s, x_s, q ];
+                }
+            }
+        }
+
+        // split each of "parents" into four blocks of the next level
+        template<typename Collision = collision_BGK>
+        void refine_amr_blocks( amr_cs_state_tbb& cs, const std::vector<amr_block*>& parents ) {
+
+            const size_t bs = cs.block_size;
+
+            std::vector<amr_block*> children;
+
+            for ( amr_block* p : parents ) {
+
+                const size_t l = p->level + 1;
+
+                for ( size_t i = 0; i < 2; ++i ) {
+                    for ( size_t j = 0; j < 2; ++j ) {
+
+                        auto& child = cs.blocks[ l ][ ( 2 * p->bx + j ) + ( 2 * p->by + i ) * cs.blocks_x( l ) ];
+
+                        child = make_amr_block( cs, l, 2 * p->by + i, 2 * p->bx + j );
+
+                        children.push_back( child.get() );
+                    }
+                }
+            }
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, children.size() ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t c = r.begin(); c < r.end(); ++c ) {
+
+                        amr_block& b = *children[ c ];
+
+                        const size_t l = b.level;
+
+                        auto D2Q9 = cs.view( b.D2Q9 );
+
+                        for ( size_t y = 1; y <= bs; ++y ) {
+                            for ( size_t x = 1; x <= bs; ++x ) {
+
+                                T f[ 9 ];
+
+                                // the cell of the parent this one is a quarter of
+                                pull_amr_cell( cs, l - 1, ( b.by * bs + y - 1 ) / 2, ( b.bx * bs + x - 1 ) / 2, f );
+
+                                rescale_non_equilibrium( f, cs.tau[ l ] / ( 2.0 * cs.tau[ l - 1 ] ) );
+
+                                Collision::collide( f, cs.omega[ l ] );
+
+                                for ( size_t q = 0; q < 9; ++q )
+                                    D2Q9[ y, x, q ] = f[ q ];
+                            }
+                        }
+
+                        set_amr_previous_cells( cs, b );
+                    }
+                }
+            );
+
+            for ( amr_block* p : parents )
+                release_amr_block( *p );
+        }
+
+        // merge the four blocks of each of "parents" back into it
+        template<typename Collision = collision_BGK>
+        void coarsen_amr_blocks( amr_cs_state_tbb& cs, std::vector<amr_block*> parents ) {
+
+            const size_t bs = cs.block_size;
+
+            // each parent gets cells again
+            for ( amr_block*& p : parents ) {
+
+                auto& slot = cs.blocks[ p->level ][ p->bx + p->by * cs.blocks_x( p->level ) ];
+
+                slot = make_amr_block( cs, p->level, p->by, p->bx );
+
+                p = slot.get();
+            }
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, parents.size() ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t k = r.begin(); k < r.end(); ++k ) {
+
+                        amr_block& b = *parents[ k ];
+
+                        auto D2Q9 = cs.view( b.D2Q9 );
+
+                        for ( size_t y = 1; y <= bs; ++y ) {
+                            for ( size_t x = 1; x <= bs; ++x ) {
+
+                                T f[ 9 ];
+
+                                restrict_amr_cell( cs, b.level, b.by * bs + y - 1, b.bx * bs + x - 1, f );
+
+                                Collision::collide( f, cs.omega[ b.level ] );
+
+                                for ( size_t q = 0; q < 9; ++q )
+                                    D2Q9[ y, x, q ] = f[ q ];
+                            }
+                        }
+
+                        set_amr_previous_cells( cs, b );
+                    }
+                }
+            );
+
+            for ( amr_block* p : parents ) {
+
+                const size_t l = p->level + 1;
+
+                for ( size_t i = 0; i < 2; ++i )
+                    for ( size_t j = 0; j < 2; ++j )
+                        cs.blocks[ l ][ ( 2 * p->bx + j ) + ( 2 * p->by + i ) * cs.blocks_x( l ) ].reset();
+            }
+        }
+
+        /*
+            refine and coarsen the blocks by amr_criterion. a block is only split once its neighbours
+            are of its level, so a coarser neighbour is split first, and four blocks are only merged if
+            no neighbour of the merged block is two levels finer. returns whether the grid changed.
+        */
+        template<typename Collision = collision_BGK>
+        bool regrid_amr( amr_cs_state_tbb& cs ) {
+
+            ++cs.regrids;
+
+            for ( size_t l = 0; l < cs.leaves.size(); ++l ) {
+
+                tbb::parallel_for( tbb::blocked_range<size_t>( 0, cs.leaves[ l ].size() ),
+                    [&]( const tbb::blocked_range<size_t>& r ) {
+
+                        for ( size_t i = r.begin(); i < r.end(); ++i )
+                            cs.leaves[ l ][ i ]->indicator = calculate_amr_indicator( cs, *cs.leaves[ l ][ i ] );
+                    }
+                );
+            }
+
+            bool changed = false;
+
+            std::vector<amr_block*> candidates;
+
+            for ( const auto& leaves : cs.leaves )
+                for ( amr_block* b : leaves )
+                    if ( b->indicator > cs.criterion.refine && amr_refinable( cs, *b ) )
+                        candidates.push_back( b );
+
+            // a coarser neighbour of a candidate is split a pass before it, a level per pass
+            for ( size_t pass = 0; pass <= cs.criterion.max_level && !candidates.empty(); ++pass ) {
+
+                std::vector<amr_block*> accepted;
+                std::vector<amr_block*> postponed;
+
+                for ( amr_block* b : candidates ) {
+
+                    if ( !b->leaf )
+                        continue;
+
+                    bool balanced = true;
+
+                    for ( std::ptrdiff_t dy = -1; dy <= 1; ++dy ) {
+                        for ( std::ptrdiff_t dx = -1; dx <= 1; ++dx ) {
+
+                            const std::ptrdiff_t y = static_cast<std::ptrdiff_t>( b->by ) + dy;
+                            const std::ptrdiff_t x = static_cast<std::ptrdiff_t>( b->bx ) + dx;
+
+                            if ( cs.block( b->level, y, x ) )
+                                continue;
+
+                            balanced = false;
+
+                            amr_block* n = cs.block( b->level - 1, y / 2, x / 2 );
+
+                            if ( n && n->leaf && amr_refinable( cs, *n ) )
+                                postponed.push_back( n );
+                        }
+                    }
+
+                    ( balanced ? accepted : postponed ).push_back( b );
+                }
+
+                for ( auto* list : { &accepted, &postponed } ) {
+
+                    std::sort( list->begin(), list->end() );
+                    list->erase( std::unique( list->begin(), list->end() ), list->end() );
+                }
+
+                refine_amr_blocks<Collision>( cs, accepted );
+
+                changed |= !accepted.empty();
+
+                candidates = std::move( postponed );
+            }
+
+            std::vector<amr_block*> parents;
+
+            for ( size_t l = 0; l < cs.criterion.max_level; ++l ) {
+
+                for ( const auto& p : cs.blocks[ l ] ) {
+
+                    if ( !p || p->leaf )
+                        continue;
+
+                    auto mergeable = [&]( const amr_block* c ) {
+
+                        return c->leaf && c->regrid != cs.regrids && c->indicator < cs.criterion.coarsen;
+                    };
+
+                    bool merge = true;
+
+                    for ( size_t i = 0; i < 2; ++i )
+                        for ( size_t j = 0; j < 2; ++j )
+                            merge = merge && mergeable( cs.block( l + 1, 2 * p->by + i, 2 * p->bx + j ) );
+
+                    for ( std::ptrdiff_t dy = -1; dy <= 1 && merge; ++dy ) {
+                        for ( std::ptrdiff_t dx = -1; dx <= 1 && merge; ++dx ) {
+
+                            const amr_block* n = cs.block( l, static_cast<std::ptrdiff_t>( p->by ) + dy, static_cast<std::ptrdiff_t>( p->bx ) + dx );
+
+                            if ( !n || n->leaf || n == p.get() )
+                                continue;
+
+                            for ( size_t i = 0; i < 2; ++i )
+                                for ( size_t j = 0; j < 2; ++j )
+                                    merge = merge && cs.block( l + 1, 2 * n->by + i, 2 * n->bx + j )->leaf;
+                        }
+                    }
+
+                    if ( merge )
+                        parents.push_back( p.get() );
+                }
+            }
+
+            coarsen_amr_blocks<Collision>( cs, parents );
+
+            changed |= !parents.empty();
+
+            if ( changed ) {
+
+                update_amr_leaves( cs );
+
+                // the coarser cells around the blocks may have changed
+                for ( const auto& leaves : cs.leaves )
+                    for ( amr_block* b : leaves )
+                        b->interface_valid = false;
+            }
+
+            return changed;
+        }
+
+        /*
+            D2Q9 is the ydim x xdim grid of level 0 in layout_aos. the dimensions must be multiples of a
+            non-zero block_size, otherwise it throws std::invalid_argument. the obstacle of a finer level
+            is "inside" at the centre of each cell, in the cells of level 0, if given, otherwise that of
+            the cell of level 0 it's part of.
+        */
+        inline amr_cs_state_tbb init_amr_cs_tbb( const T* D2Q9, const unsigned char* obstacle,
+                                                 const size_t ydim, const size_t xdim, const T viscosity,
+                                                 const amr_criterion& criterion = {},
+                                                 const std::function<bool( T, T )>& inside = {},
+                                                 const size_t block_size = amr_block_size ) {
+
+            if ( block_size == 0 || ydim % block_size != 0 || xdim % block_size != 0 )
+                throw std::invalid_argument( "the grid isn't a whole number of blocks: " + std::to_string( ydim ) + " x " +
+                                             std::to_string( xdim ) + " with blocks of " + std::to_string( block_size ) );
+
+            amr_cs_state_tbb cs;
+
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+            cs.block_size = block_size;
+            cs.viscosity = viscosity;
+            cs.criterion = criterion;
+            cs.obstacle.assign( obstacle, obstacle + ydim * xdim );
+            cs.inside = inside;
+            cs.steps = 0;
+            cs.regrids = 0;
+
+            const size_t levels = criterion.max_level + 1;
+
+            cs.tau.resize( levels );
+            cs.omega.resize( levels );
+            cs.blocks.resize( levels );
+            cs.leaves.resize( levels );
+
+            for ( size_t l = 0; l < levels; ++l ) {
+
+                cs.tau[ l ] = 0.5 + static_cast<T>( size_t{ 1 } << l ) * 3.0 * viscosity;
+                cs.omega[ l ] = 1.0 / cs.tau[ l ];
+
+                cs.blocks[ l ].resize( cs.blocks_y( l ) * cs.blocks_x( l ) );
+            }
+
+            const size_t n = block_size + 2;
+
+            for ( size_t by = 0; by < cs.blocks_y( 0 ); ++by ) {
+                for ( size_t bx = 0; bx < cs.blocks_x( 0 ); ++bx ) {
+
+                    auto b = make_amr_block( cs, 0, by, bx );
+
+                    auto D2Q9_b = cs.view( b->D2Q9 );
+
+                    // the ghost cells too, from the grid
+                    for ( size_t y = 0; y < n; ++y ) {
+                        for ( size_t x = 0; x < n; ++x ) {
+
+                            const std::ptrdiff_t y_g = static_cast<std::ptrdiff_t>( by * block_size + y ) - 1;
+                            const std::ptrdiff_t x_g = static_cast<std::ptrdiff_t>( bx * block_size + x ) - 1;
+
+                            if ( y_g < 0 || x_g < 0 || y_g >= static_cast<std::ptrdiff_t>( ydim ) || x_g >= static_cast<std::ptrdiff_t>( xdim ) )
+                                continue;
+
+                            for ( size_t q = 0; q < 9; ++q )
+                                D2Q9_b[ y, x, q ] = D2Q9[ ( x_g + y_g * xdim ) * 9 + q ];
+                        }
+                    }
+
+                    b->D2Q9_b = b->D2Q9_a;
+
+                    cs.blocks[ 0 ][ bx + by * cs.blocks_x( 0 ) ] = std::move( b );
+                }
+            }
+
+            update_amr_leaves( cs );
+
+            return cs;
+        }
+
+        /*
+            set the edge-cells of the grid to the equilibrium of the boundary conditions, what
+            set_grid_boundaries does for the whole grid
+        */
+        inline void set_grid_boundaries( amr_cs_state_tbb& cs ) {
+
+            const size_t n = cs.block_size + 2;
+
+            for ( amr_block* b : cs.leaves[ 0 ] ) {
+
+                for ( T* D2Q9_data : { b->D2Q9, b->D2Q9_n } ) {
+
+                    auto D2Q9 = cs.view( D2Q9_data );
+
+                    for ( size_t y = 0; y < n; ++y ) {
+                        for ( size_t x = 0; x < n; ++x ) {
+
+                            const size_t y_g = b->by * cs.block_size + y - 1;
+                            const size_t x_g = b->bx * cs.block_size + x - 1;
+
+                            if ( y_g == 0 || x_g == 0 || y_g == cs.ydim - 1 || x_g == cs.xdim - 1 )
+                                set_cell( D2Q9, y, x, cs.boundaries.f_eq );
+                        }
+                    }
+                }
+            }
+        }
+
+        /*
+            set the boundary conditions of the grid, and its edge-cells to their equilibrium. the blocks
+            under the sponge layer must not be refined.
+        */
+        inline void set_boundary_conditions( amr_cs_state_tbb& cs, const boundary_conditions& bc ) {
+
+            for ( size_t by = 0; by < cs.blocks_y( 0 ); ++by )
+                for ( size_t bx = 0; bx < cs.blocks_x( 0 ); ++bx )
+                    if ( !cs.block( 0, by, bx )->leaf && !amr_clear_of_sponge( cs, bc.sponge, 0, bx ) )
+                        throw std::invalid_argument( "the sponge layer covers refined blocks" );
+
+            cs.boundaries = bc;
+
+            set_grid_boundaries( cs );
+        }
+
+        // "steps" steps of level 0, regridding every period of the criterion
+        template<typename Collision = collision_BGK>
+        void stateful_collide_and_stream_tbb( amr_cs_state_tbb& cs, const size_t steps ) {
+
+            for ( size_t step = 0; step < steps; ++step ) {
+
+                collide_and_stream_amr_level<Collision>( cs, 0, 0.0 );
+
+                ++cs.steps;
+
+                if ( cs.criterion.period && cs.steps % cs.criterion.period == 0 )
+                    regrid_amr<Collision>( cs );
+            }
+        }
+
+        // the distributions of cell ( y, x ) of level l, averaged over finer leaves
+        inline void sample_amr_cell( const amr_cs_state_tbb& cs, const size_t l, const size_t y, const size_t x, T ( &f )[ 9 ] ) {
+
+            const size_t bs = cs.block_size;
+
+            const amr_block* b = cs.block( l, y / bs, x / bs );
+
+            if ( !b ) {
+
+                sample_amr_cell( cs, l - 1, y / 2, x / 2, f );
+
+            } else if ( b->leaf ) {
+
+                for ( size_t q = 0; q < 9; ++q )
+                    f[ q ] = cs.view( b->D2Q9 )[ y % bs + 1, x % bs + 1, q ];
+
+            } else {
+
+                for ( size_t q = 0; q < 9; ++q )
+                    f[ q ] = 0.0;
+
+                for ( size_t i = 0; i < 2; ++i ) {
+                    for ( size_t j = 0; j < 2; ++j ) {
+
+                        T f_fine[ 9 ];
+
+                        sample_amr_cell( cs, l + 1, 2 * y + i, 2 * x + j, f_fine );
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            f[ q ] += 0.25 * f_fine[ q ];
+                    }
+                }
+            }
+        }
+
+        /*
+            copy the grid at the resolution of level l into D2Q9, ( ydim << l ) x ( xdim << l ) in
+            layout_aos. a coarser cell is copied to the cells it covers, finer cells are averaged.
+        */
+        inline void export_D2Q9( const amr_cs_state_tbb& cs, T* D2Q9, const size_t l = 0 ) {
+
+            const size_t xdim = cs.xdim << l;
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, cs.ydim << l ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t y = r.begin(); y < r.end(); ++y ) {
+                        for ( size_t x = 0; x < xdim; ++x ) {
+
+                            T f[ 9 ];
+
+                            sample_amr_cell( cs, l, y, x, f );
+
+                            for ( size_t q = 0; q < 9; ++q )
+                                D2Q9[ ( x + y * xdim ) * 9 + q ] = f[ q ];
+                        }
+                    }
+                }
+            );
+        }
+
+        inline size_t amr_cell_count( const amr_cs_state_tbb& cs ) {
+
+            size_t cells = 0;
+
+            for ( const auto& leaves : cs.leaves )
+                cells += leaves.size() * cs.block_size * cs.block_size;
+
+            return cells;
+        }
+
+        // cells updated by the kernels for a step of level 0
+        inline size_t amr_cell_updates_per_step( const amr_cs_state_tbb& cs ) {
+
+            size_t updates = 0;
+
+            for ( size_t l = 0; l < cs.leaves.size(); ++l )
+                updates += ( cs.leaves[ l ].size() * cs.block_size * cs.block_size ) << l;
+
+            return updates;
+        }
+
+        // mass of the grid, a cell of level l weighing a quarter of one of level l - 1
+        inline T amr_mass( const amr_cs_state_tbb& cs ) {
+
+            const size_t n = cs.block_size + 2;
+
+            T mass = 0.0;
+
+            for ( size_t l = 0; l < cs.leaves.size(); ++l ) {
+
+                const T weight = 1.0 / static_cast<T>( size_t{ 1 } << ( 2 * l ) );
+
+                for ( const amr_block* b : cs.leaves[ l ] ) {
+
+                    auto D2Q9 = cs.view( b->D2Q9 );
+
+                    // summed by block, the sum of the whole grid loses the change of a single cell
+                    T block_mass = 0.0;
+
+                    for ( size_t y = 1; y < n - 1; ++y )
+                        for ( size_t x = 1; x < n - 1; ++x )
+                            for ( size_t q = 0; q < 9; ++q )
+                                block_mass += D2Q9[ y, x, q ];
+
+                    mass += weight * block_mass;
+                }
+            }
+
+            return mass;
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef LBM_BLOCKED_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_BLOCKED_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+
+/*
+    temporal blocking of the fused kernel ( see fused_collide_and_stream_tbb.hpp ).
+
+    stepping the whole grid at a time streams both grids through memory on every step. instead the
+    grid is cut into tiles and each tile is taken through several steps while it is still in cache.
+    a cell at step k needs its neighbours at step k - 1, so the tiles are skewed: a tile moves up
+    and left by one cell per step. each step of a tile then only needs:
+    ( 1 ) its own cells at the previous step.
+    ( 2 ) cells of the tiles below, to the left and below-left at the previous step.
+    and it only overwrites cells two steps old that no tile still to come reads. tiles on the same
+    anti-diagonal are independent, so the tiles are run as a wavefront, one anti-diagonal at a time,
+    with the tiles of an anti-diagonal run in parallel.
+    every cell is updated exactly as by the fused kernel, so the result is identical to running the
+    steps one at a time.
+    the tiles of an anti-diagonal can be run by a row partition of the interior of the grid, such as
+    numa_partition::parallel_rows, each tile by the subrange holding its first row.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        // default tile of 32 x 32 cells: the two grids of a tile fit in L2
+        constexpr size_t blocked_tile_ydim = 32;
+        constexpr size_t blocked_tile_xdim = 32;
+
+        // the cells a tile touches grow with the number of steps, longer runs are split into passes
+        constexpr size_t blocked_steps = 8;
+
+        /*
+            "steps" time-steps of the fused kernel. D2Q9 and D2Q9_n swap roles every step, so the
+            result is in D2Q9 after an even number of steps and in D2Q9_n after an odd number.
+            both grids must hold the same edge-cells. parallel_rows( y_begin, y_end, f ) calls
+            f( y_b, y_e ) on subranges of rows [ y_begin, y_end ) in parallel.
+        */
+        template<typename Collision = collision_BGK, typename View, typename View_n, typename Rows>
+            requires ( !std::is_integral_v<Rows> )
+        void fused_collide_and_stream_blocked_tbb( const View& D2Q9, const View_n& D2Q9_n, const unsigned char* obstacle,
+                                                   const size_t steps, const T omega, const Rows& parallel_rows,
+                                                   const size_t tile_ydim = blocked_tile_ydim,
+                                                   const size_t tile_xdim = blocked_tile_xdim ) {
+
+            const size_t ydim = D2Q9.extent( 0 );
+            const size_t xdim = D2Q9.extent( 1 );
+
+            if ( steps == 0 )
+                return;
+
+            // enough tiles to still cover the grid after they have moved back by steps - 1 cells
+            const size_t tiles_y = ( ydim - 2 + steps - 1 + tile_ydim - 1 ) / tile_ydim;
+            const size_t tiles_x = ( xdim - 2 + steps - 1 + tile_xdim - 1 ) / tile_xdim;
+
+            auto run_tile = [&]( const size_t i, const size_t j ) {
+
+                for ( size_t k = 0; k < steps; ++k ) {
+
+                    // tile bounds at step k, the shift by k is kept in signed arithmetic until clamped
+                    const std::ptrdiff_t y_begin = static_cast<std::ptrdiff_t>( 1 + i * tile_ydim ) - static_cast<std::ptrdiff_t>( k );
+                    const std::ptrdiff_t x_begin = static_cast<std::ptrdiff_t>( 1 + j * tile_xdim ) - static_cast<std::ptrdiff_t>( k );
+                    const std::ptrdiff_t y_end = y_begin + static_cast<std::ptrdiff_t>( tile_ydim );
+                    const std::ptrdiff_t x_end = x_begin + static_cast<std::ptrdiff_t>( tile_xdim );
+
+                    const size_t y_b = static_cast<size_t>( std::max<std::ptrdiff_t>( y_begin, 1 ) );
+                    const size_t x_b = static_cast<size_t>( std::max<std::ptrdiff_t>( x_begin, 1 ) );
+                    const size_t y_e = static_cast<size_t>( std::clamp<std::ptrdiff_t>( y_end, 1, ydim - 1 ) );
+                    const size_t x_e = static_cast<size_t>( std::clamp<std::ptrdiff_t>( x_end, 1, xdim - 1 ) );
+
+                    if ( y_b >= y_e || x_b >= x_e )
+                        continue;
+
+                    if ( k % 2 == 0 )
+                        fused_collide_and_stream_tile<Collision>( D2Q9, D2Q9_n, obstacle, y_b, y_e, x_b, x_e, omega );
+                    else
+                        fused_collide_and_stream_tile<Collision>( D2Q9_n, D2Q9, obstacle, y_b, y_e, x_b, x_e, omega );
+                }
+            };
+
+            for ( size_t d = 0; d < tiles_y + tiles_x - 1; ++d ) {
+
+                // tiles ( i, d - i ) on anti-diagonal d
+                const size_t i_begin = d < tiles_x ? 0 : d - tiles_x + 1;
+                const size_t i_end = std::min( d + 1, tiles_y );
+
+                // tile i starts at row 1 + i * tile_ydim, those past the interior go to the last subrange
+                parallel_rows( 1, ydim - 1,
+                    [&]( const size_t y_b, const size_t y_e ) {
+
+                        const size_t i_b = std::max( i_begin, ( y_b - 1 + tile_ydim - 1 ) / tile_ydim );
+                        const size_t i_e = y_e == ydim - 1 ? i_end : std::min( i_end, ( y_e - 1 + tile_ydim - 1 ) / tile_ydim );
+
+                        for ( size_t i = i_b; i < i_e; ++i )
+                            run_tile( i, d - i );
+                    }
+                );
+            }
+        }
+
+        template<typename Collision = collision_BGK, typename View, typename View_n>
+        void fused_collide_and_stream_blocked_tbb( const View& D2Q9, const View_n& D2Q9_n, const unsigned char* obstacle,
+                                                   const size_t steps, const T omega,
+                                                   const size_t tile_ydim = blocked_tile_ydim,
+                                                   const size_t tile_xdim = blocked_tile_xdim ) {
+
+            auto parallel_rows = []( const size_t y_begin, const size_t y_end, const auto& f ) {
+
+                tbb::parallel_for( tbb::blocked_range<size_t>( y_begin, y_end ),
+                    [&]( const tbb::blocked_range<size_t>& r ) {
+
+                        f( r.begin(), r.end() );
+                    }
+                );
+            };
+
+            fused_collide_and_stream_blocked_tbb<Collision>( D2Q9, D2Q9_n, obstacle, steps, omega, parallel_rows, tile_ydim, tile_xdim );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
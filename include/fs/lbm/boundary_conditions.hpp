@@ -0,0 +1,384 @@
+#ifndef LBM_BOUNDARY_CONDITIONS_HPP
+#define LBM_BOUNDARY_CONDITIONS_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/collision.hpp>
+
+/*
+    inlet, outlet and wall boundaries applied by the engines every time-step.
+
+    the edge-cells of the grid aren't updated by the kernels, they hold the boundary values the
+    interior cells pull from. after the interior of the new grid is written:
+    ( 1 ) the top and bottom rows are set to the equilibrium of the free stream.
+    ( 2 ) the inlet column x = 0 is either
+          equilibrium: the equilibrium of the inlet flow, or
+          zou_he: a velocity inlet. the cell pulls the distributions streaming into it from the
+                  grid, those moving out of the domain ( 3, 6, 7 ) and along it ( 0, 2, 4 ), and
+                  the three moving in ( 1, 5, 8 ) are set so the cell has the inlet velocity, with
+                  the density that follows from the known ones ( Zou and He, 1997 ). the cell is
+                  then rebuilt as the equilibrium of that density and velocity plus the projection
+                  of its non-equilibrium part onto the stress ( Latt et al., 2008 ). patching only
+                  the unknown distributions lets round-off grow at low viscosity.
+    ( 3 ) the outlet column x = xdim - 1 is either
+          equilibrium: the equilibrium of the inlet flow,
+          zero_gradient: a copy of the column next to it, or
+          non_reflecting: a characteristic outlet. the density and velocity of the cell are
+                  advanced by the locally one-dimensional inviscid equations: the waves leaving
+                  the domain are taken from the grid, and the one entering it only relaxes the
+                  density towards the free stream rather than holding it there, so pressure waves
+                  pass out instead of reflecting ( Poinsot and Lele, 1992 ). the cell is the
+                  equilibrium of the new density and velocity with the non-equilibrium part of
+                  the column next to it.
+    ( 4 ) optionally a sponge layer, the last columns of the interior before the outlet, relaxes
+          the density of the cells towards the free stream at their own velocity. the pressure
+          waves lose their amplitude before they reach the outlet, while a wake, a deficit of
+          velocity at the free-stream density, passes through unchanged. splitting the density and
+          velocity into acoustic waves along x instead can't tell a wake from a pair of them, and
+          turns part of it into a pressure disturbance. the damping ramps up from nothing at the
+          start of the layer to "strength" at the outlet, so the layer itself doesn't reflect.
+    the kernels that leave post-collision distributions in the grid ( see cs_kernel ) pull
+    post-collision values from the edge-cells, so the Zou-He cell is also collided there. the
+    equilibrium is computed once per configuration rather than per cell.
+    the obstacle mask is indexed by x + y * xdim, it is usually a pointer to the mask of the grid
+    but may be anything indexed the same way, e.g. for a lattice that doesn't store every cell.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        enum class inlet_bc {
+            equilibrium,
+            zou_he
+        };
+
+        enum class outlet_bc {
+            equilibrium,
+            zero_gradient,
+            non_reflecting
+        };
+
+        /*
+            the last "width" columns before the outlet, damped by strength * ( ( i + 1 ) / width )^ramp
+            in column i of the layer
+        */
+        struct sponge_layer {
+
+            size_t width = 0;
+            T strength = 0.05;
+            T ramp = 2.0;
+        };
+
+        struct boundary_conditions {
+
+            inlet_bc inlet;
+            outlet_bc outlet;
+
+            // velocity of the inlet flow along x, which is also the free stream at the walls
+            T u_x;
+            T rho;
+
+            // equilibrium of rho and u_x
+            std::array<T, 9> f_eq;
+
+            sponge_layer sponge = {};
+
+            // relaxation of the density towards rho at a non_reflecting outlet, 0 lets it drift
+            T outlet_relaxation = 0.25;
+
+            // whether every edge-cell holds f_eq and nothing else is applied, in which case the edges never change
+            bool equilibrium() const { return inlet == inlet_bc::equilibrium && outlet == outlet_bc::equilibrium && sponge.width == 0; }
+        };
+
+        inline boundary_conditions make_boundary_conditions( const inlet_bc inlet = inlet_bc::equilibrium,
+                                                             const outlet_bc outlet = outlet_bc::equilibrium,
+                                                             const T u_x = 0.1, const T rho = 1.0 ) {
+
+            boundary_conditions bc{ inlet, outlet, u_x, rho, {}, {} };
+
+            for ( size_t q = 0; q < 9; ++q )
+                bc.f_eq[ q ] = calculate_f_eq( q, rho, u_x, 0.0 );
+
+            return bc;
+        }
+
+        /*
+            write the distributions f of cell ( y, x ), the one place the boundary conditions write a
+            cell, so a view that doesn't store distributions can overload it ( see moment_view )
+        */
+        template<typename View, typename F>
+        void set_cell( const View& D2Q9, const size_t y, const size_t x, const F& f ) {
+
+            for ( size_t q = 0; q < 9; ++q )
+                D2Q9[ y, x, q ] = f[ q ];
+        }
+
+        /*
+            set every edge-cell of D2Q9 to the equilibrium of the boundary conditions, the starting
+            point whatever the boundary conditions
+        */
+        template<typename View>
+        void set_edge_cells( const View& D2Q9, const boundary_conditions& bc ) {
+
+            const size_t ydim = D2Q9.extent( 0 );
+            const size_t xdim = D2Q9.extent( 1 );
+
+            for ( size_t y = 0; y < ydim; ++y ) {
+
+                // inlet
+                set_cell( D2Q9, y, 0, bc.f_eq );
+                // outlet
+                set_cell( D2Q9, y, xdim - 1, bc.f_eq );
+            }
+
+            for ( size_t x = 0; x < xdim; ++x ) {
+
+                // top boundary
+                set_cell( D2Q9, 0, x, bc.f_eq );
+                // bottom boundary
+                set_cell( D2Q9, ydim - 1, x, bc.f_eq );
+            }
+        }
+
+        /*
+            Zou-He velocity inlet at cell ( y, 0 ): the distributions streaming into the cell from D2Q9,
+            with the unknown ones moving into the domain completed for velocity ( u_x, 0 ) and the
+            whole cell regularized
+        */
+        template<typename View, typename Obstacle>
+        void zou_he_inlet( const View& D2Q9, const Obstacle& obstacle, const size_t y, const T u_x, T ( &f )[ 9 ] ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            f[ 0 ] = D2Q9[ y, 0, 0 ];
+
+            for ( const size_t q : { 2, 3, 4, 6, 7 } ) {
+
+                // neighbour the distribution streams in from
+                const size_t x_s = 0 - e[ q ].first;
+                const size_t y_s = y - e[ q ].second;
+
+                if ( obstacle[ x_s + y_s * xdim ] )
+                    f[ q ] = D2Q9[ y, 0, opposite_q[ q ] ];
+                else
+                    f[ q ] = D2Q9[ y_s, x_s, q ];
+            }
+
+            const T rho = ( f[ 0 ] + f[ 2 ] + f[ 4 ] + 2.0 * ( f[ 3 ] + f[ 6 ] + f[ 7 ] ) ) / ( 1.0 - u_x );
+
+            f[ 1 ] = f[ 3 ] + ( 2.0 / 3.0 ) * rho * u_x;
+            f[ 5 ] = f[ 7 ] - 0.5 * ( f[ 2 ] - f[ 4 ] ) + ( 1.0 / 6.0 ) * rho * u_x;
+            f[ 8 ] = f[ 6 ] + 0.5 * ( f[ 2 ] - f[ 4 ] ) + ( 1.0 / 6.0 ) * rho * u_x;
+
+            // regularized: the equilibrium of rho and u_x plus the projected non-equilibrium stress
+            collide_regularized( f, 0.0 );
+        }
+
+        /*
+            the characteristic outlet at cell ( y, xdim - 1 ) of D2Q9_n, from the cell and the one next
+            to it in D2Q9, the grid of the previous step, and the one next to it in D2Q9_n
+        */
+        template<typename View, typename View_n>
+        void non_reflecting_outlet( const View& D2Q9, const View_n& D2Q9_n, const size_t y,
+                                    const boundary_conditions& bc, T ( &f )[ 9 ] ) {
+
+            const size_t xdim = D2Q9_n.extent( 1 );
+
+            auto moments = []( const T ( &f_c )[ 9 ], T& rho, T& u_x, T& u_y ) {
+
+                rho = f_c[ 0 ] + f_c[ 1 ] + f_c[ 2 ] + f_c[ 3 ] + f_c[ 4 ] + f_c[ 5 ] + f_c[ 6 ] + f_c[ 7 ] + f_c[ 8 ];
+                u_x = ( f_c[ 1 ] + f_c[ 5 ] + f_c[ 8 ] - f_c[ 3 ] - f_c[ 6 ] - f_c[ 7 ] ) / rho;
+                u_y = ( f_c[ 2 ] + f_c[ 5 ] + f_c[ 6 ] - f_c[ 4 ] - f_c[ 7 ] - f_c[ 8 ] ) / rho;
+            };
+
+            T f_b[ 9 ];
+            T f_i[ 9 ];
+
+            for ( size_t q = 0; q < 9; ++q ) {
+
+                f_b[ q ] = D2Q9[ y, xdim - 1, q ];
+                f_i[ q ] = D2Q9[ y, xdim - 2, q ];
+            }
+
+            T rho, u_x, u_y;
+            T rho_i, u_x_i, u_y_i;
+
+            moments( f_b, rho, u_x, u_y );
+            moments( f_i, rho_i, u_x_i, u_y_i );
+
+            // one-sided derivatives along x
+            const T d_rho = rho - rho_i;
+            const T d_u_x = u_x - u_x_i;
+            const T d_u_y = u_y - u_y_i;
+
+            // amplitudes of the acoustic wave leaving and the shear wave, with the isothermal pressure c_s^2 rho
+            const T L_out = ( u_x + c_s ) * ( c_s2 * d_rho + rho * c_s * d_u_x );
+            const T L_shear = std::max( u_x, T( 0.0 ) ) * d_u_y;
+
+            // the acoustic wave entering, which only pulls the density back towards the free stream
+            const T mach = u_x / c_s;
+            const T L_in = bc.outlet_relaxation * c_s * ( 1.0 - mach * mach ) / static_cast<T>( xdim - 2 ) * c_s2 * ( rho - bc.rho );
+
+            const T rho_n = rho - ( L_out + L_in ) / ( 2.0 * c_s2 );
+            const T u_x_n = u_x - ( L_out - L_in ) / ( 2.0 * rho * c_s );
+            const T u_y_n = u_y - L_shear;
+
+            // the non-equilibrium part of the column next to the outlet
+            T f_n[ 9 ];
+            T f_eq_n[ 9 ];
+
+            for ( size_t q = 0; q < 9; ++q )
+                f_n[ q ] = D2Q9_n[ y, xdim - 2, q ];
+
+            get_f_eq( f_eq_n, f_n );
+            get_f_eq( f, rho_n, u_x_n, u_y_n );
+
+            for ( size_t q = 0; q < 9; ++q )
+                f[ q ] += f_n[ q ] - f_eq_n[ q ];
+        }
+
+        /*
+            damp the density of the cell f of column i of a sponge layer: the equilibrium of the cell
+            moves by the damping of the column towards the equilibrium of the free-stream density at
+            the velocity of the cell. the velocity and the non-equilibrium part are left alone.
+        */
+        inline void damp_sponge_cell( T ( &f )[ 9 ], const size_t i, const size_t width, const boundary_conditions& bc ) {
+
+            const T sigma = bc.sponge.strength * std::pow( static_cast<T>( i + 1 ) / width, bc.sponge.ramp );
+
+            const T rho = f[ 0 ] + f[ 1 ] + f[ 2 ] + f[ 3 ] + f[ 4 ] + f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+            const T u_x = ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho;
+            const T u_y = ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho;
+
+            T f_eq[ 9 ];
+            T f_eq_s[ 9 ];
+
+            get_f_eq( f_eq, rho, u_x, u_y );
+            get_f_eq( f_eq_s, bc.rho, u_x, u_y );
+
+            for ( size_t q = 0; q < 9; ++q )
+                f[ q ] -= sigma * ( f_eq[ q ] - f_eq_s[ q ] );
+        }
+
+        // columns in the sponge layer of a grid xdim wide, the layer ends at the outlet
+        inline size_t sponge_width( const boundary_conditions& bc, const size_t xdim ) {
+
+            return std::min( bc.sponge.width, xdim - 2 );
+        }
+
+        // damp the interior cells of the sponge layer of D2Q9_n, see damp_sponge_cell
+        template<typename View_n, typename Obstacle>
+        void apply_sponge_layer( const View_n& D2Q9_n, const Obstacle& obstacle, const boundary_conditions& bc ) {
+
+            const size_t ydim = D2Q9_n.extent( 0 );
+            const size_t xdim = D2Q9_n.extent( 1 );
+
+            const size_t width = sponge_width( bc, xdim );
+            const size_t x_begin = xdim - 1 - width;
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, ydim - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t y = r.begin(); y < r.end(); ++y ) {
+                        for ( size_t x = x_begin; x < xdim - 1; ++x ) {
+
+                            if ( obstacle[ x + y * xdim ] )
+                                continue;
+
+                            T f[ 9 ];
+
+                            for ( size_t q = 0; q < 9; ++q )
+                                f[ q ] = D2Q9_n[ y, x, q ];
+
+                            damp_sponge_cell( f, x - x_begin, width, bc );
+
+                            set_cell( D2Q9_n, y, x, f );
+                        }
+                    }
+                }
+            );
+        }
+
+        /*
+            write the edge-cells of D2Q9_n, the grid a time-step of D2Q9 has just streamed into.
+            "post_collision" is whether the kernel leaves post-collision distributions, in which case
+            the Zou-He inlet is collided with Collision.
+        */
+        template<typename Collision = collision_BGK, typename View, typename View_n, typename Obstacle>
+        void apply_boundary_conditions( const View& D2Q9, const View_n& D2Q9_n, const Obstacle& obstacle,
+                                        const boundary_conditions& bc, const T omega, const bool post_collision ) {
+
+            const size_t ydim = D2Q9_n.extent( 0 );
+            const size_t xdim = D2Q9_n.extent( 1 );
+
+            // before the outlet, which pulls from the layer
+            if ( bc.sponge.width > 0 )
+                apply_sponge_layer( D2Q9_n, obstacle, bc );
+
+            for ( size_t x = 0; x < xdim; ++x ) {
+
+                // top boundary
+                set_cell( D2Q9_n, 0, x, bc.f_eq );
+                // bottom boundary
+                set_cell( D2Q9_n, ydim - 1, x, bc.f_eq );
+            }
+
+            for ( size_t y = 1; y < ydim - 1; ++y ) {
+
+                // inlet
+                if ( bc.inlet == inlet_bc::zou_he ) {
+
+                    T f[ 9 ];
+
+                    zou_he_inlet( D2Q9, obstacle, y, bc.u_x, f );
+
+                    if ( post_collision )
+                        Collision::collide( f, omega );
+
+                    set_cell( D2Q9_n, y, 0, f );
+
+                } else {
+
+                    set_cell( D2Q9_n, y, 0, bc.f_eq );
+                }
+
+                // outlet
+                if ( bc.outlet == outlet_bc::zero_gradient ) {
+
+                    T f[ 9 ];
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        f[ q ] = static_cast<T>( D2Q9_n[ y, xdim - 2, q ] );
+
+                    set_cell( D2Q9_n, y, xdim - 1, f );
+
+                } else if ( bc.outlet == outlet_bc::non_reflecting ) {
+
+                    T f[ 9 ];
+
+                    non_reflecting_outlet( D2Q9, D2Q9_n, y, bc, f );
+
+                    set_cell( D2Q9_n, y, xdim - 1, f );
+
+                } else {
+
+                    set_cell( D2Q9_n, y, xdim - 1, bc.f_eq );
+                }
+            }
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef LBM_COLLIDE_AND_STREAM_MRT_TBB_HPP
+#define LBM_COLLIDE_AND_STREAM_MRT_TBB_HPP
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <settings.hpp>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/collide_and_stream_tbb.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
+/*
+    multiple-relaxation-time ( MRT ) collision on the CPU.
+
+    the distributions are taken to the moments m = M f ( see M in common.hpp ), each moment is
+    relaxed towards its equilibrium at its own rate and the result is taken back with M_inv:
+        f -= M_inv S ( m - m_eq )
+    the moments are, in the order of the rows of M:
+        rho, e, epsilon, j_x, q_x, j_y, q_y, p_xx, p_xy
+    M only has small integer entries and most of them are zero, and the rows of M are orthogonal,
+    so M_inv is M transposed with each row scaled by 1 / |row|^2. collide_MRT writes both products
+    out by hand with the entries folded in. rho, j_x and j_y are conserved and never relaxed, which
+    leaves six relaxations and roughly a quarter of the work of two dense 9x9 products.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            direction of e that each column of M belongs to, M lists the directions in a different
+            order from e
+        */
+        constexpr std::array<size_t, 9> M_column_q = { 0, 6, 3, 7, 4, 8, 1, 5, 2 };
+
+        /*
+            relaxation rates of the non-conserved moments. a rate policy has static constexpr
+            functions of omega for each one, so rates that are constants are folded into the
+            collision at compile time.
+        */
+
+        // Lallemand and Luo, the rates the SYCL collide_MRT_ uses
+        struct mrt_rates_lallemand_luo {
+
+            static constexpr T s_e( const T ) { return 1.6; }
+            static constexpr T s_epsilon( const T ) { return 1.8; }
+            static constexpr T s_q( const T omega ) { return 8.0 * ( 2.0 - omega ) / ( 8.0 - omega ); }
+            static constexpr T s_nu( const T omega ) { return omega; }
+        };
+
+        // every moment relaxes at omega, the same collision as BGK
+        struct mrt_rates_bgk {
+
+            static constexpr T s_e( const T omega ) { return omega; }
+            static constexpr T s_epsilon( const T omega ) { return omega; }
+            static constexpr T s_q( const T omega ) { return omega; }
+            static constexpr T s_nu( const T omega ) { return omega; }
+        };
+
+        /*
+            MRT collision of the distributions of a single cell, in place. V is T, or a vector of T
+            to collide several cells at once.
+        */
+        template<typename Rates = mrt_rates_lallemand_luo, typename V>
+        [[gnu::always_inline]] inline void collide_MRT( V ( &f )[ 9 ], const T omega ) {
+
+            // sums and differences shared by the moments
+            const V axis = f[ 1 ] + f[ 2 ] + f[ 3 ] + f[ 4 ];
+            const V diagonal = f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+            const V axis_x = f[ 1 ] - f[ 3 ];
+            const V axis_y = f[ 2 ] - f[ 4 ];
+            const V diagonal_x = f[ 5 ] - f[ 6 ] - f[ 7 ] + f[ 8 ];
+            const V diagonal_y = f[ 5 ] + f[ 6 ] - f[ 7 ] - f[ 8 ];
+
+            // moments, m = M f
+            const V rho = f[ 0 ] + axis + diagonal;
+            const V e = -4.0 * f[ 0 ] - axis + 2.0 * diagonal;
+            const V epsilon = 4.0 * f[ 0 ] - 2.0 * axis + diagonal;
+            const V j_x = axis_x + diagonal_x;
+            const V q_x = -2.0 * axis_x + diagonal_x;
+            const V j_y = axis_y + diagonal_y;
+            const V q_y = -2.0 * axis_y + diagonal_y;
+            const V p_xx = f[ 1 ] - f[ 2 ] + f[ 3 ] - f[ 4 ];
+            const V p_xy = f[ 5 ] - f[ 6 ] + f[ 7 ] - f[ 8 ];
+
+            const V rho_inv = 1.0 / rho;
+            const V j_2 = ( j_x * j_x + j_y * j_y ) * rho_inv;
+
+            /*
+                S ( m - m_eq ) scaled by 1 / |row|^2 of M, which turns M transposed into M_inv
+            */
+            const V c_e = ( Rates::s_e( omega ) / 36.0 ) * ( e - ( -2.0 * rho + 3.0 * j_2 ) );
+            const V c_epsilon = ( Rates::s_epsilon( omega ) / 36.0 ) * ( epsilon - ( rho - 3.0 * j_2 ) );
+            const V c_q_x = ( Rates::s_q( omega ) / 12.0 ) * ( q_x + j_x );
+            const V c_q_y = ( Rates::s_q( omega ) / 12.0 ) * ( q_y + j_y );
+            const V c_xx = ( Rates::s_nu( omega ) / 4.0 ) * ( p_xx - ( j_x * j_x - j_y * j_y ) * rho_inv );
+            const V c_xy = ( Rates::s_nu( omega ) / 4.0 ) * ( p_xy - j_x * j_y * rho_inv );
+
+            // f -= M_inv S ( m - m_eq ), the columns of M for each direction
+            const V axis_c = -c_e - 2.0 * c_epsilon;
+            const V diagonal_c = 2.0 * c_e + c_epsilon;
+
+            f[ 0 ] -= 4.0 * ( c_epsilon - c_e );
+            f[ 1 ] -= axis_c - 2.0 * c_q_x + c_xx;
+            f[ 2 ] -= axis_c - 2.0 * c_q_y - c_xx;
+            f[ 3 ] -= axis_c + 2.0 * c_q_x + c_xx;
+            f[ 4 ] -= axis_c + 2.0 * c_q_y - c_xx;
+            f[ 5 ] -= diagonal_c + c_q_x + c_q_y + c_xy;
+            f[ 6 ] -= diagonal_c - c_q_x + c_q_y - c_xy;
+            f[ 7 ] -= diagonal_c - c_q_x - c_q_y + c_xy;
+            f[ 8 ] -= diagonal_c + c_q_x - c_q_y - c_xy;
+        }
+
+        // MRT as a collision policy for the kernels, see collision.hpp
+        template<typename Rates = mrt_rates_lallemand_luo>
+        struct collision_MRT {
+
+            template<typename V>
+            [[gnu::always_inline]] static void collide( V ( &f )[ 9 ], const T omega ) {
+
+                collide_MRT<Rates>( f, omega );
+            }
+        };
+
+        /*
+            the same collision with the dense products by M and M_inv, as in the SYCL collide_MRT_.
+            s holds the rates of all nine moments in the order of the rows of M.
+        */
+        inline void collide_MRT_dense( T ( &f )[ 9 ], const std::array<T, 9>& s ) {
+
+            T m[ 9 ] = {};
+
+            for ( size_t i = 0; i < 9; ++i )
+                for ( size_t j = 0; j < 9; ++j )
+                    m[ i ] += M[ j + i * 9 ] * f[ M_column_q[ j ] ];
+
+            const T rho = m[ 0 ];
+            const T j_x = m[ 3 ];
+            const T j_y = m[ 5 ];
+
+            const T m_eq[ 9 ] = {
+                rho,
+                -2.0 * rho + 3.0 * ( j_x * j_x + j_y * j_y ) / rho,
+                rho - 3.0 * ( j_x * j_x + j_y * j_y ) / rho,
+                j_x,
+                -j_x,
+                j_y,
+                -j_y,
+                ( j_x * j_x - j_y * j_y ) / rho,
+                j_x * j_y / rho
+            };
+
+            for ( size_t i = 0; i < 9; ++i )
+                m[ i ] -= s[ i ] * ( m[ i ] - m_eq[ i ] );
+
+            for ( size_t i = 0; i < 9; ++i ) {
+
+                T f_i{};
+
+                for ( size_t j = 0; j < 9; ++j )
+                    f_i += M_inv[ j + i * 9 ] * m[ j ];
+
+                f[ M_column_q[ i ] ] = f_i;
+            }
+        }
+
+        // rates of all nine moments of a rate policy, for collide_MRT_dense
+        template<typename Rates>
+        std::array<T, 9> get_mrt_rates( const T omega ) {
+
+            return { 0.0, Rates::s_e( omega ), Rates::s_epsilon( omega ), 0.0, Rates::s_q( omega ),
+                     0.0, Rates::s_q( omega ), Rates::s_nu( omega ), Rates::s_nu( omega ) };
+        }
+
+        /*
+            MRT collision of every cell in the grid, in place
+        */
+        template<typename Rates = mrt_rates_lallemand_luo, typename View>
+        void collide_MRT_tbb( const View& D2Q9, const T omega ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, D2Q9.extent( 0 ) * xdim ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t i = r.begin(); i < r.end(); ++i ) {
+
+                        const size_t y = i / xdim;
+                        const size_t x = i % xdim;
+
+                        T f[ 9 ];
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            f[ q ] = D2Q9[ y, x, q ];
+
+                        collide_MRT<Rates>( f, omega );
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            D2Q9[ y, x, q ] = f[ q ];
+                    }
+                }
+            );
+        }
+
+        template<typename Rates = mrt_rates_lallemand_luo>
+        void collide_MRT_tbb( T* D2Q9, const size_t vec_len, const T omega ) {
+
+            collide_MRT_tbb<Rates>( make_lattice_view<layout_aos>( D2Q9, 1, vec_len ), omega );
+        }
+
+        /*
+            the MRT counterpart of collide_and_stream_tbb, boundary conditions and all
+        */
+        template<typename Rates = mrt_rates_lallemand_luo>
+        void collide_and_stream_MRT_tbb( double* D2Q9, unsigned char* obstacle, size_t steps,
+                                         const boundary_conditions& bc = make_boundary_conditions() ) {
+
+            const T viscosity = 0.005;
+
+            const T omega = 1 / ( 3 * viscosity + 0.5 );
+
+            const size_t ydim = fs::settings::ydim;
+            const size_t xdim = fs::settings::xdim;
+            const size_t vec_len = ydim * xdim;
+
+            std::vector<T> D2Q9_copy( D2Q9, D2Q9 + vec_len * 9 );
+
+            T* D2Q9_c = D2Q9;
+            T* D2Q9_n = D2Q9_copy.data();
+
+            const std::vector<boundary_link> links = get_boundary_links( obstacle, ydim, xdim );
+
+            for ( size_t z = 0; z < steps; ++z ) {
+
+                collide_MRT_tbb<Rates>( D2Q9_c, vec_len, omega );
+
+                stream_tbb( D2Q9_c, D2Q9_n, ydim, xdim );
+
+                bounce_back_tbb( D2Q9_n, links, ydim, xdim );
+
+                apply_boundary_conditions( make_lattice_view<layout_aos>( D2Q9_c, ydim, xdim ), make_lattice_view<layout_aos>( D2Q9_n, ydim, xdim ),
+                                           obstacle, bc, omega, false );
+
+                std::swap( D2Q9_c, D2Q9_n );
+            }
+
+            if ( D2Q9_c != D2Q9 )
+                std::memcpy( D2Q9, D2Q9_c, vec_len * 9 * sizeof( T ) );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
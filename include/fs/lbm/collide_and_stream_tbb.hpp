@@ -4,151 +4,245 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <vector>
+
 #ifndef DPCPP_COMPILER
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
 #endif
 
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
 using T = double;
 
 namespace fs {
 
     namespace lbm {
 
-        inline void collide_and_stream_tbb( double* D2Q9, unsigned char* obstacle, size_t steps ) {
+        /*
+            collision of every cell in the grid, in place
+        */
+        template<typename Collision = collision_BGK, typename View>
+        void collide_tbb( const View& D2Q9, const T omega ) {
 
-            const T viscosity = 0.005;
+            const size_t xdim = D2Q9.extent( 1 );
 
-            const T omega = 1 / ( 3 * viscosity + 0.5 );
+            // every cell is independent, so split the grid by cells rather than rows
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, D2Q9.extent( 0 ) * xdim ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
 
-            const size_t ydim = fs::settings::ydim;
-            const size_t xdim = fs::settings::xdim;
-            const size_t vec_len = ydim * xdim;
+                    size_t y = r.begin() / xdim;
+                    size_t x = r.begin() % xdim;
 
-            T* D2Q9_n = ( T* )std::malloc( ydim * xdim * 9 * sizeof( T ) );
+                    for ( size_t i = r.begin(); i < r.end(); ++i, ++x ) {
 
-            T* D2Q9_n_initial = D2Q9_n;
+                        if ( x == xdim ) {
 
-            std::memcpy( D2Q9_n, D2Q9, ydim * xdim * 9 * sizeof( T ) );
+                            x = 0;
+                            ++y;
+                        }
 
-            for ( size_t z = 0; z < steps; ++z ) {
+                        T f[ 9 ];
 
-                // collide
+                        for ( size_t q = 0; q < 9; ++q )
+                            f[ q ] = D2Q9[ y, x, q ];
 
-                tbb::parallel_for( tbb::blocked_range<size_t>( 0, vec_len ),
-                    [&]( const tbb::blocked_range<size_t>& r ) {
+                        Collision::collide( f, omega );
 
-                        for ( size_t i = r.begin(); i < r.end(); ++i ) {
-                
-                            const size_t index_offset = i * 9;
+                        for ( size_t q = 0; q < 9; ++q )
+                            D2Q9[ y, x, q ] = f[ q ];
+                    }
+                }
+            );
+        }
 
-                            T rho_{};
-                                
-                            for ( size_t k = 0; k < 9; ++k )
-                                rho_ += D2Q9[ index_offset + k ];
+        // collision of every cell in rows [ y_begin, y_end ), in place
+        template<typename Collision = collision_BGK, typename View>
+        void collide_rows( const View& D2Q9, const size_t y_begin, const size_t y_end, const T omega ) {
 
-                            T ux_{};
+            for ( size_t y = y_begin; y < y_end; ++y ) {
+                for ( size_t x = 0; x < D2Q9.extent( 1 ); ++x ) {
 
-                            ux_ = ( D2Q9[ index_offset + 1 ] + D2Q9[ index_offset + 5 ] +
-                                    D2Q9[ index_offset + 8 ] - D2Q9[ index_offset + 3 ] -
-                                    D2Q9[ index_offset + 6 ] - D2Q9[ index_offset + 7 ] ) / rho_;
+                    T f[ 9 ];
 
-                            T uy_{};
+                    for ( size_t q = 0; q < 9; ++q )
+                        f[ q ] = D2Q9[ y, x, q ];
 
-                            uy_ = ( D2Q9[ index_offset + 2 ] + D2Q9[ index_offset + 5 ] +
-                                    D2Q9[ index_offset + 6 ] - D2Q9[ index_offset + 4 ] -
-                                    D2Q9[ index_offset + 7 ] - D2Q9[ index_offset + 8 ] ) / rho_;
+                    Collision::collide( f, omega );
 
-                            const T ux_2 = ux_ * ux_;
-                            const T uy_2 = uy_ * uy_;
-                            const T u_215 = 1.5 * ( ( ux_2 ) + ( uy_2 ) );
-                            const T ux_3 = ux_ * 3;
-                            const T uy_3 = uy_ * 3;
+                    for ( size_t q = 0; q < 9; ++q )
+                        D2Q9[ y, x, q ] = f[ q ];
+                }
+            }
+        }
 
-                            D2Q9[ index_offset ] += omega * ( ( 4.0 / 9.0 ) * rho_ * ( 1 - u_215 ) - D2Q9[ index_offset ] );
+        template<typename Collision = collision_BGK>
+        void collide_tbb( T* D2Q9, const size_t vec_len, const T omega ) {
 
-                            D2Q9[ index_offset + 1 ] += omega * ( ( 1.0f / 9.0f ) * rho_ * ( 1 + ux_3 + 4.5 * ux_2 - u_215 ) - D2Q9[ index_offset + 1 ] );
+            collide_tbb<Collision>( make_lattice_view<layout_aos>( D2Q9, 1, vec_len ), omega );
+        }
 
-                            D2Q9[ index_offset + 2 ] += omega * ( ( 1.0f / 9.0f ) * rho_ * ( 1 + uy_3 + 4.5 * uy_2 - u_215 ) - D2Q9[ index_offset + 2 ] );
+        // stream the post-collision distributions of the interior cells of rows [ y_begin, y_end ) from D2Q9 into D2Q9_n
+        template<typename View, typename View_n>
+        void stream_rows( const View& D2Q9, const View_n& D2Q9_n, const size_t y_begin, const size_t y_end ) {
 
-                            D2Q9[ index_offset + 3 ] += omega * ( ( 1.0f / 9.0f ) * rho_ * ( 1 - ux_3 + 4.5 * ux_2 - u_215 ) - D2Q9[ index_offset + 3 ] );    
-                        
-                            D2Q9[ index_offset + 4 ] += omega * ( ( 1.0f / 9.0f ) * rho_ * ( 1 - uy_3 + 4.5 * uy_2 - u_215 )  - D2Q9[ index_offset + 4 ] ); 
-                        
-                            const T uxuy_2 = 2 * ux_ * uy_;
+            const size_t xdim = D2Q9.extent( 1 );
 
-                            const T u_2 = ux_2 + uy_2;
+            for ( size_t y = y_begin; y < y_end; ++y ) {
 
-                            D2Q9[ index_offset + 5 ] += omega * ( ( 1.0f / 36.0f ) * rho_ * ( 1 + ux_3 + uy_3 + 4.5 * ( u_2 + uxuy_2 ) - u_215 ) - D2Q9[ index_offset + 5 ] ); 
+                for ( size_t x = 1; x < xdim - 1; ++x ) {
 
-                            D2Q9[ index_offset + 6 ] += omega * ( ( 1.0f / 36.0f ) * rho_ * ( 1 - ux_3 + uy_3 + 4.5 * ( u_2 - uxuy_2 ) - u_215 ) - D2Q9[ index_offset + 6 ] );
+                    D2Q9_n[ y, x, 0 ] = D2Q9[ y, x, 0 ];
 
-                            D2Q9[ index_offset + 7 ] += omega * ( ( 1.0f / 36.0f ) * rho_ * ( 1 - ux_3 - uy_3 + 4.5 * ( u_2 + uxuy_2 ) - u_215 ) - D2Q9[ index_offset + 7 ] ); 
-                    
-                            D2Q9[ index_offset + 8 ] += omega * ( ( 1.0f / 36.0f ) * rho_ * ( 1 + ux_3 - uy_3 + 4.5 * ( u_2 - uxuy_2 ) - u_215 ) - D2Q9[ index_offset + 8 ] ); 
-                        }
-                    }
-                );
+                    D2Q9_n[ y, x, 1 ] = D2Q9[ y, x - 1, 1 ];
 
-                // stream
+                    D2Q9_n[ y, x, 4 ] = D2Q9[ y + 1, x, 4 ];
 
-                tbb::parallel_for( tbb::blocked_range<size_t>( 1, ydim - 1 ),
-                    [&]( const tbb::blocked_range<size_t>& r ) {
+                    D2Q9_n[ y, x, 3 ] = D2Q9[ y, x + 1, 3 ];
 
-                        for ( size_t y = r.begin(); y < r.end(); ++y ) {
+                    D2Q9_n[ y, x, 2 ] = D2Q9[ y - 1, x, 2 ];
 
-                            for ( size_t x = 1; x < xdim - 1; ++x ) {
+                    D2Q9_n[ y, x, 8 ] = D2Q9[ y + 1, x - 1, 8 ];
 
-                                const size_t base_index = ( x + y * xdim ) * 9;
+                    D2Q9_n[ y, x, 7 ] = D2Q9[ y + 1, x + 1, 7 ];
 
-                                D2Q9_n[ base_index ] = D2Q9[ base_index ];
+                    D2Q9_n[ y, x, 6 ] = D2Q9[ y - 1, x + 1, 6 ];
 
-                                D2Q9_n[ base_index + 1 ] = D2Q9[ ( ( x - 1 ) + y * xdim ) * 9 + 1 ];
+                    D2Q9_n[ y, x, 5 ] = D2Q9[ y - 1, x - 1, 5 ];
+                }
+            }
+        }
 
-                                D2Q9_n[ base_index + 4 ] = D2Q9[ ( x + ( y + 1 ) * xdim ) * 9 + 4 ];
+        /*
+            stream the post-collision distributions of the interior cells from D2Q9 into D2Q9_n.
+            edge cells of D2Q9_n are left untouched.
+        */
+        template<typename View, typename View_n>
+        void stream_tbb( const View& D2Q9, const View_n& D2Q9_n ) {
 
-                                D2Q9_n[ base_index + 3 ] = D2Q9[ ( ( x + 1 ) + y * xdim ) * 9 + 3 ];
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, D2Q9.extent( 0 ) - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
 
-                                D2Q9_n[ base_index + 2 ] = D2Q9[ ( x + ( y - 1 ) * xdim ) * 9 + 2 ];
+                    stream_rows( D2Q9, D2Q9_n, r.begin(), r.end() );
+                }
+            );
+        }
 
-                                D2Q9_n[ base_index + 8 ] = D2Q9[ ( ( x - 1 ) + ( y + 1 ) * xdim ) * 9 + 8 ];
+        inline void stream_tbb( const T* D2Q9, T* D2Q9_n, const size_t ydim, const size_t xdim ) {
 
-                                D2Q9_n[ base_index + 7 ] = D2Q9[ ( ( x + 1 ) + ( y + 1 ) * xdim ) * 9 + 7 ];
+            stream_tbb( make_lattice_view<layout_aos>( D2Q9, ydim, xdim ), make_lattice_view<layout_aos>( D2Q9_n, ydim, xdim ) );
+        }
 
-                                D2Q9_n[ base_index + 6 ] = D2Q9[ ( ( x + 1 ) + ( y - 1 ) * xdim ) * 9 + 6 ];
+        /*
+            a link between a fluid cell and a neighbouring obstacle cell. after streaming, the
+            distribution of the fluid cell in direction q is the one that was streamed into the
+            obstacle cell in the opposite direction.
+        */
+        struct boundary_link {
 
-                                D2Q9_n[ base_index + 5 ] = D2Q9[ ( ( x - 1 ) + ( y - 1 ) * xdim ) * 9 + 5 ];
-                            }
-                        }
-                    }
-                );
+            // 1D index of the fluid cell, the destination
+            size_t fluid;
+            // 1D index of the obstacle cell, the source
+            size_t solid;
 
-                for ( size_t y = 1; y < ydim; ++y ) {
+            size_t q;
+        };
 
-                    for ( size_t x = 1; x < xdim - 1; ++x ) {
+        /*
+            compile the obstacle mask into the links between interior obstacle cells and the fluid
+            cells around them, only needs redoing when the obstacle changes
+        */
+        inline std::vector<boundary_link> get_boundary_links( const unsigned char* obstacle, const size_t ydim, const size_t xdim ) {
 
-                        if ( obstacle[ x + y * xdim ] ) {
+            std::vector<boundary_link> links;
 
-                            size_t index = ( x + y * xdim ) * 9;
-                
-                            D2Q9_n[ ( x + 1 + y * xdim ) * 9 + 1 ] = D2Q9_n[ index + 3 ];
+            for ( size_t y = 1; y < ydim - 1; ++y ) {
 
-                            D2Q9_n[ ( x - 1 + y * xdim ) * 9 + 3 ] = D2Q9_n[ index + 1 ];
+                for ( size_t x = 1; x < xdim - 1; ++x ) {
 
-                            D2Q9_n[ ( x + ( y + 1 ) * xdim ) * 9 + 2 ] = D2Q9_n[ index + 4 ];
+                    const size_t solid = x + y * xdim;
 
-                            D2Q9_n[ ( x + ( y - 1 ) * xdim ) * 9 + 4 ] = D2Q9_n[ index + 2 ];
+                    if ( !obstacle[ solid ] )
+                        continue;
 
-                            D2Q9_n[ ( x + 1 + ( y + 1 ) * xdim ) * 9 + 5 ] = D2Q9_n[ index + 7 ];
+                    for ( size_t q = 1; q < 9; ++q ) {
 
-                            D2Q9_n[ ( x - 1 + ( y + 1 ) * xdim ) * 9 + 6 ] = D2Q9_n[ index + 8 ];
+                        const size_t fluid = ( x + e[ q ].first ) + ( y + e[ q ].second ) * xdim;
 
-                            D2Q9_n[ ( x + 1 + ( y - 1 ) * xdim ) * 9 + 8 ] = D2Q9_n[ index + 6 ];
+                        if ( !obstacle[ fluid ] )
+                            links.push_back( { fluid, solid, q } );
+                    }
+                }
+            }
 
-                            D2Q9_n[ ( x - 1 + ( y - 1 ) * xdim ) * 9 + 7 ] = D2Q9_n[ index + 5 ];
-                        }
-                    }  
+            return links;
+        }
+
+        /*
+            reflect the distributions that were streamed into obstacle cells back into the
+            neighbouring cells they came from. every link writes a different fluid distribution and
+            only reads obstacle distributions, so the links are independent.
+        */
+        template<typename View>
+        void bounce_back_tbb( const View& D2Q9_n, const std::vector<boundary_link>& links ) {
+
+            const size_t xdim = D2Q9_n.extent( 1 );
+
+            // small obstacles don't have enough links to be worth splitting
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, links.size(), 512 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t i = r.begin(); i < r.end(); ++i ) {
+
+                        const boundary_link& link = links[ i ];
+
+                        D2Q9_n[ link.fluid / xdim, link.fluid % xdim, link.q ] =
+                            D2Q9_n[ link.solid / xdim, link.solid % xdim, opposite_q[ link.q ] ];
+                    }
                 }
+            );
+        }
+
+        inline void bounce_back_tbb( T* D2Q9_n, const std::vector<boundary_link>& links, const size_t ydim, const size_t xdim ) {
+
+            bounce_back_tbb( make_lattice_view<layout_aos>( D2Q9_n, ydim, xdim ), links );
+        }
+
+        /*
+            advance the grid by "steps" time-steps, applying the boundary conditions every step
+        */
+        inline void collide_and_stream_tbb( double* D2Q9, unsigned char* obstacle, size_t steps,
+                                            const boundary_conditions& bc = make_boundary_conditions() ) {
+
+            const T viscosity = 0.005;
+
+            const T omega = 1 / ( 3 * viscosity + 0.5 );
+
+            const size_t ydim = fs::settings::ydim;
+            const size_t xdim = fs::settings::xdim;
+            const size_t vec_len = ydim * xdim;
+
+            T* D2Q9_n = ( T* )std::malloc( ydim * xdim * 9 * sizeof( T ) );
+
+            T* D2Q9_n_initial = D2Q9_n;
+
+            std::memcpy( D2Q9_n, D2Q9, ydim * xdim * 9 * sizeof( T ) );
+
+            const std::vector<boundary_link> links = get_boundary_links( obstacle, ydim, xdim );
+
+            for ( size_t z = 0; z < steps; ++z ) {
+
+                collide_tbb( D2Q9, vec_len, omega );
+
+                stream_tbb( D2Q9, D2Q9_n, ydim, xdim );
+
+                bounce_back_tbb( D2Q9_n, links, ydim, xdim );
+
+                apply_boundary_conditions( make_lattice_view<layout_aos>( D2Q9, ydim, xdim ), make_lattice_view<layout_aos>( D2Q9_n, ydim, xdim ),
+                                           obstacle, bc, omega, false );
 
                 std::swap( D2Q9, D2Q9_n );
             }
@@ -0,0 +1,216 @@
+#ifndef LBM_COLLISION_HPP
+#define LBM_COLLISION_HPP
+
+#include <cstddef>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+
+/*
+    collision operators as policies for the kernels.
+
+    a policy is a struct with a static collide( f, omega ) that collides the distributions of a
+    single cell in place. the kernels take the policy as a template parameter, defaulting to
+    collision_BGK, and call it where they used to collide inline, so every kernel gets every
+    operator, inlined, with the same memory access:
+    ( 1 ) collision_BGK: single relaxation time.
+    ( 2 ) collision_TRT: two relaxation times, for the parts of f that are even and odd in e.
+    ( 3 ) collision_regularized: BGK on the non-equilibrium part projected onto the second moments.
+    ( 4 ) collision_MRT: multiple relaxation times, see collide_and_stream_MRT_tbb.hpp.
+    V is T, or a vector of T to collide several cells at once ( see simd_collide_and_stream_tbb.hpp ).
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            BGK collision of the distributions of a single cell, in place
+        */
+        template<typename V>
+        [[gnu::always_inline]] inline void collide_BGK( V ( &f )[ 9 ], const T omega ) {
+
+            const V rho = f[ 0 ] + f[ 1 ] + f[ 2 ] + f[ 3 ] + f[ 4 ] + f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+            const V u_x = ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho;
+            const V u_y = ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho;
+
+            const V ux_2 = u_x * u_x;
+            const V uy_2 = u_y * u_y;
+            const V u_215 = 1.5 * ( ux_2 + uy_2 );
+            const V ux_3 = 3.0 * u_x;
+            const V uy_3 = 3.0 * u_y;
+            const V uxuy_2 = 2.0 * u_x * u_y;
+            const V u_2 = ux_2 + uy_2;
+
+            const V rho_0 = w[ 0 ] * rho;
+            const V rho_1 = w[ 1 ] * rho;
+            const V rho_5 = w[ 5 ] * rho;
+
+            f[ 0 ] += omega * ( rho_0 * ( 1.0                                      - u_215 ) - f[ 0 ] );
+            f[ 1 ] += omega * ( rho_1 * ( 1.0 + ux_3        + 4.5 * ux_2             - u_215 ) - f[ 1 ] );
+            f[ 2 ] += omega * ( rho_1 * ( 1.0 + uy_3        + 4.5 * uy_2             - u_215 ) - f[ 2 ] );
+            f[ 3 ] += omega * ( rho_1 * ( 1.0 - ux_3        + 4.5 * ux_2             - u_215 ) - f[ 3 ] );
+            f[ 4 ] += omega * ( rho_1 * ( 1.0 - uy_3        + 4.5 * uy_2             - u_215 ) - f[ 4 ] );
+            f[ 5 ] += omega * ( rho_5 * ( 1.0 + ux_3 + uy_3 + 4.5 * ( u_2 + uxuy_2 ) - u_215 ) - f[ 5 ] );
+            f[ 6 ] += omega * ( rho_5 * ( 1.0 - ux_3 + uy_3 + 4.5 * ( u_2 - uxuy_2 ) - u_215 ) - f[ 6 ] );
+            f[ 7 ] += omega * ( rho_5 * ( 1.0 - ux_3 - uy_3 + 4.5 * ( u_2 + uxuy_2 ) - u_215 ) - f[ 7 ] );
+            f[ 8 ] += omega * ( rho_5 * ( 1.0 + ux_3 - uy_3 + 4.5 * ( u_2 - uxuy_2 ) - u_215 ) - f[ 8 ] );
+        }
+
+        /*
+            equilibrium distributions of a cell with density rho and velocity ( u_x, u_y )
+        */
+        template<typename V>
+        [[gnu::always_inline]] inline void get_f_eq( V ( &f_eq )[ 9 ], const V& rho, const V& u_x, const V& u_y ) {
+
+            const V ux_2 = u_x * u_x;
+            const V uy_2 = u_y * u_y;
+            const V u_215 = 1.5 * ( ux_2 + uy_2 );
+            const V ux_3 = 3.0 * u_x;
+            const V uy_3 = 3.0 * u_y;
+            const V uxuy_2 = 2.0 * u_x * u_y;
+            const V u_2 = ux_2 + uy_2;
+
+            const V rho_0 = w[ 0 ] * rho;
+            const V rho_1 = w[ 1 ] * rho;
+            const V rho_5 = w[ 5 ] * rho;
+
+            f_eq[ 0 ] = rho_0 * ( 1.0                                      - u_215 );
+            f_eq[ 1 ] = rho_1 * ( 1.0 + ux_3        + 4.5 * ux_2             - u_215 );
+            f_eq[ 2 ] = rho_1 * ( 1.0 + uy_3        + 4.5 * uy_2             - u_215 );
+            f_eq[ 3 ] = rho_1 * ( 1.0 - ux_3        + 4.5 * ux_2             - u_215 );
+            f_eq[ 4 ] = rho_1 * ( 1.0 - uy_3        + 4.5 * uy_2             - u_215 );
+            f_eq[ 5 ] = rho_5 * ( 1.0 + ux_3 + uy_3 + 4.5 * ( u_2 + uxuy_2 ) - u_215 );
+            f_eq[ 6 ] = rho_5 * ( 1.0 - ux_3 + uy_3 + 4.5 * ( u_2 - uxuy_2 ) - u_215 );
+            f_eq[ 7 ] = rho_5 * ( 1.0 - ux_3 - uy_3 + 4.5 * ( u_2 + uxuy_2 ) - u_215 );
+            f_eq[ 8 ] = rho_5 * ( 1.0 + ux_3 - uy_3 + 4.5 * ( u_2 - uxuy_2 ) - u_215 );
+        }
+
+        // equilibrium distributions of the density and velocity of f
+        template<typename V>
+        [[gnu::always_inline]] inline void get_f_eq( V ( &f_eq )[ 9 ], const V ( &f )[ 9 ] ) {
+
+            const V rho = f[ 0 ] + f[ 1 ] + f[ 2 ] + f[ 3 ] + f[ 4 ] + f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+            const V u_x = ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho;
+            const V u_y = ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho;
+
+            get_f_eq( f_eq, rho, u_x, u_y );
+        }
+
+        /*
+            TRT collision of a single cell, in place. the part of f that is even in e relaxes at
+            omega, the odd part at a rate set by the magic parameter
+                magic = ( 1 / omega_+ - 1 / 2 ) ( 1 / omega_- - 1 / 2 )
+            3 / 16 puts half-way bounce-back walls exactly half-way between the cells.
+        */
+        template<typename V>
+        [[gnu::always_inline]] inline void collide_TRT( V ( &f )[ 9 ], const T omega, const T magic ) {
+
+            const T omega_p = omega;
+            const T omega_m = 1.0 / ( 0.5 + magic / ( 1.0 / omega - 0.5 ) );
+
+            V f_eq[ 9 ];
+
+            get_f_eq( f_eq, f );
+
+            f[ 0 ] += omega_p * ( f_eq[ 0 ] - f[ 0 ] );
+
+            // each direction with its opposite
+            for ( const size_t q : { 1, 2, 5, 6 } ) {
+
+                const size_t o = opposite_q[ q ];
+
+                const V neq_p = 0.5 * ( ( f[ q ] + f[ o ] ) - ( f_eq[ q ] + f_eq[ o ] ) );
+                const V neq_m = 0.5 * ( ( f[ q ] - f[ o ] ) - ( f_eq[ q ] - f_eq[ o ] ) );
+
+                f[ q ] -= omega_p * neq_p + omega_m * neq_m;
+                f[ o ] -= omega_p * neq_p - omega_m * neq_m;
+            }
+        }
+
+        /*
+            regularized BGK collision of a single cell, in place. the non-equilibrium part of f is
+            replaced by its projection onto the second moments, Pi_ab = sum e_a e_b ( f - f_eq ),
+            which drops the higher-order non-equilibrium parts that BGK would carry along.
+                f = f_eq + ( 1 - omega ) w_q / ( 2 c_s^4 ) ( e_a e_b - c_s^2 delta_ab ) Pi_ab
+        */
+        template<typename V>
+        [[gnu::always_inline]] inline void collide_regularized( V ( &f )[ 9 ], const T omega ) {
+
+            V f_eq[ 9 ];
+
+            get_f_eq( f_eq, f );
+
+            V neq[ 9 ];
+
+            for ( size_t q = 0; q < 9; ++q )
+                neq[ q ] = f[ q ] - f_eq[ q ];
+
+            const V diagonal = neq[ 5 ] + neq[ 6 ] + neq[ 7 ] + neq[ 8 ];
+
+            const V pi_xx = neq[ 1 ] + neq[ 3 ] + diagonal;
+            const V pi_yy = neq[ 2 ] + neq[ 4 ] + diagonal;
+            const V pi_xy = neq[ 5 ] - neq[ 6 ] + neq[ 7 ] - neq[ 8 ];
+
+            // ( 1 - omega ) w_q / ( 2 c_s^4 ) for each kind of direction, 1 / ( 2 c_s^4 ) = 4.5
+            const T scale_0 = ( 1.0 - omega ) * 4.5 * w[ 0 ];
+            const T scale_1 = ( 1.0 - omega ) * 4.5 * w[ 1 ];
+            const T scale_5 = ( 1.0 - omega ) * 4.5 * w[ 5 ];
+
+            const V trace = pi_xx + pi_yy;
+
+            f[ 0 ] = f_eq[ 0 ] - scale_0 * ( trace / 3.0 );
+
+            const V axis_x = scale_1 * ( 2.0 / 3.0 * pi_xx - pi_yy / 3.0 );
+            const V axis_y = scale_1 * ( 2.0 / 3.0 * pi_yy - pi_xx / 3.0 );
+
+            f[ 1 ] = f_eq[ 1 ] + axis_x;
+            f[ 2 ] = f_eq[ 2 ] + axis_y;
+            f[ 3 ] = f_eq[ 3 ] + axis_x;
+            f[ 4 ] = f_eq[ 4 ] + axis_y;
+
+            const V diagonal_p = scale_5 * ( 2.0 / 3.0 * trace + 2.0 * pi_xy );
+            const V diagonal_m = scale_5 * ( 2.0 / 3.0 * trace - 2.0 * pi_xy );
+
+            f[ 5 ] = f_eq[ 5 ] + diagonal_p;
+            f[ 6 ] = f_eq[ 6 ] + diagonal_m;
+            f[ 7 ] = f_eq[ 7 ] + diagonal_p;
+            f[ 8 ] = f_eq[ 8 ] + diagonal_m;
+        }
+
+        struct collision_BGK {
+
+            template<typename V>
+            [[gnu::always_inline]] static void collide( V ( &f )[ 9 ], const T omega ) {
+
+                collide_BGK( f, omega );
+            }
+        };
+
+        struct collision_TRT {
+
+            static constexpr T magic = 3.0 / 16.0;
+
+            template<typename V>
+            [[gnu::always_inline]] static void collide( V ( &f )[ 9 ], const T omega ) {
+
+                collide_TRT( f, omega, magic );
+            }
+        };
+
+        struct collision_regularized {
+
+            template<typename V>
+            [[gnu::always_inline]] static void collide( V ( &f )[ 9 ], const T omega ) {
+
+                collide_regularized( f, omega );
+            }
+        };
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -45,18 +45,18 @@ namespace fs {
 
         /*
             look-up table used during bounce-back to flip the direction
-            of streaming
+            of streaming, indexed with the same direction numbering as e
         */
         constexpr std::array<size_t, 9> opposite_q = {
             0,  // [ 0 ] opposite( rest particle )  => rest particle
-            5,  // [ 1 ] opposite( up )             => down
-            6,  // [ 2 ] opposite( up-right )       => down-left
-            7,  // [ 3 ] opposite( right )          => left
-            8,  // [ 4 ] opposite( down-right )     => up-left
-            1,  // [ 5 ] opposite( down )           => up
-            2,  // [ 6 ] opposite( down-left )      => up-right
-            3,  // [ 7 ] opposite( left )           => right
-            4   // [ 8 ] opposite( up-left )        => down-right
+            3,  // [ 1 ] opposite( right )          => left
+            4,  // [ 2 ] opposite( up )             => down
+            1,  // [ 3 ] opposite( left )           => right
+            2,  // [ 4 ] opposite( down )           => up
+            7,  // [ 5 ] opposite( up-right )       => down-left
+            8,  // [ 6 ] opposite( up-left )        => down-right
+            5,  // [ 7 ] opposite( down-left )      => up-right
+            6   // [ 8 ] opposite( down-right )     => up-left
         };
 
         /*
@@ -0,0 +1,212 @@
+#ifndef LBM_CONVERGENCE_HPP
+#define LBM_CONVERGENCE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/macroscopic.hpp>
+#include <fs/lbm/stateful_collide_and_stream_tbb.hpp>
+
+/*
+    steady-state detection for the engine.
+
+    every "period" steps the density and velocity are sampled, for free with the fused kernel ( see
+    macroscopic.hpp ), and compared with the previous sample over the n fluid cells:
+        velocity: L2 = sqrt( sum |u - u_prev|^2 / sum |u|^2 ) / period
+        density:  L2 = sqrt( sum ( rho - rho_prev )^2 / n ) / period
+        Linf = max |a - a_prev| / period
+    where a is the velocity or the density. the velocity residual is relative, the density
+    residual absolute: the density only moves by O( Ma^2 ) about the free stream, so relative to
+    the density itself it falls below any tolerance long before the flow settles. both are per
+    step, so the tolerance doesn't depend on the period. the run stops once L2 is below the
+    tolerance, or after max_steps.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        enum class convergence_field {
+            velocity,
+            density
+        };
+
+        struct convergence_monitor {
+
+            convergence_field field = convergence_field::velocity;
+
+            // steps between samples
+            size_t period = 100;
+
+            // of the L2 change per step, relative for the velocity and absolute for the density
+            T tolerance = 1e-7;
+
+            size_t max_steps = 100000;
+        };
+
+        struct residual {
+
+            // steps run when the sample was taken
+            size_t step;
+
+            T l2;
+            T l_inf;
+        };
+
+        struct convergence_result {
+
+            bool converged;
+
+            // steps run
+            size_t steps;
+
+            // a residual per sample after the first
+            std::vector<residual> history;
+        };
+
+        /*
+            change between two samples of the fields over the cells where obstacle is zero, the L2
+            norm, relative to the current sample for the velocity and the root mean square for the
+            density, and the largest change of a cell
+        */
+        inline residual get_residual( const macroscopic_fields& current, const macroscopic_fields& previous,
+                                      const unsigned char* obstacle, const size_t vec_len, const convergence_field field ) {
+
+            struct sums {
+
+                T change_2;
+                T value_2;
+                T change_max;
+                size_t cells;
+            };
+
+            const sums total = tbb::parallel_reduce( tbb::blocked_range<size_t>( 0, vec_len ), sums{},
+                [&]( const tbb::blocked_range<size_t>& r, sums s ) {
+
+                    for ( size_t i = r.begin(); i < r.end(); ++i ) {
+
+                        if ( obstacle[ i ] )
+                            continue;
+
+                        T change_2;
+                        T value_2 = 0.0;
+
+                        if ( field == convergence_field::velocity ) {
+
+                            const T du_x = current.u_x[ i ] - previous.u_x[ i ];
+                            const T du_y = current.u_y[ i ] - previous.u_y[ i ];
+
+                            change_2 = du_x * du_x + du_y * du_y;
+                            value_2 = current.u_x[ i ] * current.u_x[ i ] + current.u_y[ i ] * current.u_y[ i ];
+
+                        } else {
+
+                            const T drho = current.rho[ i ] - previous.rho[ i ];
+
+                            change_2 = drho * drho;
+                        }
+
+                        s.change_2 += change_2;
+                        s.value_2 += value_2;
+                        s.change_max = std::max( s.change_max, change_2 );
+                        ++s.cells;
+                    }
+
+                    return s;
+                },
+                []( const sums& a, const sums& b ) {
+
+                    return sums{ a.change_2 + b.change_2, a.value_2 + b.value_2, std::max( a.change_max, b.change_max ), a.cells + b.cells };
+                }
+            );
+
+            T l2 = std::sqrt( total.change_2 );
+
+            if ( field == convergence_field::density && total.cells > 0 )
+                l2 = std::sqrt( total.change_2 / total.cells );
+            else if ( field == convergence_field::velocity && total.value_2 > 0.0 )
+                l2 = std::sqrt( total.change_2 / total.value_2 );
+
+            return { 0, l2, std::sqrt( total.change_max ) };
+        }
+
+        /*
+            advance the simulation until it stops changing, see convergence_monitor. the state is
+            left at the last sample, a multiple of the period past where it started. with the aa kernel
+            the grid is only sampled after an even number of steps, an odd period throws
+            std::invalid_argument.
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        convergence_result collide_and_stream_to_convergence_tbb( cs_state_tbb<Layout, Storage, Collision>& cs,
+                                                                  const convergence_monitor& monitor ) {
+
+            const size_t vec_len = cs.ydim * cs.xdim;
+            const size_t period = std::max<size_t>( monitor.period, 1 );
+
+            if ( cs.kernel == cs_kernel::aa && period % 2 != 0 )
+                throw std::invalid_argument( "the aa kernel needs an even convergence period" );
+
+            // the current and previous samples, swapped after each one
+            std::vector<T> rho[ 2 ], u_x[ 2 ], u_y[ 2 ];
+
+            macroscopic_fields samples[ 2 ];
+
+            for ( size_t i = 0; i < 2; ++i ) {
+
+                if ( monitor.field == convergence_field::density ) {
+
+                    rho[ i ].resize( vec_len );
+                    samples[ i ].rho = rho[ i ].data();
+
+                } else {
+
+                    u_x[ i ].resize( vec_len );
+                    u_y[ i ].resize( vec_len );
+                    samples[ i ].u_x = u_x[ i ].data();
+                    samples[ i ].u_y = u_y[ i ].data();
+                }
+            }
+
+            convergence_result result{ false, 0, {} };
+
+            calculate_macroscopic( cs, samples[ 1 ] );
+
+            while ( result.steps + period <= monitor.max_steps ) {
+
+                stateful_collide_and_stream_tbb( cs, period, samples[ 0 ] );
+
+                result.steps += period;
+
+                residual r = get_residual( samples[ 0 ], samples[ 1 ], cs.obstacle.data(), vec_len, monitor.field );
+
+                r.step = result.steps;
+                r.l2 /= period;
+                r.l_inf /= period;
+
+                result.history.push_back( r );
+
+                if ( r.l2 < monitor.tolerance ) {
+
+                    result.converged = true;
+
+                    break;
+                }
+
+                std::swap( samples[ 0 ], samples[ 1 ] );
+            }
+
+            return result;
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef LBM_FUSED_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_FUSED_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <cstddef>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/macroscopic.hpp>
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            single-pass "pull" update of the interior cells in rows [ y_begin, y_end ) and
+            columns [ x_begin, x_end ).
+
+            each cell gathers the post-collision distributions streaming into it from its neighbours,
+            collides them and writes the result, so D2Q9 and D2Q9_n both hold post-collision
+            distributions. a distribution that would be pulled out of an obstacle cell is instead the
+            cell's own distribution in the opposite direction ( half-way bounce-back ).
+            Collision is the collision operator, see collision.hpp. the density and velocity of the
+            cells are also stored in "fields" if it has any, see macroscopic.hpp.
+        */
+        template<typename Collision = collision_BGK, typename View, typename View_n>
+        void fused_collide_and_stream_tile( const View& D2Q9, const View_n& D2Q9_n, const unsigned char* obstacle,
+                                            const size_t y_begin, const size_t y_end,
+                                            const size_t x_begin, const size_t x_end, const T omega,
+                                            const macroscopic_fields& fields = {} ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            for ( size_t y = y_begin; y < y_end; ++y ) {
+
+                const unsigned char* obstacle_s = obstacle + ( y - 1 ) * xdim;
+                const unsigned char* obstacle_c = obstacle + y * xdim;
+                const unsigned char* obstacle_n = obstacle + ( y + 1 ) * xdim;
+
+                for ( size_t x = x_begin; x < x_end; ++x ) {
+
+                    T f[ 9 ];
+
+                    f[ 0 ] = D2Q9[ y, x, 0 ];
+                    f[ 1 ] = D2Q9[ y, x - 1, 1 ];
+                    f[ 2 ] = D2Q9[ y - 1, x, 2 ];
+                    f[ 3 ] = D2Q9[ y, x + 1, 3 ];
+                    f[ 4 ] = D2Q9[ y + 1, x, 4 ];
+                    f[ 5 ] = D2Q9[ y - 1, x - 1, 5 ];
+                    f[ 6 ] = D2Q9[ y - 1, x + 1, 6 ];
+                    f[ 7 ] = D2Q9[ y + 1, x + 1, 7 ];
+                    f[ 8 ] = D2Q9[ y + 1, x - 1, 8 ];
+
+                    const bool near_obstacle = obstacle_s[ x - 1 ] | obstacle_s[ x ] | obstacle_s[ x + 1 ] |
+                                               obstacle_c[ x - 1 ] | obstacle_c[ x + 1 ] |
+                                               obstacle_n[ x - 1 ] | obstacle_n[ x ] | obstacle_n[ x + 1 ];
+
+                    if ( near_obstacle ) {
+
+                        for ( size_t q = 1; q < 9; ++q ) {
+
+                            // neighbour the distribution streams in from
+                            const size_t source = ( x - e[ q ].first ) + ( y - e[ q ].second ) * xdim;
+
+                            if ( obstacle[ source ] )
+                                f[ q ] = D2Q9[ y, x, opposite_q[ q ] ];
+                        }
+                    }
+
+                    if ( fields )
+                        fields.store( x + y * xdim, f );
+
+                    Collision::collide( f, omega );
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        D2Q9_n[ y, x, q ] = f[ q ];
+                }
+            }
+        }
+
+        // whole rows [ y_begin, y_end ) of interior cells
+        template<typename Collision = collision_BGK, typename View, typename View_n>
+        void fused_collide_and_stream_rows( const View& D2Q9, const View_n& D2Q9_n, const unsigned char* obstacle,
+                                            const size_t y_begin, const size_t y_end, const T omega,
+                                            const macroscopic_fields& fields = {} ) {
+
+            fused_collide_and_stream_tile<Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, 1, D2Q9.extent( 1 ) - 1, omega, fields );
+        }
+
+        /*
+            one time-step of collide, stream and bounce-back in a single sweep over the grid.
+            edge cells of D2Q9_n are left untouched.
+        */
+        template<typename Collision = collision_BGK, typename View, typename View_n>
+        void fused_collide_and_stream_tbb( const View& D2Q9, const View_n& D2Q9_n, const unsigned char* obstacle, const T omega ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, D2Q9.extent( 0 ) - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    fused_collide_and_stream_rows<Collision>( D2Q9, D2Q9_n, obstacle, r.begin(), r.end(), omega );
+                }
+            );
+        }
+
+        inline void fused_collide_and_stream_tbb( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                                  const size_t ydim, const size_t xdim, const T omega ) {
+
+            fused_collide_and_stream_tbb( make_lattice_view<layout_aos>( D2Q9, ydim, xdim ),
+                                          make_lattice_view<layout_aos>( D2Q9_n, ydim, xdim ), obstacle, omega );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -46,6 +46,18 @@ namespace fs {
             }
         }
 
+        // as above, for a D2Q9 view of any layout
+        template<typename View> requires ( View::rank() == 3 )
+        void set_velocity( const View& D2Q9,
+                           const size_t y, const size_t x,
+                           const T u_x, const T u_y ) {
+
+            const T rho = 1.0;
+
+            for ( size_t q = 0; q < 9; ++ q )
+                D2Q9[ y, x, q ] = calculate_f_eq( q, rho, u_x, u_y );
+        }
+
         /*
             initialize all the cells in a D2Q9 grid to
             a certain density and velocity
@@ -67,7 +79,8 @@ namespace fs {
         }
 
         /*
-            set all the edge-cells in the grid
+            set all the edge-cells in the grid. the engines apply their boundary conditions every
+            step themselves, see boundary_conditions.hpp, this is for a grid advanced by other means.
         */
         template<typename DataStorage, typename View>
         void set_boundaries( sim::grid<DataStorage, View>& gd ) {
@@ -76,20 +89,32 @@ namespace fs {
             const size_t ydim = gd.get_dim( 0 );
             const size_t xdim = gd.get_dim( 1 );
 
+            // the same equilibrium for every edge-cell
+            double f_eq[ 9 ];
+
+            for ( size_t q = 0; q < 9; ++q )
+                f_eq[ q ] = calculate_f_eq( q, 1.0, 0.1, 0.0 );
+
+            auto set_cell = [&]( const size_t y, const size_t x ) {
+
+                for ( size_t q = 0; q < 9; ++q )
+                    gd.set_cell_state( f_eq[ q ], y, x, q );
+            };
+
             for ( size_t y = 0; y < ydim; ++y ) {
 
                 // inlet
-                set_velocity( gd, y, 0, 0.1, 0.0 );
+                set_cell( y, 0 );
                 // outlet
-                set_velocity( gd, y, xdim - 1, 0.1, 0.0 );
+                set_cell( y, xdim - 1 );
             } 
     
             for ( size_t x = 0; x < xdim; ++x ) {
                 
                 // top boundary
-                set_velocity( gd, 0, x, 0.1, 0.0 );
+                set_cell( 0, x );
                 // bottom boundary
-                set_velocity( gd, ydim - 1, x, 0.1, 0.0 );
+                set_cell( ydim - 1, x );
             }
         }
 
@@ -0,0 +1,408 @@
+#ifndef LBM_LATTICE_HPP
+#define LBM_LATTICE_HPP
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+
+/*
+    lattice descriptors and the kernels generated from them.
+
+    a descriptor is a struct of constexpr members:
+        D         dimensions
+        Q         directions
+        c         the velocity of each direction, c[ q ][ 0 ] is along x
+        w         the weight of each direction
+        c_s2      the square of the speed of sound
+        opposite  the direction with velocity -c[ q ], worked out from c
+    the kernels are unrolled over the directions and dimensions at compile time, so every velocity
+    component and weight is a constant in the generated code: components of 0 drop out, 1 and -1
+    become additions and subtractions, and there are no loops over q or lookups into c and w.
+
+    the grids are stored as in layout_soa, direction q of cell i at q * cells + i, with cell
+    i = x + xdim * ( y + ydim * z ).
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        // the direction whose velocity is the opposite of each direction's
+        template<size_t D, size_t Q>
+        constexpr std::array<size_t, Q> get_opposite( const std::array<std::array<int, D>, Q>& c ) {
+
+            std::array<size_t, Q> opposite{};
+
+            for ( size_t q = 0; q < Q; ++q ) {
+                for ( size_t p = 0; p < Q; ++p ) {
+
+                    bool is_opposite = true;
+
+                    for ( size_t k = 0; k < D; ++k )
+                        is_opposite = is_opposite && c[ p ][ k ] == -c[ q ][ k ];
+
+                    if ( is_opposite )
+                        opposite[ q ] = p;
+                }
+            }
+
+            return opposite;
+        }
+
+        // the directions in the same order as e
+        struct lattice_D2Q9 {
+
+            static constexpr size_t D = 2;
+            static constexpr size_t Q = 9;
+
+            static constexpr std::array<std::array<int, D>, Q> c = { {
+                {  0,  0 },
+                {  1,  0 }, {  0,  1 }, { -1,  0 }, {  0, -1 },
+                {  1,  1 }, { -1,  1 }, { -1, -1 }, {  1, -1 }
+            } };
+
+            static constexpr std::array<T, Q> w = {
+                4.0 / 9.0,
+                1.0 / 9.0, 1.0 / 9.0, 1.0 / 9.0, 1.0 / 9.0,
+                1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0
+            };
+
+            static constexpr T c_s2 = 1.0 / 3.0;
+
+            static constexpr std::array<size_t, Q> opposite = get_opposite( c );
+        };
+
+        // the rest and cardinal directions of D2Q9
+        struct lattice_D2Q5 {
+
+            static constexpr size_t D = 2;
+            static constexpr size_t Q = 5;
+
+            static constexpr std::array<std::array<int, D>, Q> c = { {
+                {  0,  0 },
+                {  1,  0 }, {  0,  1 }, { -1,  0 }, {  0, -1 }
+            } };
+
+            static constexpr std::array<T, Q> w = {
+                1.0 / 3.0,
+                1.0 / 6.0, 1.0 / 6.0, 1.0 / 6.0, 1.0 / 6.0
+            };
+
+            static constexpr T c_s2 = 1.0 / 3.0;
+
+            static constexpr std::array<size_t, Q> opposite = get_opposite( c );
+        };
+
+        // rest, the six faces and the twelve edges of the unit cube
+        struct lattice_D3Q19 {
+
+            static constexpr size_t D = 3;
+            static constexpr size_t Q = 19;
+
+            static constexpr std::array<std::array<int, D>, Q> c = { {
+                {  0,  0,  0 },
+                {  1,  0,  0 }, { -1,  0,  0 }, {  0,  1,  0 }, {  0, -1,  0 }, {  0,  0,  1 }, {  0,  0, -1 },
+                {  1,  1,  0 }, { -1, -1,  0 }, {  1, -1,  0 }, { -1,  1,  0 },
+                {  1,  0,  1 }, { -1,  0, -1 }, {  1,  0, -1 }, { -1,  0,  1 },
+                {  0,  1,  1 }, {  0, -1, -1 }, {  0,  1, -1 }, {  0, -1,  1 }
+            } };
+
+            static constexpr std::array<T, Q> w = {
+                1.0 / 3.0,
+                1.0 / 18.0, 1.0 / 18.0, 1.0 / 18.0, 1.0 / 18.0, 1.0 / 18.0, 1.0 / 18.0,
+                1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0,
+                1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0,
+                1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0, 1.0 / 36.0
+            };
+
+            static constexpr T c_s2 = 1.0 / 3.0;
+
+            static constexpr std::array<size_t, Q> opposite = get_opposite( c );
+        };
+
+        // D3Q19 and the eight corners of the unit cube
+        struct lattice_D3Q27 {
+
+            static constexpr size_t D = 3;
+            static constexpr size_t Q = 27;
+
+            static constexpr std::array<std::array<int, D>, Q> c = { {
+                {  0,  0,  0 },
+                {  1,  0,  0 }, { -1,  0,  0 }, {  0,  1,  0 }, {  0, -1,  0 }, {  0,  0,  1 }, {  0,  0, -1 },
+                {  1,  1,  0 }, { -1, -1,  0 }, {  1, -1,  0 }, { -1,  1,  0 },
+                {  1,  0,  1 }, { -1,  0, -1 }, {  1,  0, -1 }, { -1,  0,  1 },
+                {  0,  1,  1 }, {  0, -1, -1 }, {  0,  1, -1 }, {  0, -1,  1 },
+                {  1,  1,  1 }, { -1, -1, -1 }, {  1,  1, -1 }, { -1, -1,  1 },
+                {  1, -1,  1 }, { -1,  1, -1 }, { -1,  1,  1 }, {  1, -1, -1 }
+            } };
+
+            static constexpr std::array<T, Q> w = {
+                8.0 / 27.0,
+                2.0 / 27.0, 2.0 / 27.0, 2.0 / 27.0, 2.0 / 27.0, 2.0 / 27.0, 2.0 / 27.0,
+                1.0 / 54.0, 1.0 / 54.0, 1.0 / 54.0, 1.0 / 54.0,
+                1.0 / 54.0, 1.0 / 54.0, 1.0 / 54.0, 1.0 / 54.0,
+                1.0 / 54.0, 1.0 / 54.0, 1.0 / 54.0, 1.0 / 54.0,
+                1.0 / 216.0, 1.0 / 216.0, 1.0 / 216.0, 1.0 / 216.0,
+                1.0 / 216.0, 1.0 / 216.0, 1.0 / 216.0, 1.0 / 216.0
+            };
+
+            static constexpr T c_s2 = 1.0 / 3.0;
+
+            static constexpr std::array<size_t, Q> opposite = get_opposite( c );
+        };
+
+        // the hand-written D2Q9 kernels index with e, w and opposite_q, which must agree with the descriptor
+        static_assert( [] {
+            for ( size_t q = 0; q < 9; ++q ) {
+
+                if ( lattice_D2Q9::c[ q ][ 0 ] != e[ q ].first || lattice_D2Q9::c[ q ][ 1 ] != e[ q ].second )
+                    return false;
+
+                if ( lattice_D2Q9::w[ q ] != w[ q ] || lattice_D2Q9::opposite[ q ] != opposite_q[ q ] )
+                    return false;
+            }
+            return true;
+        }(), "e, w and opposite_q disagree with lattice_D2Q9" );
+
+        template<typename F, size_t... i>
+        [[gnu::always_inline]] inline void unroll( F& f, std::index_sequence<i...> ) {
+
+            ( f( std::integral_constant<size_t, i>{} ), ... );
+        }
+
+        // call f( std::integral_constant<size_t, i>{} ) for i in [ 0, N ), unrolled
+        template<size_t N, typename F>
+        [[gnu::always_inline]] inline void unroll( F&& f ) {
+
+            unroll( f, std::make_index_sequence<N>{} );
+        }
+
+        // c[ q ] . u, with only the non-zero components of c[ q ]
+        template<typename L, size_t q, typename V>
+        [[gnu::always_inline]] inline V lattice_dot( const std::array<V, L::D>& u ) {
+
+            V c_u{};
+
+            unroll<L::D>( [&]( auto k ) {
+
+                constexpr int c_k = L::c[ q ][ k ];
+
+                if constexpr ( c_k == 1 )
+                    c_u += u[ k ];
+                else if constexpr ( c_k == -1 )
+                    c_u -= u[ k ];
+                else if constexpr ( c_k != 0 )
+                    c_u += static_cast<T>( c_k ) * u[ k ];
+            } );
+
+            return c_u;
+        }
+
+        // density and velocity of a cell
+        template<typename L, typename V>
+        [[gnu::always_inline]] inline void lattice_moments( const V ( &f )[ L::Q ], V& rho, std::array<V, L::D>& u ) {
+
+            rho = V{};
+            u = {};
+
+            unroll<L::Q>( [&]( auto q ) {
+
+                rho += f[ q ];
+
+                unroll<L::D>( [&]( auto k ) {
+
+                    constexpr int c_k = L::c[ q ][ k ];
+
+                    if constexpr ( c_k == 1 )
+                        u[ k ] += f[ q ];
+                    else if constexpr ( c_k == -1 )
+                        u[ k ] -= f[ q ];
+                    else if constexpr ( c_k != 0 )
+                        u[ k ] += static_cast<T>( c_k ) * f[ q ];
+                } );
+            } );
+
+            const V rho_inv = 1.0 / rho;
+
+            for ( size_t k = 0; k < L::D; ++k )
+                u[ k ] *= rho_inv;
+        }
+
+        /*
+            equilibrium distribution of direction q, to second order in u
+                f_eq = w_q rho ( 1 + c.u / c_s^2 + ( c.u )^2 / ( 2 c_s^4 ) - u.u / ( 2 c_s^2 ) )
+            u_2 is u.u / ( 2 c_s^2 ), which is the same for every direction
+        */
+        template<typename L, size_t q, typename V>
+        [[gnu::always_inline]] inline V lattice_f_eq( const V& rho, const std::array<V, L::D>& u, const V& u_2 ) {
+
+            constexpr T w_q = L::w[ q ];
+
+            if constexpr ( q == 0 && L::c[ 0 ] == std::array<int, L::D>{} ) {
+
+                return ( w_q * rho ) * ( 1.0 - u_2 );
+
+            } else {
+
+                const V c_u = lattice_dot<L, q>( u );
+
+                return ( w_q * rho ) * ( 1.0 + c_u * ( 1.0 / L::c_s2 ) + c_u * c_u * ( 0.5 / ( L::c_s2 * L::c_s2 ) ) - u_2 );
+            }
+        }
+
+        // equilibrium distributions of a cell with density rho and velocity u
+        template<typename L, typename V>
+        [[gnu::always_inline]] inline void lattice_f_eq( V ( &f_eq )[ L::Q ], const V& rho, const std::array<V, L::D>& u ) {
+
+            V u_u{};
+
+            for ( size_t k = 0; k < L::D; ++k )
+                u_u += u[ k ] * u[ k ];
+
+            const V u_2 = u_u * ( 0.5 / L::c_s2 );
+
+            unroll<L::Q>( [&]( auto q ) { f_eq[ q ] = lattice_f_eq<L, q>( rho, u, u_2 ); } );
+        }
+
+        /*
+            BGK collision of the distributions of a single cell, in place
+        */
+        template<typename L, typename V>
+        [[gnu::always_inline]] inline void lattice_collide_BGK( V ( &f )[ L::Q ], const T omega ) {
+
+            V rho;
+            std::array<V, L::D> u;
+
+            lattice_moments<L>( f, rho, u );
+
+            V u_u{};
+
+            for ( size_t k = 0; k < L::D; ++k )
+                u_u += u[ k ] * u[ k ];
+
+            const V u_2 = u_u * ( 0.5 / L::c_s2 );
+
+            unroll<L::Q>( [&]( auto q ) { f[ q ] += omega * ( lattice_f_eq<L, q>( rho, u, u_2 ) - f[ q ] ); } );
+        }
+
+        // cells in a grid of the given extents, extents[ 0 ] along x
+        template<size_t D>
+        size_t lattice_cells( const std::array<size_t, D>& extents ) {
+
+            size_t cells = 1;
+
+            for ( const size_t extent : extents )
+                cells *= extent;
+
+            return cells;
+        }
+
+        // offset of the cell each direction streams in from
+        template<typename L>
+        std::array<std::ptrdiff_t, L::Q> lattice_source_offsets( const std::array<size_t, L::D>& extents ) {
+
+            std::array<std::ptrdiff_t, L::Q> source{};
+
+            unroll<L::Q>( [&]( auto q ) {
+
+                std::ptrdiff_t stride = 1;
+
+                for ( size_t k = 0; k < L::D; ++k ) {
+
+                    source[ q ] -= L::c[ q ][ k ] * stride;
+                    stride *= static_cast<std::ptrdiff_t>( extents[ k ] );
+                }
+            } );
+
+            return source;
+        }
+
+        /*
+            single-pass "pull" update of the interior cells of layers [ begin, end ) along the last
+            dimension ( rows in 2D, planes in 3D ), the counterpart of fused_collide_and_stream_rows.
+            f holds post-collision distributions. each interior cell pulls the distribution that
+            streams into it from its neighbour, takes its own distribution in the opposite direction
+            where the neighbour is an obstacle ( half-way bounce-back ), collides and writes the
+            result to f_n. the edge-cells aren't updated.
+        */
+        template<typename L>
+        void lattice_collide_and_stream_layers( const T* f, T* f_n, const unsigned char* obstacle,
+                                                const std::array<size_t, L::D>& extents,
+                                                const size_t begin, const size_t end, const T omega ) {
+
+            static_assert( L::D == 2 || L::D == 3 );
+
+            const size_t cells = lattice_cells( extents );
+
+            const std::array<std::ptrdiff_t, L::Q> source = lattice_source_offsets<L>( extents );
+
+            auto update = [&]( const size_t i ) {
+
+                if ( obstacle[ i ] )
+                    return;
+
+                T f_i[ L::Q ];
+
+                unroll<L::Q>( [&]( auto q ) {
+
+                    if constexpr ( q == 0 ) {
+
+                        f_i[ q ] = f[ i ];
+
+                    } else {
+
+                        const size_t s = i + source[ q ];
+
+                        f_i[ q ] = obstacle[ s ] ? f[ L::opposite[ q ] * cells + i ] : f[ q * cells + s ];
+                    }
+                } );
+
+                lattice_collide_BGK<L>( f_i, omega );
+
+                unroll<L::Q>( [&]( auto q ) { f_n[ q * cells + i ] = f_i[ q ]; } );
+            };
+
+            const size_t xdim = extents[ 0 ];
+            const size_t ydim = extents[ 1 ];
+
+            for ( size_t l = begin; l < end; ++l ) {
+
+                if constexpr ( L::D == 2 ) {
+
+                    for ( size_t x = 1; x < xdim - 1; ++x )
+                        update( x + l * xdim );
+
+                } else {
+
+                    for ( size_t y = 1; y < ydim - 1; ++y )
+                        for ( size_t x = 1; x < xdim - 1; ++x )
+                            update( x + xdim * ( y + ydim * l ) );
+                }
+            }
+        }
+
+        // one time-step of the generated kernel from f into f_n
+        template<typename L>
+        void lattice_collide_and_stream_tbb( const T* f, T* f_n, const unsigned char* obstacle,
+                                             const std::array<size_t, L::D>& extents, const T omega ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, extents[ L::D - 1 ] - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    lattice_collide_and_stream_layers<L>( f, f_n, obstacle, extents, r.begin(), r.end(), omega );
+                }
+            );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef LBM_LAYOUT_HPP
+#define LBM_LAYOUT_HPP
+
+#include <cstddef>
+
+#include <mdspan-stable/include/mdspan/mdspan.hpp>
+
+/*
+    memory layouts for the distributions of a lattice, as mdspan layout mappings over the
+    extents ( y, x, q ):
+    ( 1 ) layout_aos: the distributions of a cell are contiguous, [ y ][ x ][ q ].
+    ( 2 ) layout_soa: each direction is a contiguous grid, [ q ][ y ][ x ] ( see js.hpp ).
+    ( 3 ) layout_aosoa<B>: cells are grouped into blocks of B consecutive cells, within a block
+          each direction is contiguous, [ cell / B ][ q ][ cell % B ].
+    kernels index the view with f[ y, x, q ] and work with any of them.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        // [ y ][ x ][ q ] is exactly the row-major layout
+        using layout_aos = Kokkos::layout_right;
+
+        struct layout_soa {
+
+            template<typename Extents>
+            class mapping {
+
+            public:
+
+                using extents_type = Extents;
+                using index_type = typename Extents::index_type;
+                using size_type = typename Extents::size_type;
+                using rank_type = typename Extents::rank_type;
+                using layout_type = layout_soa;
+
+                static_assert( Extents::rank() == 3, "layout_soa maps ( y, x, q ) extents" );
+
+                constexpr mapping() noexcept = default;
+                constexpr mapping( const extents_type& extents ) noexcept : extents_( extents ) {}
+
+                constexpr const extents_type& extents() const noexcept { return extents_; }
+
+                constexpr index_type required_span_size() const noexcept {
+
+                    return extents_.extent( 0 ) * extents_.extent( 1 ) * extents_.extent( 2 );
+                }
+
+                template<typename Y, typename X, typename Q>
+                constexpr index_type operator()( const Y y, const X x, const Q q ) const noexcept {
+
+                    return ( static_cast<index_type>( q ) * extents_.extent( 0 ) + static_cast<index_type>( y ) ) * extents_.extent( 1 )
+                           + static_cast<index_type>( x );
+                }
+
+                static constexpr bool is_always_unique() noexcept { return true; }
+                static constexpr bool is_always_exhaustive() noexcept { return true; }
+                static constexpr bool is_always_strided() noexcept { return true; }
+
+                static constexpr bool is_unique() noexcept { return true; }
+                static constexpr bool is_exhaustive() noexcept { return true; }
+                static constexpr bool is_strided() noexcept { return true; }
+
+                constexpr index_type stride( const rank_type r ) const noexcept {
+
+                    if ( r == 0 )
+                        return extents_.extent( 1 );
+
+                    if ( r == 1 )
+                        return 1;
+
+                    return extents_.extent( 0 ) * extents_.extent( 1 );
+                }
+
+                friend constexpr bool operator==( const mapping& a, const mapping& b ) noexcept {
+
+                    return a.extents() == b.extents();
+                }
+
+            private:
+
+                extents_type extents_{};
+            };
+        };
+
+        template<size_t Block>
+        struct layout_aosoa {
+
+            static_assert( Block > 0 && ( Block & ( Block - 1 ) ) == 0, "block size must be a power of two" );
+
+            // cells per block
+            static constexpr size_t block = Block;
+
+            template<typename Extents>
+            class mapping {
+
+            public:
+
+                using extents_type = Extents;
+                using index_type = typename Extents::index_type;
+                using size_type = typename Extents::size_type;
+                using rank_type = typename Extents::rank_type;
+                using layout_type = layout_aosoa;
+
+                static_assert( Extents::rank() == 3, "layout_aosoa maps ( y, x, q ) extents" );
+
+                constexpr mapping() noexcept = default;
+                constexpr mapping( const extents_type& extents ) noexcept : extents_( extents ) {}
+
+                constexpr const extents_type& extents() const noexcept { return extents_; }
+
+                // the last block is padded out to a whole block
+                constexpr index_type required_span_size() const noexcept {
+
+                    const index_type cells = extents_.extent( 0 ) * extents_.extent( 1 );
+
+                    return ( cells + Block - 1 ) / Block * Block * extents_.extent( 2 );
+                }
+
+                template<typename Y, typename X, typename Q>
+                constexpr index_type operator()( const Y y, const X x, const Q q ) const noexcept {
+
+                    const index_type cell = static_cast<index_type>( y ) * extents_.extent( 1 ) + static_cast<index_type>( x );
+
+                    return ( cell / Block * extents_.extent( 2 ) + static_cast<index_type>( q ) ) * Block + cell % Block;
+                }
+
+                static constexpr bool is_always_unique() noexcept { return true; }
+                static constexpr bool is_always_exhaustive() noexcept { return false; }
+                static constexpr bool is_always_strided() noexcept { return false; }
+
+                static constexpr bool is_unique() noexcept { return true; }
+                static constexpr bool is_strided() noexcept { return false; }
+
+                constexpr bool is_exhaustive() const noexcept {
+
+                    return extents_.extent( 0 ) * extents_.extent( 1 ) % Block == 0;
+                }
+
+                friend constexpr bool operator==( const mapping& a, const mapping& b ) noexcept {
+
+                    return a.extents() == b.extents();
+                }
+
+            private:
+
+                extents_type extents_{};
+            };
+        };
+
+        /*
+            view of a ydim x xdim grid of Q-direction cells whose dimensions are only known at run-time
+        */
+        template<typename Layout, size_t Q = 9, typename T>
+        Kokkos::mdspan<T, Kokkos::extents<size_t, Kokkos::dynamic_extent, Kokkos::dynamic_extent, Q>, Layout>
+        make_lattice_view( T* data, const size_t ydim, const size_t xdim ) {
+
+            using extents_type = Kokkos::extents<size_t, Kokkos::dynamic_extent, Kokkos::dynamic_extent, Q>;
+
+            return { data, typename Layout::template mapping<extents_type>( extents_type( ydim, xdim ) ) };
+        }
+
+        // number of elements a buffer needs to hold a ydim x xdim grid of Q-direction cells
+        template<typename Layout, size_t Q = 9>
+        size_t lattice_span_size( const size_t ydim, const size_t xdim ) {
+
+            using extents_type = Kokkos::extents<size_t, Kokkos::dynamic_extent, Kokkos::dynamic_extent, Q>;
+
+            return typename Layout::template mapping<extents_type>( extents_type( ydim, xdim ) ).required_span_size();
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -5,10 +5,23 @@
 
 #include <fs/global_aliases.hpp>
 #include <fs/lbm/common.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+#include <fs/lbm/lattice.hpp>
 
 #include <fs/lbm/initialize_grid.hpp>
 
 #include <fs/lbm/collide_and_stream_tbb.hpp>
+#include <fs/lbm/stateful_collide_and_stream_tbb.hpp>
+#include <fs/lbm/convergence.hpp>
+#include <fs/lbm/sparse_collide_and_stream_tbb.hpp>
+#include <fs/lbm/subdomain_collide_and_stream_tbb.hpp>
+#include <fs/lbm/multiblock_collide_and_stream_tbb.hpp>
+#include <fs/lbm/amr_collide_and_stream_tbb.hpp>
+#include <fs/lbm/moment_collide_and_stream_tbb.hpp>
+#include <fs/lbm/padded_collide_and_stream_tbb.hpp>
+#include <fs/lbm/warm_start.hpp>
+#include <fs/lbm/stateful_collide_and_stream_3D_tbb.hpp>
 #include <fs/lbm/collide_and_stream_MRT_tbb.hpp>
 
 #if !defined(DPCPP_COMPILER)
@@ -0,0 +1,126 @@
+#ifndef LBM_MACROSCOPIC_HPP
+#define LBM_MACROSCOPIC_HPP
+
+#include <cstddef>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+
+/*
+    density and velocity fields written by the kernels as they update the grid.
+
+    collision conserves density and momentum, so the moments of the distributions a cell pulls are
+    those of the cell after the step, whichever state the grid holds ( see cs_kernel ). a kernel
+    given macroscopic_fields stores them on the way, which saves reading the grid again to draw it
+    or to check on it. the fields are ydim x xdim, cell ( y, x ) at x + y * xdim, and a null field
+    isn't written.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        struct macroscopic_fields {
+
+            T* rho = nullptr;
+            T* u_x = nullptr;
+            T* u_y = nullptr;
+
+            explicit operator bool() const { return rho || u_x || u_y; }
+
+            // store the moments of cell i
+            template<typename V>
+            [[gnu::always_inline]] void store( const size_t i, const V ( &f )[ 9 ] ) const {
+
+                const T rho_i = f[ 0 ] + f[ 1 ] + f[ 2 ] + f[ 3 ] + f[ 4 ] + f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+                if ( rho )
+                    rho[ i ] = rho_i;
+
+                if ( u_x )
+                    u_x[ i ] = ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho_i;
+
+                if ( u_y )
+                    u_y[ i ] = ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho_i;
+            }
+
+            template<typename View>
+            void store( const View& D2Q9, const size_t y, const size_t x ) const {
+
+                T f[ 9 ];
+
+                for ( size_t q = 0; q < 9; ++q )
+                    f[ q ] = D2Q9[ y, x, q ];
+
+                store( x + y * D2Q9.extent( 1 ), f );
+            }
+        };
+
+        // the fields of every cell in rows [ y_begin, y_end ) from a D2Q9 view of any layout
+        template<typename View>
+        void calculate_macroscopic_rows( const View& D2Q9, const macroscopic_fields& fields, const size_t y_begin, const size_t y_end ) {
+
+            for ( size_t y = y_begin; y < y_end; ++y )
+                for ( size_t x = 0; x < D2Q9.extent( 1 ); ++x )
+                    fields.store( D2Q9, y, x );
+        }
+
+        template<typename View>
+        void calculate_macroscopic_tbb( const View& D2Q9, const macroscopic_fields& fields ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, D2Q9.extent( 0 ) ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    calculate_macroscopic_rows( D2Q9, fields, r.begin(), r.end() );
+                }
+            );
+        }
+
+        // the fields of the edge-cells, which the kernels don't update
+        template<typename View>
+        void calculate_macroscopic_edges( const View& D2Q9, const macroscopic_fields& fields ) {
+
+            const size_t ydim = D2Q9.extent( 0 );
+            const size_t xdim = D2Q9.extent( 1 );
+
+            for ( size_t y = 0; y < ydim; ++y ) {
+
+                fields.store( D2Q9, y, 0 );
+                fields.store( D2Q9, y, xdim - 1 );
+            }
+
+            for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                fields.store( D2Q9, 0, x );
+                fields.store( D2Q9, ydim - 1, x );
+            }
+        }
+
+        /*
+            curl of the velocity, du_y/dx - du_x/dy in central differences without the factor of a
+            half, as calculate_curl_v_tbb. the edge-cells are left untouched.
+        */
+        inline void calculate_curl_tbb( const T* u_x, const T* u_y, T* curl, const size_t ydim, const size_t xdim ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, ydim - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t y = r.begin(); y < r.end(); ++y ) {
+                        for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                            curl[ x + y * xdim ] = u_y[ ( x + 1 ) + y * xdim ] - u_y[ ( x - 1 ) + y * xdim ]
+                                                 - u_x[ x + ( y + 1 ) * xdim ] + u_x[ x + ( y - 1 ) * xdim ];
+                        }
+                    }
+                }
+            );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,387 @@
+#ifndef LBM_MOMENT_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_MOMENT_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+#include <fs/lbm/macroscopic.hpp>
+#include <fs/lbm/numa_tbb.hpp>
+#include <fs/lbm/stateful_collide_and_stream_tbb.hpp>
+
+/*
+    moment-space storage: a cell is stored as six moments rather than nine distributions.
+
+    the moments are the density, the velocity and the non-equilibrium part of the momentum flux,
+        Pi_ab = sum e_a e_b f - rho u_a u_b - rho c_s^2 delta_ab
+    from which the distributions are rebuilt as
+        f_q = f_eq_q + w_q / ( 2 c_s^4 ) ( e_a e_b - c_s^2 delta_ab ) Pi_ab
+    which is exact for post-collision distributions of the regularized collision ( see
+    collide_regularized ). with another collision the parts of f above the second moments are
+    dropped when the cell is stored, so BGK becomes regularized BGK.
+
+    the fused pull kernel runs on the moments: each cell rebuilds the distributions streaming into it
+    from the moments of its neighbours, collides them and stores its moments. the grid is read and
+    written once a step as with the fused kernel, in 6 values a cell instead of 9.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        // rho, u_x, u_y, Pi_xx, Pi_xy, Pi_yy
+        constexpr size_t moment_count = 6;
+
+        // the moments of the distributions of a cell
+        [[gnu::always_inline]] inline void get_moments( const T ( &f )[ 9 ], T ( &m )[ moment_count ] ) {
+
+            const T rho = f[ 0 ] + f[ 1 ] + f[ 2 ] + f[ 3 ] + f[ 4 ] + f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+            const T u_x = ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho;
+            const T u_y = ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho;
+
+            const T diagonal = f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+            m[ 0 ] = rho;
+            m[ 1 ] = u_x;
+            m[ 2 ] = u_y;
+            m[ 3 ] = f[ 1 ] + f[ 3 ] + diagonal - rho * ( u_x * u_x + 1.0 / 3.0 );
+            m[ 4 ] = f[ 5 ] - f[ 6 ] + f[ 7 ] - f[ 8 ] - rho * u_x * u_y;
+            m[ 5 ] = f[ 2 ] + f[ 4 ] + diagonal - rho * ( u_y * u_y + 1.0 / 3.0 );
+        }
+
+        // distribution q of a cell with moments m
+        template<typename M>
+        [[gnu::always_inline]] inline T get_distribution( const M& m, const size_t q ) {
+
+            const T rho = m[ 0 ];
+            const T u_x = m[ 1 ];
+            const T u_y = m[ 2 ];
+
+            const T e_x = e[ q ].first;
+            const T e_y = e[ q ].second;
+
+            const T e_u = e_x * u_x + e_y * u_y;
+
+            // ( e_a e_b - c_s^2 delta_ab ) Pi_ab
+            const T e_pi = ( e_x * e_x - 1.0 / 3.0 ) * m[ 3 ] + 2.0 * e_x * e_y * m[ 4 ] + ( e_y * e_y - 1.0 / 3.0 ) * m[ 5 ];
+
+            return w[ q ] * ( rho * ( 1.0 + 3.0 * e_u + 4.5 * e_u * e_u - 1.5 * ( u_x * u_x + u_y * u_y ) ) + 4.5 * e_pi );
+        }
+
+        /*
+            view of a grid of moments indexed like a D2Q9 view with f[ y, x, q ], which rebuilds the
+            distribution on every read. read-only, cells are written with store_moments.
+        */
+        template<typename Layout>
+        class moment_view {
+
+        public:
+
+            using storage_view = Kokkos::mdspan<T, Kokkos::extents<size_t, Kokkos::dynamic_extent, Kokkos::dynamic_extent, moment_count>, Layout>;
+
+            moment_view( T* data, const size_t ydim, const size_t xdim )
+                : view_( make_lattice_view<Layout, moment_count>( data, ydim, xdim ) ) {}
+
+            static constexpr size_t rank() { return 3; }
+
+            size_t extent( const size_t r ) const { return r == 2 ? 9 : view_.extent( r ); }
+
+            T operator[]( const size_t y, const size_t x, const size_t q ) const {
+
+                return get_distribution( cell( y, x ), q );
+            }
+
+            // the moments of cell ( y, x ), read once
+            std::array<T, moment_count> cell( const size_t y, const size_t x ) const {
+
+                std::array<T, moment_count> m;
+
+                for ( size_t k = 0; k < moment_count; ++k )
+                    m[ k ] = view_[ y, x, k ];
+
+                return m;
+            }
+
+            const storage_view& moments() const { return view_; }
+
+        private:
+
+            storage_view view_;
+        };
+
+        template<typename Layout>
+        void store_moments( const moment_view<Layout>& M, const size_t y, const size_t x, const T ( &f )[ 9 ] ) {
+
+            T m[ moment_count ];
+
+            get_moments( f, m );
+
+            for ( size_t k = 0; k < moment_count; ++k )
+                M.moments()[ y, x, k ] = m[ k ];
+        }
+
+        template<typename Layout>
+        void store_moments( const moment_view<Layout>& M, const size_t y, const size_t x, const std::array<T, 9>& f ) {
+
+            T f_c[ 9 ];
+
+            for ( size_t q = 0; q < 9; ++q )
+                f_c[ q ] = f[ q ];
+
+            store_moments( M, y, x, f_c );
+        }
+
+        // the boundary conditions write a cell of a moment grid as its moments, see apply_boundary_conditions
+        template<typename Layout, typename F>
+        void set_cell( const moment_view<Layout>& M, const size_t y, const size_t x, const F& f ) {
+
+            store_moments( M, y, x, f );
+        }
+
+        /*
+            the fused pull kernel on moments, rows [ y_begin, y_end ) of interior cells. a cell pulls
+            each distribution from the moments of the neighbour it streams from, or from its own moments
+            in the opposite direction next to an obstacle, see fused_collide_and_stream_tile.
+        */
+        template<typename Collision = collision_regularized, typename Layout>
+        void fused_collide_and_stream_moments_rows( const moment_view<Layout>& M, const moment_view<Layout>& M_n,
+                                                    const unsigned char* obstacle, const size_t y_begin, const size_t y_end,
+                                                    const T omega, const macroscopic_fields& fields = {} ) {
+
+            const size_t xdim = M.extent( 1 );
+
+            for ( size_t y = y_begin; y < y_end; ++y ) {
+                for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                    const auto m = M.cell( y, x );
+
+                    T f[ 9 ];
+
+                    f[ 0 ] = get_distribution( m, 0 );
+
+                    for ( size_t q = 1; q < 9; ++q ) {
+
+                        // neighbour the distribution streams in from
+                        const size_t x_s = x - e[ q ].first;
+                        const size_t y_s = y - e[ q ].second;
+
+                        if ( obstacle[ x_s + y_s * xdim ] )
+                            f[ q ] = get_distribution( m, opposite_q[ q ] );
+                        else
+                            f[ q ] = get_distribution( M.cell( y_s, x_s ), q );
+                    }
+
+                    if ( fields )
+                        fields.store( x + y * xdim, f );
+
+                    Collision::collide( f, omega );
+
+                    store_moments( M_n, y, x, f );
+                }
+            }
+        }
+
+        /*
+            the engine on moment storage, see cs_state_tbb. the grid holds post-collision moments,
+            as the fused kernel holds post-collision distributions. Layout is the layout of the
+            moments, [ y ][ x ][ k ] with layout_aos.
+        */
+        template<typename Layout = layout_aos, typename Collision = collision_regularized>
+        struct moment_cs_state_tbb {
+
+            numa_vector<T> M_a;
+            numa_vector<T> M_b;
+
+            // current grid
+            T* M;
+            // grid being streamed into
+            T* M_n;
+
+            std::vector<unsigned char> obstacle;
+
+            size_t ydim;
+            size_t xdim;
+            size_t vec_len;
+
+            // elements in each buffer, at least vec_len * moment_count depending on the layout
+            size_t span_size;
+
+            T viscosity;
+            T omega;
+
+            boundary_conditions boundaries;
+
+            numa_partition numa;
+
+            moment_cs_state_tbb() = default;
+
+            // M and M_n point into the buffers, so the state can be moved but not copied
+            moment_cs_state_tbb( const moment_cs_state_tbb& ) = delete;
+            moment_cs_state_tbb& operator=( const moment_cs_state_tbb& ) = delete;
+
+            moment_cs_state_tbb( moment_cs_state_tbb&& ) = default;
+            moment_cs_state_tbb& operator=( moment_cs_state_tbb&& ) = default;
+
+            moment_view<Layout> view( T* M_data ) const {
+
+                return { M_data, ydim, xdim };
+            }
+        };
+
+        /*
+            D2Q9 is a grid in the AoS layout of D2Q9_view, stored as its moments
+        */
+        template<typename Layout = layout_aos, typename Collision = collision_regularized>
+        moment_cs_state_tbb<Layout, Collision> init_moment_cs_tbb( const T* D2Q9, const unsigned char* obstacle,
+                                                                   const size_t ydim, const size_t xdim, const T viscosity ) {
+
+            moment_cs_state_tbb<Layout, Collision> cs;
+
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+            cs.vec_len = ydim * xdim;
+            cs.span_size = lattice_span_size<Layout, moment_count>( ydim, xdim );
+
+            cs.viscosity = viscosity;
+            cs.omega = 1.0 / ( 3.0 * viscosity + 0.5 );
+
+            cs.M_a.resize( cs.span_size );
+            cs.M_b.resize( cs.span_size );
+
+            cs.M = cs.M_a.data();
+            cs.M_n = cs.M_b.data();
+
+            auto D2Q9_v = make_lattice_view<layout_aos>( D2Q9, ydim, xdim );
+
+            cs.numa.parallel_grid_rows( ydim,
+                [&]( const size_t y_begin, const size_t y_end ) {
+
+                    for ( size_t y = y_begin; y < y_end; ++y ) {
+                        for ( size_t x = 0; x < xdim; ++x ) {
+
+                            T f[ 9 ];
+
+                            for ( size_t q = 0; q < 9; ++q )
+                                f[ q ] = D2Q9_v[ y, x, q ];
+
+                            store_moments( cs.view( cs.M ), y, x, f );
+                            store_moments( cs.view( cs.M_n ), y, x, f );
+                        }
+                    }
+                }
+            );
+
+            cs.obstacle.assign( obstacle, obstacle + cs.vec_len );
+
+            cs.boundaries = make_boundary_conditions();
+
+            return cs;
+        }
+
+        template<typename Layout, typename Collision>
+        void set_grid_boundaries( moment_cs_state_tbb<Layout, Collision>& cs ) {
+
+            for ( T* M_data : { cs.M, cs.M_n } )
+                set_edge_cells( cs.view( M_data ), cs.boundaries );
+        }
+
+        template<typename Layout, typename Collision>
+        void set_boundary_conditions( moment_cs_state_tbb<Layout, Collision>& cs, const boundary_conditions& bc ) {
+
+            cs.boundaries = bc;
+
+            set_grid_boundaries( cs );
+        }
+
+        // the density and velocity of the current grid, see macroscopic.hpp
+        template<typename Layout, typename Collision>
+        void calculate_macroscopic( moment_cs_state_tbb<Layout, Collision>& cs, const macroscopic_fields& fields ) {
+
+            const auto M = cs.view( cs.M ).moments();
+
+            cs.numa.parallel_grid_rows( cs.ydim,
+                [&]( const size_t y_begin, const size_t y_end ) {
+
+                    for ( size_t y = y_begin; y < y_end; ++y ) {
+                        for ( size_t x = 0; x < cs.xdim; ++x ) {
+
+                            const size_t i = x + y * cs.xdim;
+
+                            if ( fields.rho )
+                                fields.rho[ i ] = M[ y, x, 0 ];
+
+                            if ( fields.u_x )
+                                fields.u_x[ i ] = M[ y, x, 1 ];
+
+                            if ( fields.u_y )
+                                fields.u_y[ i ] = M[ y, x, 2 ];
+                        }
+                    }
+                }
+            );
+        }
+
+        /*
+            advance the simulation by "steps" time-steps, see stateful_collide_and_stream_tbb. the
+            density and velocity after the last step are stored in "fields" if it has any.
+        */
+        template<typename Layout, typename Collision>
+        void stateful_collide_and_stream_tbb( moment_cs_state_tbb<Layout, Collision>& cs, const size_t steps,
+                                              const macroscopic_fields& fields = {} ) {
+
+            const unsigned char* obstacle = cs.obstacle.data();
+
+            for ( size_t z = 0; z < steps; ++z ) {
+
+                const auto M = cs.view( cs.M );
+                const auto M_n = cs.view( cs.M_n );
+
+                cs.numa.parallel_rows( 1, cs.ydim - 1,
+                    [&]( const size_t y_begin, const size_t y_end ) {
+
+                        fused_collide_and_stream_moments_rows<Collision>( M, M_n, obstacle, y_begin, y_end, cs.omega );
+                    }
+                );
+
+                apply_boundary_conditions<Collision>( M, M_n, obstacle, cs.boundaries, cs.omega, true );
+
+                std::swap( cs.M, cs.M_n );
+            }
+
+            // the moments are the fields, nothing to rebuild
+            if ( fields )
+                calculate_macroscopic( cs, fields );
+        }
+
+        template<typename Layout, typename Collision>
+        double benchmark_cs( moment_cs_state_tbb<Layout, Collision>& cs, const size_t steps ) {
+
+            auto start = std::chrono::steady_clock::now();
+
+            stateful_collide_and_stream_tbb( cs, steps );
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            return static_cast<double>( cs.vec_len ) * steps / elapsed.count() / 1e6;
+        }
+
+        // the current grid rebuilt as distributions into D2Q9, in the AoS layout of D2Q9_view
+        template<typename Layout, typename Collision>
+        void export_D2Q9( moment_cs_state_tbb<Layout, Collision>& cs, T* D2Q9 ) {
+
+            copy_D2Q9( cs.view( cs.M ), make_lattice_view<layout_aos>( D2Q9, cs.ydim, cs.xdim ) );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
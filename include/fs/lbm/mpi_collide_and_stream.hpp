@@ -0,0 +1,393 @@
+#ifndef LBM_MPI_COLLIDE_AND_STREAM_HPP
+#define LBM_MPI_COLLIDE_AND_STREAM_HPP
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/initialize_grid.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
+/*
+    distributed fused kernel over MPI ranks.
+
+    the interior rows of the grid are split into slabs, one per rank. a rank stores its slab with a
+    ghost row either side, so the fused pull kernel ( see fused_collide_and_stream_tbb.hpp ) runs on
+    it unchanged. each step:
+    ( 1 ) the distributions leaving the slab are sent to the neighbouring ranks: those moving up
+          ( 2, 5, 6 ) from the top row, those moving down ( 4, 7, 8 ) from the bottom row. the other
+          six directions of a ghost row are never pulled, so they aren't sent.
+    ( 2 ) while they are in flight the rows that don't read a ghost row are updated.
+    ( 3 ) the ghost rows are filled in and the top and bottom rows updated.
+    ( 4 ) the boundary conditions are applied to the edge-cells of the slab ( see
+          boundary_conditions.hpp ), by the first and last ranks also to the edge-rows of the grid.
+    the first and last ranks' outer ghost rows are the edge-rows of the grid, which hold boundary
+    values and aren't exchanged. within a rank the rows are updated in parallel with TBB, so ranks
+    can be sockets with a thread per core each.
+    the optional dependency on MPI keeps this header out of lbm.hpp.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        // directions moving up and down, the only ones that cross between slabs
+        constexpr std::array<size_t, 3> up_q = { 2, 5, 6 };
+        constexpr std::array<size_t, 3> down_q = { 4, 7, 8 };
+
+        struct mpi_cs_state {
+
+            MPI_Comm comm;
+
+            int rank;
+            int ranks;
+
+            // neighbouring ranks, MPI_PROC_NULL at the edges of the grid
+            int below;
+            int above;
+
+            // the whole grid
+            size_t ydim;
+            size_t xdim;
+
+            // interior rows [ y_begin, y_end ) of the grid belong to this rank
+            size_t y_begin;
+            size_t y_end;
+
+            // rows of the slab with its ghost rows, local row 0 is row y_begin - 1 of the grid
+            size_t local_ydim;
+
+            std::vector<T> D2Q9_a;
+            std::vector<T> D2Q9_b;
+
+            // current slab
+            T* D2Q9;
+            // slab being streamed into
+            T* D2Q9_n;
+
+            // obstacle of the slab and its ghost rows
+            std::vector<unsigned char> obstacle;
+
+            // outgoing distributions of the bottom and top rows, and the incoming ones of the ghost rows
+            std::vector<T> send_below;
+            std::vector<T> send_above;
+            std::vector<T> recv_below;
+            std::vector<T> recv_above;
+
+            T viscosity;
+            T omega;
+
+            boundary_conditions boundaries;
+
+            mpi_cs_state() = default;
+
+            // D2Q9 and D2Q9_n point into the buffers, so the state can be moved but not copied
+            mpi_cs_state( const mpi_cs_state& ) = delete;
+            mpi_cs_state& operator=( const mpi_cs_state& ) = delete;
+
+            mpi_cs_state( mpi_cs_state&& ) = default;
+            mpi_cs_state& operator=( mpi_cs_state&& ) = default;
+
+            auto view( T* D2Q9_data ) const {
+
+                return make_lattice_view<layout_aos>( D2Q9_data, local_ydim, xdim );
+            }
+        };
+
+        /*
+            every rank's share of a ydim x xdim grid. D2Q9 and obstacle are the whole grid and only
+            need to be valid on the rank's own rows and the rows either side. every rank needs an
+            interior row, with more ranks than ydim - 2 it throws std::invalid_argument on all of them.
+        */
+        inline mpi_cs_state init_mpi_cs( const T* D2Q9, const unsigned char* obstacle, const size_t ydim, const size_t xdim,
+                                         const T viscosity, MPI_Comm comm = MPI_COMM_WORLD ) {
+
+            mpi_cs_state cs;
+
+            cs.comm = comm;
+
+            MPI_Comm_rank( comm, &cs.rank );
+            MPI_Comm_size( comm, &cs.ranks );
+
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+
+            const size_t rows = ydim - 2;
+
+            if ( static_cast<size_t>( cs.ranks ) > rows )
+                throw std::invalid_argument( "more ranks than interior rows: " + std::to_string( cs.ranks ) + " ranks for " +
+                                             std::to_string( rows ) + " rows" );
+
+            cs.y_begin = 1 + rows * cs.rank / cs.ranks;
+            cs.y_end = 1 + rows * ( cs.rank + 1 ) / cs.ranks;
+
+            cs.below = cs.rank > 0 ? cs.rank - 1 : MPI_PROC_NULL;
+            cs.above = cs.rank < cs.ranks - 1 ? cs.rank + 1 : MPI_PROC_NULL;
+
+            cs.local_ydim = cs.y_end - cs.y_begin + 2;
+
+            const size_t row = xdim * 9;
+
+            cs.D2Q9_a.assign( D2Q9 + ( cs.y_begin - 1 ) * row, D2Q9 + ( cs.y_end + 1 ) * row );
+            cs.D2Q9_b = cs.D2Q9_a;
+
+            cs.D2Q9 = cs.D2Q9_a.data();
+            cs.D2Q9_n = cs.D2Q9_b.data();
+
+            cs.obstacle.assign( obstacle + ( cs.y_begin - 1 ) * xdim, obstacle + ( cs.y_end + 1 ) * xdim );
+
+            for ( auto* buffer : { &cs.send_below, &cs.send_above, &cs.recv_below, &cs.recv_above } )
+                buffer->resize( xdim * 3 );
+
+            cs.viscosity = viscosity;
+            cs.omega = 1.0 / ( 3.0 * viscosity + 0.5 );
+
+            cs.boundaries = make_boundary_conditions();
+
+            return cs;
+        }
+
+        /*
+            set the edge-cells of the grid that belong to this rank in both buffers to the equilibrium
+            of the boundary conditions, as set_grid_boundaries does for the whole grid
+        */
+        inline void set_grid_boundaries( mpi_cs_state& cs ) {
+
+            for ( T* D2Q9_data : { cs.D2Q9, cs.D2Q9_n } ) {
+
+                auto D2Q9 = cs.view( D2Q9_data );
+
+                for ( size_t y = 0; y < cs.local_ydim; ++y ) {
+
+                    // inlet
+                    set_cell( D2Q9, y, 0, cs.boundaries.f_eq );
+                    // outlet
+                    set_cell( D2Q9, y, cs.xdim - 1, cs.boundaries.f_eq );
+                }
+
+                for ( size_t x = 0; x < cs.xdim; ++x ) {
+
+                    // top boundary
+                    if ( cs.below == MPI_PROC_NULL )
+                        set_cell( D2Q9, 0, x, cs.boundaries.f_eq );
+                    // bottom boundary
+                    if ( cs.above == MPI_PROC_NULL )
+                        set_cell( D2Q9, cs.local_ydim - 1, x, cs.boundaries.f_eq );
+                }
+            }
+        }
+
+        /*
+            switch boundary conditions on this rank, which resets its edge-cells to the new
+            equilibrium. every rank should be given the same ones.
+        */
+        inline void set_boundary_conditions( mpi_cs_state& cs, const boundary_conditions& bc ) {
+
+            cs.boundaries = bc;
+
+            set_grid_boundaries( cs );
+        }
+
+        template<typename Collision = collision_BGK>
+        void stateful_collide_and_stream_mpi( mpi_cs_state& cs, const size_t steps ) {
+
+            const size_t xdim = cs.xdim;
+            const size_t top = cs.local_ydim - 2;
+
+            auto pack = [&]( const T* D2Q9, const size_t y, const std::array<size_t, 3>& directions, std::vector<T>& buffer ) {
+
+                for ( size_t x = 0; x < xdim; ++x )
+                    for ( size_t k = 0; k < 3; ++k )
+                        buffer[ x * 3 + k ] = D2Q9[ ( y * xdim + x ) * 9 + directions[ k ] ];
+            };
+
+            auto unpack = [&]( T* D2Q9, const size_t y, const std::array<size_t, 3>& directions, const std::vector<T>& buffer ) {
+
+                for ( size_t x = 0; x < xdim; ++x )
+                    for ( size_t k = 0; k < 3; ++k )
+                        D2Q9[ ( y * xdim + x ) * 9 + directions[ k ] ] = buffer[ x * 3 + k ];
+            };
+
+            auto update_rows = [&]( const size_t y_begin, const size_t y_end ) {
+
+                if ( y_begin >= y_end )
+                    return;
+
+                tbb::parallel_for( tbb::blocked_range<size_t>( y_begin, y_end ),
+                    [&]( const tbb::blocked_range<size_t>& r ) {
+
+                        fused_collide_and_stream_rows<Collision>( cs.view( cs.D2Q9 ), cs.view( cs.D2Q9_n ), cs.obstacle.data(),
+                                                                  r.begin(), r.end(), cs.omega );
+                    }
+                );
+            };
+
+            const int count = static_cast<int>( xdim * 3 );
+
+            for ( size_t s = 0; s < steps; ++s ) {
+
+                MPI_Request requests[ 4 ];
+
+                MPI_Irecv( cs.recv_below.data(), count, MPI_DOUBLE, cs.below, 0, cs.comm, &requests[ 0 ] );
+                MPI_Irecv( cs.recv_above.data(), count, MPI_DOUBLE, cs.above, 1, cs.comm, &requests[ 1 ] );
+
+                pack( cs.D2Q9, top, up_q, cs.send_above );
+                pack( cs.D2Q9, 1, down_q, cs.send_below );
+
+                MPI_Isend( cs.send_above.data(), count, MPI_DOUBLE, cs.above, 0, cs.comm, &requests[ 2 ] );
+                MPI_Isend( cs.send_below.data(), count, MPI_DOUBLE, cs.below, 1, cs.comm, &requests[ 3 ] );
+
+                // rows that only read rows of this slab
+                update_rows( 2, top );
+
+                MPI_Waitall( 4, requests, MPI_STATUSES_IGNORE );
+
+                if ( cs.below != MPI_PROC_NULL )
+                    unpack( cs.D2Q9, 0, up_q, cs.recv_below );
+
+                if ( cs.above != MPI_PROC_NULL )
+                    unpack( cs.D2Q9, top + 1, down_q, cs.recv_above );
+
+                // rows next to the ghost rows, a single row when the slab is one row
+                update_rows( 1, 2 );
+
+                if ( top > 1 )
+                    update_rows( top, top + 1 );
+
+                // the ghost rows are set as edge-rows too, only the directions exchanged are read from them
+                apply_boundary_conditions<Collision>( cs.view( cs.D2Q9 ), cs.view( cs.D2Q9_n ), cs.obstacle.data(),
+                                                      cs.boundaries, cs.omega, true );
+
+                std::swap( cs.D2Q9, cs.D2Q9_n );
+            }
+        }
+
+        /*
+            collect rows of "row_bytes" bytes from every rank's slab, ghost rows included, into the
+            whole grid on rank 0. the edge-rows of the grid are the first and last ranks' outer
+            ghost rows.
+        */
+        inline void gather_rows( const mpi_cs_state& cs, const void* local, void* global, const size_t row_bytes ) {
+
+            MPI_Datatype row;
+
+            MPI_Type_contiguous( static_cast<int>( row_bytes ), MPI_BYTE, &row );
+            MPI_Type_commit( &row );
+
+            std::vector<int> counts( cs.ranks ), displacements( cs.ranks );
+
+            for ( int r = 0; r < cs.ranks; ++r ) {
+
+                const size_t y_begin = 1 + ( cs.ydim - 2 ) * r / cs.ranks;
+                const size_t y_end = 1 + ( cs.ydim - 2 ) * ( r + 1 ) / cs.ranks;
+
+                counts[ r ] = static_cast<int>( y_end - y_begin );
+                displacements[ r ] = static_cast<int>( y_begin );
+            }
+
+            /*
+                the first and last ranks also send their outer ghost row. MPI_Gatherv only reads the
+                counts and displacements on the root, so they're only adjusted there.
+            */
+            if ( cs.rank == 0 ) {
+                ++counts[ 0 ];
+                ++counts[ cs.ranks - 1 ];
+                displacements[ 0 ] = 0;
+            }
+
+            const bool first = cs.rank == 0;
+            const bool last = cs.rank == cs.ranks - 1;
+
+            const int send_count = static_cast<int>( cs.y_end - cs.y_begin ) + first + last;
+            const unsigned char* send = static_cast<const unsigned char*>( local ) + ( first ? 0 : row_bytes );
+
+            MPI_Gatherv( send, send_count, row, global, counts.data(), displacements.data(), row, 0, cs.comm );
+
+            MPI_Type_free( &row );
+        }
+
+        /*
+            collect the whole grid into D2Q9 on rank 0, in the layout_aos of the other engines.
+            D2Q9 is only written on rank 0.
+        */
+        inline void gather_D2Q9( const mpi_cs_state& cs, T* D2Q9 ) {
+
+            gather_rows( cs, cs.D2Q9, D2Q9, cs.xdim * 9 * sizeof( T ) );
+        }
+
+        struct mpi_benchmark {
+
+            // million lattice-cell updates per second over all ranks
+            double mlups;
+
+            // time on one rank over ranks times the time on all of them, 1 is perfect strong scaling
+            double efficiency;
+        };
+
+        /*
+            "steps" time-steps on every rank, and the same steps of the whole grid on rank 0 alone
+            for the parallel efficiency. the result is only valid on rank 0, and the state is left
+            "steps" steps further on.
+        */
+        inline mpi_benchmark benchmark_mpi_cs( mpi_cs_state& cs, const size_t steps ) {
+
+            // every cell of the grid, as benchmark_cs counts them for the shared-memory engines
+            const size_t cells = cs.ydim * cs.xdim;
+
+            MPI_Barrier( cs.comm );
+
+            const double start = MPI_Wtime();
+
+            stateful_collide_and_stream_mpi( cs, steps );
+
+            MPI_Barrier( cs.comm );
+
+            const double elapsed = MPI_Wtime() - start;
+
+            mpi_benchmark result{ cells * steps / elapsed / 1e6, 1.0 };
+
+            if ( cs.ranks > 1 ) {
+
+                std::vector<T> D2Q9( cs.rank == 0 ? cs.ydim * cs.xdim * 9 : 0 );
+                std::vector<unsigned char> obstacle( cs.rank == 0 ? cs.ydim * cs.xdim : 0 );
+
+                gather_D2Q9( cs, D2Q9.data() );
+                gather_rows( cs, cs.obstacle.data(), obstacle.data(), cs.xdim );
+
+                if ( cs.rank == 0 ) {
+
+                    mpi_cs_state single = init_mpi_cs( D2Q9.data(), obstacle.data(), cs.ydim, cs.xdim, cs.viscosity, MPI_COMM_SELF );
+
+                    single.boundaries = cs.boundaries;
+
+                    const double single_start = MPI_Wtime();
+
+                    stateful_collide_and_stream_mpi( single, steps );
+
+                    result.efficiency = ( MPI_Wtime() - single_start ) / ( cs.ranks * elapsed );
+                }
+
+                MPI_Barrier( cs.comm );
+            }
+
+            return result;
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
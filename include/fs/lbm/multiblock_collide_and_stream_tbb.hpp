@@ -0,0 +1,578 @@
+#ifndef LBM_MULTIBLOCK_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_MULTIBLOCK_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+
+/*
+    static grid refinement: nested blocks of finer grids around the obstacles.
+
+    level 0 is the whole grid. level l + 1 refines a block of level l by 2:1, its nodes coincide with
+    the block's nodes and fall half-way between them, so a block of ( n_y + 1 ) x ( n_x + 1 ) nodes
+    is a level of ( 2n_y + 1 ) x ( 2n_x + 1 ). the spacing and the time-step halve from one level to
+    the next, so for the same viscosity tau - 1/2 doubles ( convective scaling ), and a level takes
+    two steps for each of the level above it ( local time-stepping ).
+
+    every level is run by the fused pull kernel ( see fused_collide_and_stream_tbb.hpp ), so a level
+    holds post-collision distributions and its edge-cells aren't updated by the kernel. the edge-cells
+    of level 0 hold the boundary conditions ( see boundary_conditions.hpp ), those of a finer level
+    are the interface with the level above. each step of level l:
+    ( 1 ) level l takes a step, leaving out the nodes strictly inside the block of level l + 1.
+    ( 2 ) the pre-collision distributions of level l are gathered at the nodes on the perimeter of
+          the block, by pulling from the state before the step.
+    ( 3 ) level l + 1 takes a step, with its edge-cells from the previous step of level l.
+    ( 4 ) its edge-cells are set from the average of the distributions gathered this step and the
+          previous one, the level l values half-way through the step, and it takes a second step.
+    ( 5 ) its edge-cells are set from the distributions gathered this step.
+    ( 6 ) the nodes of level l strictly inside the block are set from the coincident nodes of
+          level l + 1.
+    the edge-cells between two nodes of level l take the average of the two. the distributions are
+    pre-collision when they cross between levels, where the non-equilibrium part is rescaled for the
+    other relaxation time and spacing ( Dupuis and Chopard, 2003 ):
+        f_fine = f_eq + tau_fine / ( 2 tau_coarse ) ( f_coarse - f_eq )
+    and the other way around, then collided on the level they're written to.
+
+    a level is stepped twice as often as the one above it, but covers only its block, so resolving
+    the flow next to an obstacle costs a small part of the cell updates of refining the whole grid.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            nodes [ y_begin, y_end ] x [ x_begin, x_end ] of a level, inclusive, the perimeter of the
+            block refining them. a block has to be at least a node from the edge-cells of its level.
+        */
+        struct refinement_block {
+
+            size_t y_begin;
+            size_t y_end;
+            size_t x_begin;
+            size_t x_end;
+
+            size_t ydim() const { return y_end - y_begin + 1; }
+            size_t xdim() const { return x_end - x_begin + 1; }
+        };
+
+        struct refinement_level {
+
+            size_t ydim;
+            size_t xdim;
+
+            // block of the level above this refines, unused on level 0
+            refinement_block block;
+
+            // position of node ( 0, 0 ) in the nodes of level 0, and the spacing in those nodes
+            T origin_y;
+            T origin_x;
+            T spacing;
+
+            T tau;
+            T omega;
+
+            std::vector<T> D2Q9_a;
+            std::vector<T> D2Q9_b;
+
+            // current grid
+            T* D2Q9;
+            // grid being streamed into
+            T* D2Q9_n;
+
+            std::vector<unsigned char> obstacle;
+
+            /*
+                pre-collision distributions of the level above at the nodes of the block, in layout_aos
+                of block.ydim() x block.xdim(), gathered the step before and this step. only the
+                perimeter is written.
+            */
+            std::vector<T> interface_prev;
+            std::vector<T> interface_next;
+
+            auto view( T* D2Q9_data ) const {
+
+                return make_lattice_view<layout_aos>( D2Q9_data, ydim, xdim );
+            }
+
+            auto interface_view( T* interface_data ) const {
+
+                return make_lattice_view<layout_aos>( interface_data, block.ydim(), block.xdim() );
+            }
+        };
+
+        struct multiblock_cs_state_tbb {
+
+            // level 0 first, each refining a block of the one before it
+            std::vector<refinement_level> levels;
+
+            // in the units of level 0
+            T viscosity;
+
+            // of level 0
+            boundary_conditions boundaries = make_boundary_conditions();
+
+            multiblock_cs_state_tbb() = default;
+
+            // the levels point into their buffers, so the state can be moved but not copied
+            multiblock_cs_state_tbb( const multiblock_cs_state_tbb& ) = delete;
+            multiblock_cs_state_tbb& operator=( const multiblock_cs_state_tbb& ) = delete;
+
+            multiblock_cs_state_tbb( multiblock_cs_state_tbb&& ) = default;
+            multiblock_cs_state_tbb& operator=( multiblock_cs_state_tbb&& ) = default;
+        };
+
+        /*
+            the smallest block holding every obstacle cell of the grid and "margin" nodes of fluid
+            around it, kept a node clear of the edge-cells
+        */
+        inline refinement_block get_refinement_block( const unsigned char* obstacle, const size_t ydim, const size_t xdim,
+                                                      const size_t margin ) {
+
+            refinement_block block{ ydim, 0, xdim, 0 };
+
+            for ( size_t y = 1; y < ydim - 1; ++y ) {
+                for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                    if ( !obstacle[ x + y * xdim ] )
+                        continue;
+
+                    block.y_begin = std::min( block.y_begin, y );
+                    block.y_end = std::max( block.y_end, y );
+                    block.x_begin = std::min( block.x_begin, x );
+                    block.x_end = std::max( block.x_end, x );
+                }
+            }
+
+            // no obstacle, the block is the whole grid
+            if ( block.y_begin > block.y_end )
+                return { 1, ydim - 2, 1, xdim - 2 };
+
+            block.y_begin = std::max<size_t>( block.y_begin, margin + 1 ) - margin;
+            block.x_begin = std::max<size_t>( block.x_begin, margin + 1 ) - margin;
+            block.y_end = std::min( block.y_end + margin, ydim - 2 );
+            block.x_end = std::min( block.x_end + margin, xdim - 2 );
+
+            return block;
+        }
+
+        /*
+            the distributions streaming into node ( y, x ) of a level, the pre-collision distributions
+            of the next step, with half-way bounce-back from obstacle cells
+        */
+        template<typename View>
+        void pull_cell( const View& D2Q9, const unsigned char* obstacle, const size_t y, const size_t x, T ( &f )[ 9 ] ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
+
+            f[ 0 ] = D2Q9[ y, x, 0 ];
+
+            for ( size_t q = 1; q < 9; ++q ) {
+
+                // neighbour the distribution streams in from
+                const size_t x_s = x - e[ q ].first;
+                const size_t y_s = y - e[ q ].second;
+
+                if ( obstacle[ x_s + y_s * xdim ] )
+                    f[ q ] = D2Q9[ y, x, opposite_q[ q ] ];
+                else
+                    f[ q ] = D2Q9[ y_s, x_s, q ];
+            }
+        }
+
+        // scale the non-equilibrium part of the distributions of a cell by "factor"
+        inline void rescale_non_equilibrium( T ( &f )[ 9 ], const T factor ) {
+
+            const T rho = f[ 0 ] + f[ 1 ] + f[ 2 ] + f[ 3 ] + f[ 4 ] + f[ 5 ] + f[ 6 ] + f[ 7 ] + f[ 8 ];
+
+            const T u_x = ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho;
+            const T u_y = ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho;
+
+            for ( size_t q = 0; q < 9; ++q ) {
+
+                const T f_eq = calculate_f_eq( q, rho, u_x, u_y );
+
+                f[ q ] = f_eq + factor * ( f[ q ] - f_eq );
+            }
+        }
+
+        // call f( y, x ) for every node on the perimeter of a ydim x xdim grid
+        template<typename F>
+        void for_each_perimeter_node( const size_t ydim, const size_t xdim, const F& f ) {
+
+            for ( size_t x = 0; x < xdim; ++x ) {
+
+                f( 0, x );
+                f( ydim - 1, x );
+            }
+
+            for ( size_t y = 1; y < ydim - 1; ++y ) {
+
+                f( y, 0 );
+                f( y, xdim - 1 );
+            }
+        }
+
+        /*
+            one step of a level's kernel. "child" is the block of the level below, whose interior nodes
+            are left to the restriction, and "bc" the boundary conditions, for level 0.
+        */
+        template<typename Collision = collision_BGK>
+        void collide_and_stream_level( refinement_level& level, const refinement_block* child, const boundary_conditions* bc ) {
+
+            auto D2Q9 = level.view( level.D2Q9 );
+            auto D2Q9_n = level.view( level.D2Q9_n );
+
+            const unsigned char* obstacle = level.obstacle.data();
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, level.ydim - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t y = r.begin(); y < r.end(); ++y ) {
+
+                        if ( child && y > child->y_begin && y < child->y_end ) {
+
+                            // either side of the block, its perimeter included
+                            fused_collide_and_stream_tile<Collision>( D2Q9, D2Q9_n, obstacle, y, y + 1, 1, child->x_begin + 1, level.omega );
+                            fused_collide_and_stream_tile<Collision>( D2Q9, D2Q9_n, obstacle, y, y + 1, child->x_end, level.xdim - 1, level.omega );
+
+                        } else {
+
+                            fused_collide_and_stream_rows<Collision>( D2Q9, D2Q9_n, obstacle, y, y + 1, level.omega );
+                        }
+                    }
+                }
+            );
+
+            if ( bc )
+                apply_boundary_conditions<Collision>( D2Q9, D2Q9_n, obstacle, *bc, level.omega, true );
+
+            std::swap( level.D2Q9, level.D2Q9_n );
+        }
+
+        /*
+            the pre-collision distributions of "coarse" at the perimeter of the block of "fine", pulled
+            from "D2Q9_data", the state of the coarse level before its last step
+        */
+        inline void gather_interface( const refinement_level& coarse, refinement_level& fine, T* D2Q9_data, T* interface_data ) {
+
+            auto D2Q9 = coarse.view( D2Q9_data );
+            auto interface = fine.interface_view( interface_data );
+
+            const refinement_block& b = fine.block;
+
+            for_each_perimeter_node( b.ydim(), b.xdim(), [&]( const size_t y, const size_t x ) {
+
+                T f[ 9 ];
+
+                pull_cell( D2Q9, coarse.obstacle.data(), b.y_begin + y, b.x_begin + x, f );
+
+                for ( size_t q = 0; q < 9; ++q )
+                    interface[ y, x, q ] = f[ q ];
+            } );
+        }
+
+        /*
+            set the edge-cells of the current grid of "fine" from the distributions of "coarse" a
+            fraction "t" through the coarse step
+        */
+        template<typename Collision = collision_BGK>
+        void set_interface( const refinement_level& coarse, refinement_level& fine, const T t ) {
+
+            auto D2Q9 = fine.view( fine.D2Q9 );
+
+            auto prev = fine.interface_view( fine.interface_prev.data() );
+            auto next = fine.interface_view( fine.interface_next.data() );
+
+            const T factor = fine.tau / ( 2.0 * coarse.tau );
+
+            for_each_perimeter_node( fine.ydim, fine.xdim, [&]( const size_t y, const size_t x ) {
+
+                // the coarse nodes either side of the fine node, the same node if it coincides with one
+                const size_t y_0 = y / 2;
+                const size_t x_0 = x / 2;
+                const size_t y_1 = ( y + 1 ) / 2;
+                const size_t x_1 = ( x + 1 ) / 2;
+
+                T f[ 9 ];
+
+                for ( size_t q = 0; q < 9; ++q ) {
+
+                    const T f_0 = ( 1.0 - t ) * prev[ y_0, x_0, q ] + t * next[ y_0, x_0, q ];
+                    const T f_1 = ( 1.0 - t ) * prev[ y_1, x_1, q ] + t * next[ y_1, x_1, q ];
+
+                    f[ q ] = 0.5 * ( f_0 + f_1 );
+                }
+
+                rescale_non_equilibrium( f, factor );
+
+                Collision::collide( f, fine.omega );
+
+                for ( size_t q = 0; q < 9; ++q )
+                    D2Q9[ y, x, q ] = f[ q ];
+            } );
+        }
+
+        /*
+            set the nodes of the current grid of "coarse" strictly inside the block of "fine" from the
+            coincident fine nodes. the pre-collision distributions at the end of the coarse step are
+            pulled from the fine grid half a coarse step before.
+        */
+        template<typename Collision = collision_BGK>
+        void restrict_level( refinement_level& coarse, const refinement_level& fine ) {
+
+            auto D2Q9 = coarse.view( coarse.D2Q9 );
+            auto D2Q9_f = fine.view( fine.D2Q9_n );
+
+            const refinement_block& b = fine.block;
+
+            const T factor = 2.0 * coarse.tau / fine.tau;
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, b.ydim() - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t y = r.begin(); y < r.end(); ++y ) {
+                        for ( size_t x = 1; x < b.xdim() - 1; ++x ) {
+
+                            T f[ 9 ];
+
+                            pull_cell( D2Q9_f, fine.obstacle.data(), 2 * y, 2 * x, f );
+
+                            rescale_non_equilibrium( f, factor );
+
+                            Collision::collide( f, coarse.omega );
+
+                            for ( size_t q = 0; q < 9; ++q )
+                                D2Q9[ b.y_begin + y, b.x_begin + x, q ] = f[ q ];
+                        }
+                    }
+                }
+            );
+        }
+
+        // one step of level l and two of every level below it for each
+        template<typename Collision = collision_BGK>
+        void collide_and_stream_levels( multiblock_cs_state_tbb& cs, const size_t l ) {
+
+            refinement_level& level = cs.levels[ l ];
+
+            const bool refined = l + 1 < cs.levels.size();
+
+            collide_and_stream_level<Collision>( level, refined ? &cs.levels[ l + 1 ].block : nullptr,
+                                                 l == 0 ? &cs.boundaries : nullptr );
+
+            if ( !refined )
+                return;
+
+            refinement_level& fine = cs.levels[ l + 1 ];
+
+            gather_interface( level, fine, level.D2Q9_n, fine.interface_next.data() );
+
+            collide_and_stream_levels<Collision>( cs, l + 1 );
+
+            set_interface<Collision>( level, fine, 0.5 );
+
+            collide_and_stream_levels<Collision>( cs, l + 1 );
+
+            set_interface<Collision>( level, fine, 1.0 );
+
+            restrict_level<Collision>( level, fine );
+
+            std::swap( fine.interface_prev, fine.interface_next );
+        }
+
+        /*
+            "blocks" are the blocks refined, blocks[ l ] in the nodes of level l, so each is nested in
+            the one before it. the finer levels start from the distributions of the level above,
+            interpolated and rescaled as at the interface. the obstacle of a finer level is "inside"
+            at the position of each node in the nodes of level 0 if given, otherwise any node next to
+            an obstacle node of the level above.
+        */
+        inline multiblock_cs_state_tbb init_multiblock_cs_tbb( const T* D2Q9, const unsigned char* obstacle,
+                                                               const size_t ydim, const size_t xdim, const T viscosity,
+                                                               const std::vector<refinement_block>& blocks,
+                                                               const std::function<bool( T, T )>& inside = {} ) {
+
+            multiblock_cs_state_tbb cs;
+
+            cs.viscosity = viscosity;
+
+            cs.levels.reserve( blocks.size() + 1 );
+
+            refinement_level& base = cs.levels.emplace_back();
+
+            base.ydim = ydim;
+            base.xdim = xdim;
+            base.block = { 0, ydim - 1, 0, xdim - 1 };
+            base.origin_y = 0.0;
+            base.origin_x = 0.0;
+            base.spacing = 1.0;
+            base.tau = 3.0 * viscosity + 0.5;
+            base.omega = 1.0 / base.tau;
+            base.D2Q9_a.assign( D2Q9, D2Q9 + ydim * xdim * 9 );
+            base.D2Q9_b = base.D2Q9_a;
+            base.obstacle.assign( obstacle, obstacle + ydim * xdim );
+
+            for ( const refinement_block& b : blocks ) {
+
+                const refinement_level& coarse = cs.levels.back();
+
+                refinement_level level;
+
+                level.block = b;
+                level.ydim = 2 * b.ydim() - 1;
+                level.xdim = 2 * b.xdim() - 1;
+                level.spacing = 0.5 * coarse.spacing;
+                level.origin_y = coarse.origin_y + b.y_begin * coarse.spacing;
+                level.origin_x = coarse.origin_x + b.x_begin * coarse.spacing;
+                level.tau = 0.5 + 2.0 * ( coarse.tau - 0.5 );
+                level.omega = 1.0 / level.tau;
+
+                level.D2Q9_a.resize( level.ydim * level.xdim * 9 );
+                level.obstacle.resize( level.ydim * level.xdim );
+
+                const T* coarse_D2Q9 = coarse.D2Q9_a.data();
+                T* fine_D2Q9 = level.D2Q9_a.data();
+
+                // the non-equilibrium part scales between the levels as at the interface
+                const T factor = level.tau / ( 2.0 * coarse.tau );
+
+                for ( size_t y = 0; y < level.ydim; ++y ) {
+                    for ( size_t x = 0; x < level.xdim; ++x ) {
+
+                        // the coarse nodes either side
+                        const size_t y_0 = b.y_begin + y / 2;
+                        const size_t x_0 = b.x_begin + x / 2;
+                        const size_t y_1 = b.y_begin + ( y + 1 ) / 2;
+                        const size_t x_1 = b.x_begin + ( x + 1 ) / 2;
+
+                        T f[ 9 ];
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            f[ q ] = 0.25 * ( coarse_D2Q9[ ( x_0 + y_0 * coarse.xdim ) * 9 + q ] +
+                                              coarse_D2Q9[ ( x_1 + y_0 * coarse.xdim ) * 9 + q ] +
+                                              coarse_D2Q9[ ( x_0 + y_1 * coarse.xdim ) * 9 + q ] +
+                                              coarse_D2Q9[ ( x_1 + y_1 * coarse.xdim ) * 9 + q ] );
+
+                        rescale_non_equilibrium( f, factor );
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            fine_D2Q9[ ( x + y * level.xdim ) * 9 + q ] = f[ q ];
+
+                        if ( inside ) {
+
+                            level.obstacle[ x + y * level.xdim ] = inside( level.origin_y + y * level.spacing,
+                                                                           level.origin_x + x * level.spacing );
+                        } else {
+
+                            level.obstacle[ x + y * level.xdim ] = coarse.obstacle[ x_0 + y_0 * coarse.xdim ] |
+                                                                   coarse.obstacle[ x_1 + y_0 * coarse.xdim ] |
+                                                                   coarse.obstacle[ x_0 + y_1 * coarse.xdim ] |
+                                                                   coarse.obstacle[ x_1 + y_1 * coarse.xdim ];
+                        }
+                    }
+                }
+
+                level.D2Q9_b = level.D2Q9_a;
+
+                level.interface_prev.resize( b.ydim() * b.xdim() * 9 );
+                level.interface_next.resize( b.ydim() * b.xdim() * 9 );
+
+                cs.levels.push_back( std::move( level ) );
+            }
+
+            for ( refinement_level& level : cs.levels ) {
+
+                level.D2Q9 = level.D2Q9_a.data();
+                level.D2Q9_n = level.D2Q9_b.data();
+            }
+
+            // the previous step of the level above, for want of one, is its current state
+            for ( size_t l = 1; l < cs.levels.size(); ++l )
+                gather_interface( cs.levels[ l - 1 ], cs.levels[ l ], cs.levels[ l - 1 ].D2Q9, cs.levels[ l ].interface_prev.data() );
+
+            return cs;
+        }
+
+        /*
+            set the edge-cells of level 0 to the equilibrium of the boundary conditions, what
+            set_grid_boundaries does for the whole grid
+        */
+        inline void set_grid_boundaries( multiblock_cs_state_tbb& cs ) {
+
+            refinement_level& base = cs.levels.front();
+
+            set_edge_cells( base.view( base.D2Q9 ), cs.boundaries );
+            set_edge_cells( base.view( base.D2Q9_n ), cs.boundaries );
+        }
+
+        // "steps" steps of level 0, 2^l of level l for each
+        template<typename Collision = collision_BGK>
+        void stateful_collide_and_stream_tbb( multiblock_cs_state_tbb& cs, const size_t steps ) {
+
+            for ( size_t step = 0; step < steps; ++step )
+                collide_and_stream_levels<Collision>( cs, 0 );
+        }
+
+        // copy the current distributions of level l into D2Q9, levels[ l ].ydim x levels[ l ].xdim in layout_aos
+        inline void export_D2Q9( const multiblock_cs_state_tbb& cs, T* D2Q9, const size_t l = 0 ) {
+
+            const refinement_level& level = cs.levels[ l ];
+
+            std::memcpy( D2Q9, level.D2Q9, level.ydim * level.xdim * 9 * sizeof( T ) );
+        }
+
+        // cells updated by the kernels for a step of level 0
+        inline size_t cell_updates_per_step( const multiblock_cs_state_tbb& cs ) {
+
+            size_t updates = 0;
+
+            for ( size_t l = 0; l < cs.levels.size(); ++l ) {
+
+                const refinement_level& level = cs.levels[ l ];
+
+                size_t cells = ( level.ydim - 2 ) * ( level.xdim - 2 );
+
+                // the interior of the block below is restricted rather than updated
+                if ( l + 1 < cs.levels.size() ) {
+
+                    const refinement_block& b = cs.levels[ l + 1 ].block;
+
+                    cells -= ( b.ydim() - 2 ) * ( b.xdim() - 2 );
+                }
+
+                updates += cells << l;
+            }
+
+            return updates;
+        }
+
+        // the same for the whole of level 0 refined as finely as the finest level
+        inline size_t uniform_cell_updates_per_step( const multiblock_cs_state_tbb& cs ) {
+
+            const size_t l = cs.levels.size() - 1;
+
+            const size_t ydim = ( ( cs.levels.front().ydim - 1 ) << l ) + 1;
+            const size_t xdim = ( ( cs.levels.front().xdim - 1 ) << l ) + 1;
+
+            return ( ( ydim - 2 ) * ( xdim - 2 ) ) << l;
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef LBM_NUMA_TBB_HPP
+#define LBM_NUMA_TBB_HPP
+
+#include <chrono>
+#include <cstddef>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include <tbb/info.h>
+
+/*
+    NUMA placement for the TBB kernels.
+
+    a page is placed on the NUMA node of the thread that first writes it. a grid that is filled
+    by a single thread ends up on a single node and the threads of every other node read it over
+    the interconnect. instead:
+    ( 1 ) buffers are allocated without being filled ( default_init_allocator ).
+    ( 2 ) the rows of the grid are split between the nodes and each node's share is only ever
+          written and updated by threads of a task_arena pinned to that node ( numa_partition ),
+          starting with the first write.
+    on a machine with a single node this is one arena over all the rows.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            allocator whose value-initialization is default-initialization, so resizing a
+            std::vector of doubles doesn't write it
+        */
+        template<typename U>
+        struct default_init_allocator : std::allocator<U> {
+
+            using value_type = U;
+
+            template<typename V>
+            struct rebind {
+                using other = default_init_allocator<V>;
+            };
+
+            default_init_allocator() = default;
+
+            template<typename V>
+            default_init_allocator( const default_init_allocator<V>& ) noexcept {}
+
+            template<typename V>
+            void construct( V* p ) noexcept {
+
+                ::new ( static_cast<void*>( p ) ) V;
+            }
+
+            template<typename V, typename... Args>
+            void construct( V* p, Args&&... args ) {
+
+                ::new ( static_cast<void*>( p ) ) V( std::forward<Args>( args )... );
+            }
+        };
+
+        // buffer whose pages are placed by the first parallel write rather than on allocation
+        template<typename U>
+        using numa_vector = std::vector<U, default_init_allocator<U>>;
+
+        /*
+            a task_arena for each NUMA node, with the rows of a grid divided evenly between them.
+            the same rows go to the same node on every call, so a grid first written through
+            parallel_rows stays local to the threads that update it.
+        */
+        class numa_partition {
+
+        public:
+
+            numa_partition() {
+
+                for ( const tbb::numa_node_id node : tbb::info::numa_nodes() )
+                    arenas_.emplace_back( tbb::task_arena::constraints( node ) );
+            }
+
+            size_t nodes() const { return arenas_.size(); }
+
+            // rows [ y_begin, y_end ) that belong to a node
+            std::pair<size_t, size_t> node_rows( const size_t node, const size_t y_begin, const size_t y_end ) const {
+
+                const size_t rows = y_end - y_begin;
+
+                return { y_begin + rows * node / nodes(), y_begin + rows * ( node + 1 ) / nodes() };
+            }
+
+            /*
+                call f( i_b, i_e ) on subranges of [ begin, end ) on the threads of one node. the
+                static partitioner splits the range the same way on every call, which thread runs a
+                subrange may change but it is always one of the node's.
+            */
+            template<typename F>
+            void node_for( const size_t node, const size_t begin, const size_t end, const F& f ) {
+
+                arenas_[ node ].execute( [&] { for_range( begin, end, f ); } );
+            }
+
+            /*
+                call f( y_b, y_e ) on subranges of rows [ y_begin, y_end ), each node's rows on the
+                threads of that node, with the nodes running at the same time
+            */
+            template<typename F>
+            void parallel_rows( const size_t y_begin, const size_t y_end, const F& f ) {
+
+                if ( nodes() == 1 ) {
+
+                    node_for( 0, y_begin, y_end, f );
+
+                    return;
+                }
+
+                std::vector<tbb::task_group> groups( nodes() );
+
+                for ( size_t node = 0; node < nodes(); ++node ) {
+
+                    const auto [ y_b, y_e ] = node_rows( node, y_begin, y_end );
+
+                    arenas_[ node ].execute( [&, node, y_b, y_e] { groups[ node ].run( [&, y_b, y_e] { for_range( y_b, y_e, f ); } ); } );
+                }
+
+                for ( size_t node = 0; node < nodes(); ++node )
+                    arenas_[ node ].execute( [&, node] { groups[ node ].wait(); } );
+            }
+
+            /*
+                call f( y_b, y_e ) on subranges of every row of a grid of ydim rows, split as
+                parallel_rows splits the interior rows [ 1, ydim - 1 ) the kernels update, with the edge
+                rows added to the first and last subranges. a grid first written this way has each
+                interior row on the node that updates it.
+            */
+            template<typename F>
+            void parallel_grid_rows( const size_t ydim, const F& f ) {
+
+                parallel_rows( 1, ydim - 1,
+                    [&]( const size_t y_begin, const size_t y_end ) {
+
+                        f( y_begin == 1 ? 0 : y_begin, y_end == ydim - 1 ? ydim : y_end );
+                    }
+                );
+            }
+
+        private:
+
+            template<typename F>
+            static void for_range( const size_t begin, const size_t end, const F& f ) {
+
+                tbb::parallel_for( tbb::blocked_range<size_t>( begin, end ),
+                    [&]( const tbb::blocked_range<size_t>& r ) {
+
+                        f( r.begin(), r.end() );
+                    },
+                    tbb::static_partitioner()
+                );
+            }
+
+            std::vector<tbb::task_arena> arenas_;
+        };
+
+        /*
+            the STREAM-triad ceiling of each node in GB/s: a = b + s * c over "elements" doubles per
+            array, placed on and run by the threads of the node, one node at a time with the others
+            idle. the best of "repeats" runs is reported. it bounds what a node can move, not what
+            the kernels achieve or what a node gets with every node loaded, see numa_kernel_bandwidth.
+        */
+        inline std::vector<double> numa_triad_ceiling( numa_partition& numa, const size_t elements = size_t( 1 ) << 22,
+                                                         const size_t repeats = 5 ) {
+
+            std::vector<double> bandwidth;
+
+            for ( size_t node = 0; node < numa.nodes(); ++node ) {
+
+                numa_vector<double> a( elements ), b( elements ), c( elements );
+
+                // first touch by the node
+                numa.node_for( node, 0, elements,
+                    [&]( const size_t i_b, const size_t i_e ) {
+
+                        for ( size_t i = i_b; i < i_e; ++i ) {
+
+                            a[ i ] = 0.0;
+                            b[ i ] = 1.0;
+                            c[ i ] = 2.0;
+                        }
+                    }
+                );
+
+                double best{};
+
+                for ( size_t r = 0; r < repeats; ++r ) {
+
+                    auto start = std::chrono::steady_clock::now();
+
+                    numa.node_for( node, 0, elements,
+                        [&]( const size_t i_b, const size_t i_e ) {
+
+                            for ( size_t i = i_b; i < i_e; ++i )
+                                a[ i ] = b[ i ] + 3.0 * c[ i ];
+                        }
+                    );
+
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                    best = std::max( best, 3.0 * sizeof( double ) * elements / elapsed.count() / 1e9 );
+                }
+
+                bandwidth.push_back( best );
+            }
+
+            return bandwidth;
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,501 @@
+#ifndef LBM_PADDED_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_PADDED_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+#include <fs/lbm/macroscopic.hpp>
+#include <fs/lbm/numa_tbb.hpp>
+#include <fs/lbm/stateful_collide_and_stream_tbb.hpp>
+
+/*
+    a lattice padded with a ring of ghost cells.
+
+    every cell of the grid is a fluid cell ( or an obstacle ), none are set aside as edge-cells, and
+    the ghost cells around the grid hold what streams in across each side. the update is then the same
+    for every cell: pull each distribution from the neighbour it streams from, or from the cell itself
+    in the opposite direction when the neighbour is an obstacle. the choice is a select on the obstacle
+    mask rather than a branch, and the mask is padded too, so there are no edge ranges and no special
+    cases in the loop.
+
+    the side of the grid decides what its ghost cells hold, in a pass over the ghost ring after each
+    step:
+        equilibrium    the equilibrium of the free stream, the edge-cells of cs_state_tbb
+        zou_he         Zou-He velocity inlet, left side only
+        zero_gradient  a copy of the cells next to it
+        periodic       a copy of the cells on the opposite side, which must be periodic too
+        wall           obstacles, the cells next to it bounce back ( no-slip )
+
+    the grid is in layout_soa, so each distribution of a row is contiguous in both grids and the row
+    loop is loads, selects and stores at unit stride.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        enum class ghost_fill {
+            equilibrium,
+            zou_he,
+            zero_gradient,
+            periodic,
+            wall
+        };
+
+        struct ghost_boundaries {
+
+            ghost_fill left;
+            ghost_fill right;
+            ghost_fill top;
+            ghost_fill bottom;
+
+            // velocity along x and density of the free stream
+            T u_x;
+            T rho;
+
+            // equilibrium of rho and u_x
+            std::array<T, 9> f_eq;
+        };
+
+        /*
+            the boundary conditions of cs_state_tbb: the inlet on the left, the outlet on the right and
+            the free stream along the top and bottom. the ghost ring is only filled, nothing runs on the
+            interior after a step, so a non_reflecting outlet or a sponge layer throws
+            std::invalid_argument.
+        */
+        inline ghost_boundaries make_ghost_boundaries( const boundary_conditions& bc = make_boundary_conditions() ) {
+
+            if ( bc.outlet == outlet_bc::non_reflecting || bc.sponge.width > 0 )
+                throw std::invalid_argument( "the padded engine takes no non_reflecting outlet or sponge layer" );
+
+            return { bc.inlet == inlet_bc::zou_he ? ghost_fill::zou_he : ghost_fill::equilibrium,
+                     bc.outlet == outlet_bc::equilibrium ? ghost_fill::equilibrium : ghost_fill::zero_gradient,
+                     ghost_fill::equilibrium, ghost_fill::equilibrium,
+                     bc.u_x, bc.rho, bc.f_eq };
+        }
+
+        // a channel periodic along x between walls at the top and bottom
+        inline ghost_boundaries make_periodic_channel( const T rho = 1.0 ) {
+
+            ghost_boundaries gb = make_ghost_boundaries( make_boundary_conditions( inlet_bc::equilibrium, outlet_bc::equilibrium, 0.0, rho ) );
+
+            gb.left = gb.right = ghost_fill::periodic;
+            gb.top = gb.bottom = ghost_fill::wall;
+
+            return gb;
+        }
+
+        /*
+            one step of rows [ y_begin, y_end ) of a padded grid, in the padded coordinates. D2Q9 and
+            D2Q9_n are layout_soa grids of ydim x xdim cells, the ghost ring included, and obstacle is
+            the padded mask. the density and velocity are stored in "fields" by the index of the cell
+            in the grid without the ghost ring.
+        */
+        template<typename Collision = collision_BGK>
+        void padded_collide_and_stream_rows( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                             const size_t ydim, const size_t xdim,
+                                             const size_t y_begin, const size_t y_end, const T omega,
+                                             const macroscopic_fields& fields = {} ) {
+
+            const size_t plane = ydim * xdim;
+
+            for ( size_t y = y_begin; y < y_end; ++y ) {
+
+                // the rows above, at and below the cell, distribution q of a row is at [ q * plane + x ]
+                const T* f_s = D2Q9 + ( y - 1 ) * xdim;
+                const T* f_c = D2Q9 + y * xdim;
+                const T* f_n = D2Q9 + ( y + 1 ) * xdim;
+
+                const unsigned char* obstacle_s = obstacle + ( y - 1 ) * xdim;
+                const unsigned char* obstacle_c = obstacle + y * xdim;
+                const unsigned char* obstacle_n = obstacle + ( y + 1 ) * xdim;
+
+                T* f_next = D2Q9_n + y * xdim;
+
+                // both are loaded whichever is kept, so the select needs no branch
+                auto select = []( const unsigned char bounce, const T f_b, const T f_p ) { return bounce ? f_b : f_p; };
+
+                // the distributions streaming into cell x, or bounced back where they would come from an obstacle
+                auto pull = [=]( const size_t x, T ( &f )[ 9 ] ) {
+
+                    f[ 0 ] = f_c[ x ];
+                    f[ 1 ] = select( obstacle_c[ x - 1 ], f_c[ 3 * plane + x ], f_c[ 1 * plane + x - 1 ] );
+                    f[ 2 ] = select( obstacle_s[ x ],     f_c[ 4 * plane + x ], f_s[ 2 * plane + x ] );
+                    f[ 3 ] = select( obstacle_c[ x + 1 ], f_c[ 1 * plane + x ], f_c[ 3 * plane + x + 1 ] );
+                    f[ 4 ] = select( obstacle_n[ x ],     f_c[ 2 * plane + x ], f_n[ 4 * plane + x ] );
+                    f[ 5 ] = select( obstacle_s[ x - 1 ], f_c[ 7 * plane + x ], f_s[ 5 * plane + x - 1 ] );
+                    f[ 6 ] = select( obstacle_s[ x + 1 ], f_c[ 8 * plane + x ], f_s[ 6 * plane + x + 1 ] );
+                    f[ 7 ] = select( obstacle_n[ x + 1 ], f_c[ 5 * plane + x ], f_n[ 7 * plane + x + 1 ] );
+                    f[ 8 ] = select( obstacle_n[ x - 1 ], f_c[ 6 * plane + x ], f_n[ 8 * plane + x - 1 ] );
+                };
+
+                // D2Q9 and D2Q9_n are different grids, the rows written are never read
+                #pragma GCC ivdep
+                for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                    T f[ 9 ];
+
+                    pull( x, f );
+
+                    Collision::collide( f, omega );
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        f_next[ q * plane + x ] = f[ q ];
+                }
+
+                // a second pass over the row keeps the update loop free of it
+                if ( fields ) {
+
+                    for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                        T f[ 9 ];
+
+                        pull( x, f );
+
+                        fields.store( ( x - 1 ) + ( y - 1 ) * ( xdim - 2 ), f );
+                    }
+                }
+            }
+        }
+
+        /*
+            the obstacle mask of the padded grid from the mask of the grid, the ghost cells of a wall
+            are obstacles and those of a periodic side repeat the mask of the opposite side
+        */
+        inline void set_ghost_obstacle( std::vector<unsigned char>& padded, const unsigned char* obstacle,
+                                        const size_t ydim, const size_t xdim, const ghost_boundaries& gb ) {
+
+            const size_t ydim_p = ydim + 2;
+            const size_t xdim_p = xdim + 2;
+
+            padded.assign( ydim_p * xdim_p, 0 );
+
+            for ( size_t y = 0; y < ydim; ++y )
+                for ( size_t x = 0; x < xdim; ++x )
+                    padded[ ( x + 1 ) + ( y + 1 ) * xdim_p ] = obstacle[ x + y * xdim ];
+
+            for ( size_t y = 1; y < ydim_p - 1; ++y ) {
+
+                unsigned char* row = padded.data() + y * xdim_p;
+
+                row[ 0 ] = gb.left == ghost_fill::wall || ( gb.left == ghost_fill::periodic && row[ xdim_p - 2 ] );
+                row[ xdim_p - 1 ] = gb.right == ghost_fill::wall || ( gb.right == ghost_fill::periodic && row[ 1 ] );
+            }
+
+            for ( size_t x = 0; x < xdim_p; ++x ) {
+
+                unsigned char& top = padded[ x ];
+                unsigned char& bottom = padded[ x + ( ydim_p - 1 ) * xdim_p ];
+
+                top = gb.top == ghost_fill::wall || ( gb.top == ghost_fill::periodic && padded[ x + ( ydim_p - 2 ) * xdim_p ] );
+                bottom = gb.bottom == ghost_fill::wall || ( gb.bottom == ghost_fill::periodic && padded[ x + xdim_p ] );
+            }
+        }
+
+        /*
+            fill the ghost ring of D2Q9_n, the padded grid a step of D2Q9 has just streamed into. the
+            sides go first and the top and bottom after across the whole width, so the corners of
+            periodic sides wrap around diagonally.
+        */
+        template<typename Collision = collision_BGK, typename View>
+        void fill_ghost_layer( const View& D2Q9, const View& D2Q9_n, const unsigned char* obstacle,
+                               const ghost_boundaries& gb, const T omega ) {
+
+            const size_t ydim = D2Q9_n.extent( 0 );
+            const size_t xdim = D2Q9_n.extent( 1 );
+
+            auto fill = [&]( const ghost_fill kind, const size_t y, const size_t x,
+                             const size_t y_next, const size_t x_next, const size_t y_wrap, const size_t x_wrap ) {
+
+                switch ( kind ) {
+
+                    case ghost_fill::equilibrium:
+
+                        set_cell( D2Q9_n, y, x, gb.f_eq );
+
+                        break;
+
+                    case ghost_fill::zou_he: {
+
+                        T f[ 9 ];
+
+                        zou_he_inlet( D2Q9, obstacle, y, gb.u_x, f );
+
+                        Collision::collide( f, omega );
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            D2Q9_n[ y, x, q ] = f[ q ];
+
+                        break;
+                    }
+
+                    case ghost_fill::zero_gradient:
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            D2Q9_n[ y, x, q ] = D2Q9_n[ y_next, x_next, q ];
+
+                        break;
+
+                    case ghost_fill::periodic:
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            D2Q9_n[ y, x, q ] = D2Q9_n[ y_wrap, x_wrap, q ];
+
+                        break;
+
+                    // the ghost cells are obstacles and never read
+                    case ghost_fill::wall:
+
+                        break;
+                }
+            };
+
+            for ( size_t y = 1; y < ydim - 1; ++y ) {
+
+                fill( gb.left, y, 0, y, 1, y, xdim - 2 );
+                fill( gb.right, y, xdim - 1, y, xdim - 2, y, 1 );
+            }
+
+            for ( size_t x = 0; x < xdim; ++x ) {
+
+                fill( gb.top, 0, x, 1, x, ydim - 2, x );
+                fill( gb.bottom, ydim - 1, x, ydim - 2, x, 1, x );
+            }
+        }
+
+        /*
+            the engine on a padded grid, see cs_state_tbb. ydim and xdim are the dimensions of the grid
+            without the ghost ring.
+        */
+        template<typename Collision = collision_BGK>
+        struct padded_cs_state_tbb {
+
+            numa_vector<T> D2Q9_a;
+            numa_vector<T> D2Q9_b;
+
+            // current grid
+            T* D2Q9;
+            // grid being streamed into
+            T* D2Q9_n;
+
+            // the padded mask
+            std::vector<unsigned char> obstacle;
+
+            size_t ydim;
+            size_t xdim;
+            size_t vec_len;
+
+            T viscosity;
+            T omega;
+
+            ghost_boundaries boundaries;
+
+            numa_partition numa;
+
+            padded_cs_state_tbb() = default;
+
+            // D2Q9 and D2Q9_n point into the buffers, so the state can be moved but not copied
+            padded_cs_state_tbb( const padded_cs_state_tbb& ) = delete;
+            padded_cs_state_tbb& operator=( const padded_cs_state_tbb& ) = delete;
+
+            padded_cs_state_tbb( padded_cs_state_tbb&& ) = default;
+            padded_cs_state_tbb& operator=( padded_cs_state_tbb&& ) = default;
+
+            // the padded grid, cell ( y, x ) of the grid is ( y + 1, x + 1 )
+            auto view( T* data ) const {
+
+                return make_lattice_view<layout_soa>( data, ydim + 2, xdim + 2 );
+            }
+        };
+
+        /*
+            fill the ghost ring of both grids for the state's boundaries. until the first step the
+            ghost cells of every side that isn't periodic hold the equilibrium of the free stream.
+        */
+        template<typename Collision>
+        void set_grid_boundaries( padded_cs_state_tbb<Collision>& cs ) {
+
+            ghost_boundaries gb = cs.boundaries;
+
+            for ( ghost_fill* side : { &gb.left, &gb.right, &gb.top, &gb.bottom } )
+                if ( *side != ghost_fill::periodic )
+                    *side = ghost_fill::equilibrium;
+
+            for ( T* D2Q9 : { cs.D2Q9, cs.D2Q9_n } )
+                fill_ghost_layer<Collision>( cs.view( D2Q9 ), cs.view( D2Q9 ), cs.obstacle.data(), gb, cs.omega );
+        }
+
+        template<typename Collision>
+        void set_obstacle( padded_cs_state_tbb<Collision>& cs, const unsigned char* obstacle ) {
+
+            set_ghost_obstacle( cs.obstacle, obstacle, cs.ydim, cs.xdim, cs.boundaries );
+        }
+
+        /*
+            switch boundaries, which also changes the ghost cells of the mask and resets the ghost ring
+        */
+        template<typename Collision>
+        void set_boundary_conditions( padded_cs_state_tbb<Collision>& cs, const ghost_boundaries& gb ) {
+
+            std::vector<unsigned char> obstacle( cs.ydim * cs.xdim );
+
+            for ( size_t y = 0; y < cs.ydim; ++y )
+                for ( size_t x = 0; x < cs.xdim; ++x )
+                    obstacle[ x + y * cs.xdim ] = cs.obstacle[ ( x + 1 ) + ( y + 1 ) * ( cs.xdim + 2 ) ];
+
+            cs.boundaries = gb;
+
+            set_obstacle( cs, obstacle.data() );
+
+            set_grid_boundaries( cs );
+        }
+
+        template<typename Collision>
+        void set_boundary_conditions( padded_cs_state_tbb<Collision>& cs, const boundary_conditions& bc ) {
+
+            set_boundary_conditions( cs, make_ghost_boundaries( bc ) );
+        }
+
+        /*
+            D2Q9 is a grid of ydim x xdim cells in the AoS layout of D2Q9_view, without the ghost ring
+        */
+        template<typename Collision = collision_BGK>
+        padded_cs_state_tbb<Collision> init_padded_cs_tbb( const T* D2Q9, const unsigned char* obstacle,
+                                                           const size_t ydim, const size_t xdim, const T viscosity,
+                                                           const ghost_boundaries& gb = make_ghost_boundaries() ) {
+
+            padded_cs_state_tbb<Collision> cs;
+
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+            cs.vec_len = ydim * xdim;
+
+            cs.viscosity = viscosity;
+            cs.omega = 1.0 / ( 3.0 * viscosity + 0.5 );
+
+            cs.boundaries = gb;
+
+            const size_t span_size = lattice_span_size<layout_soa>( ydim + 2, xdim + 2 );
+
+            cs.D2Q9_a.resize( span_size );
+            cs.D2Q9_b.resize( span_size );
+
+            cs.D2Q9 = cs.D2Q9_a.data();
+            cs.D2Q9_n = cs.D2Q9_b.data();
+
+            auto src = make_lattice_view<layout_aos>( D2Q9, ydim, xdim );
+
+            cs.numa.parallel_rows( 0, ydim,
+                [&]( const size_t y_begin, const size_t y_end ) {
+
+                    for ( T* data : { cs.D2Q9, cs.D2Q9_n } ) {
+
+                        auto dst = cs.view( data );
+
+                        for ( size_t y = y_begin; y < y_end; ++y )
+                            for ( size_t x = 0; x < xdim; ++x )
+                                for ( size_t q = 0; q < 9; ++q )
+                                    dst[ y + 1, x + 1, q ] = src[ y, x, q ];
+                    }
+                }
+            );
+
+            set_obstacle( cs, obstacle );
+
+            set_grid_boundaries( cs );
+
+            return cs;
+        }
+
+        // the density and velocity of the current grid, see macroscopic.hpp
+        template<typename Collision>
+        void calculate_macroscopic( padded_cs_state_tbb<Collision>& cs, const macroscopic_fields& fields ) {
+
+            const auto D2Q9 = cs.view( cs.D2Q9 );
+
+            cs.numa.parallel_rows( 0, cs.ydim,
+                [&]( const size_t y_begin, const size_t y_end ) {
+
+                    for ( size_t y = y_begin; y < y_end; ++y ) {
+                        for ( size_t x = 0; x < cs.xdim; ++x ) {
+
+                            T f[ 9 ];
+
+                            for ( size_t q = 0; q < 9; ++q )
+                                f[ q ] = D2Q9[ y + 1, x + 1, q ];
+
+                            fields.store( x + y * cs.xdim, f );
+                        }
+                    }
+                }
+            );
+        }
+
+        /*
+            advance the simulation by "steps" time-steps, see stateful_collide_and_stream_tbb. the
+            density and velocity after the last step are stored in "fields" if it has any.
+        */
+        template<typename Collision>
+        void stateful_collide_and_stream_tbb( padded_cs_state_tbb<Collision>& cs, const size_t steps,
+                                              const macroscopic_fields& fields = {} ) {
+
+            const unsigned char* obstacle = cs.obstacle.data();
+
+            const size_t ydim = cs.ydim + 2;
+            const size_t xdim = cs.xdim + 2;
+
+            for ( size_t z = 0; z < steps; ++z ) {
+
+                cs.numa.parallel_rows( 1, ydim - 1,
+                    [&]( const size_t y_begin, const size_t y_end ) {
+
+                        padded_collide_and_stream_rows<Collision>( cs.D2Q9, cs.D2Q9_n, obstacle, ydim, xdim, y_begin, y_end, cs.omega,
+                                                                   z + 1 == steps ? fields : macroscopic_fields{} );
+                    }
+                );
+
+                fill_ghost_layer<Collision>( cs.view( cs.D2Q9 ), cs.view( cs.D2Q9_n ), obstacle, cs.boundaries, cs.omega );
+
+                std::swap( cs.D2Q9, cs.D2Q9_n );
+            }
+        }
+
+        template<typename Collision>
+        double benchmark_cs( padded_cs_state_tbb<Collision>& cs, const size_t steps ) {
+
+            auto start = std::chrono::steady_clock::now();
+
+            stateful_collide_and_stream_tbb( cs, steps );
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            return static_cast<double>( cs.vec_len ) * steps / elapsed.count() / 1e6;
+        }
+
+        // the current grid without the ghost ring into D2Q9, in the AoS layout of D2Q9_view
+        template<typename Collision>
+        void export_D2Q9( padded_cs_state_tbb<Collision>& cs, T* D2Q9 ) {
+
+            const auto src = cs.view( cs.D2Q9 );
+            auto dst = make_lattice_view<layout_aos>( D2Q9, cs.ydim, cs.xdim );
+
+            for ( size_t y = 0; y < cs.ydim; ++y )
+                for ( size_t x = 0; x < cs.xdim; ++x )
+                    for ( size_t q = 0; q < 9; ++q )
+                        dst[ y, x, q ] = src[ y + 1, x + 1, q ];
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -5,6 +5,7 @@
 #include <numeric>
 #include <functional>
 
+#include <array>
 #include <vector>
 
 #include <grid.hpp>
@@ -172,31 +173,47 @@ namespace fs {
             }
         }
 
-        inline void calculate_property_v_tbb( double* D2Q9_data, double* property_data,
-                                              std::function<double( std::span<double> )> calculate_property ) {
+        // copy a cell of a D2Q9 view of any layout, so its distributions are contiguous
+        template<typename View>
+        std::array<double, 9> get_cell_state( const View& D2Q9, const size_t y, const size_t x ) {
+
+            std::array<double, 9> cell_state;
+
+            for ( size_t q = 0; q < 9; ++q )
+                cell_state[ q ] = D2Q9[ y, x, q ];
+
+            return cell_state;
+        }
+
+        template<typename View> requires ( View::rank() == 3 )
+        void calculate_property_v_tbb( const View& D2Q9, double* property_data,
+                                       std::function<double( std::span<double> )> calculate_property ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
 
             tbb::parallel_for(
-                tbb::blocked_range<size_t>( 0, fs::settings::ydim ),
+                tbb::blocked_range<size_t>( 0, D2Q9.extent( 0 ) ),
                 [&]( const tbb::blocked_range<size_t>& range ) {
 
                     for ( size_t y = range.begin(); y < range.end(); ++y ) {
- 
-                        for ( size_t x = 0; x < fs::settings::xdim; ++x ) {
 
-                            const size_t offset = ( x + y * fs::settings::xdim ) * 9;
+                        for ( size_t x = 0; x < xdim; ++x ) {
 
-                            // non-owning view of cell's Q9
-                            std::span<double> cell_state( &D2Q9_data[ offset ], 9 );
+                            std::array<double, 9> cell_state = get_cell_state( D2Q9, y, x );
 
-                            double property = calculate_property( cell_state );
-
-                            property_data[ x + y * fs::settings::xdim ] = property;
+                            property_data[ x + y * xdim ] = calculate_property( cell_state );
                         }
                     }
-                }   
+                }
             );
         }
 
+        inline void calculate_property_v_tbb( double* D2Q9_data, double* property_data,
+                                              std::function<double( std::span<double> )> calculate_property ) {
+
+            calculate_property_v_tbb( D2Q9_view( D2Q9_data ), property_data, calculate_property );
+        }
+
         template<typename Callable>
         concept CallableWithSpan = requires( Callable&& calc, std::span<double> cell_state ) {
             { calc( cell_state ) } -> std::convertible_to<double>;
@@ -230,37 +247,43 @@ namespace fs {
             );
         }
 
-        inline void calculate_curl_v_tbb( double* D2Q9_data, double* curl_data ) {
+        template<typename View> requires ( View::rank() == 3 )
+        void calculate_curl_v_tbb( const View& D2Q9, double* curl_data ) {
 
-            sim::grid<std::vector<double>, fs::property_view> u_x( fs::lbm::property_states );
-            sim::grid<std::vector<double>, fs::property_view> u_y( fs::lbm::property_states ); 
+            const size_t ydim = D2Q9.extent( 0 );
+            const size_t xdim = D2Q9.extent( 1 );
 
-            calculate_property_v_tbb( D2Q9_data, u_x.get_data_handle(), calculate_u_x );
-            calculate_property_v_tbb( D2Q9_data, u_y.get_data_handle(), calculate_u_y );
+            std::vector<double> u_x_data( ydim * xdim );
+            std::vector<double> u_y_data( ydim * xdim );
 
-            double* u_x_data = u_x.get_data_handle();
-            double* u_y_data = u_y.get_data_handle();
+            calculate_property_v_tbb( D2Q9, u_x_data.data(), calculate_u_x );
+            calculate_property_v_tbb( D2Q9, u_y_data.data(), calculate_u_y );
 
             tbb::parallel_for(
-                tbb::blocked_range<size_t>( 1, fs::settings::ydim - 1 ),
+                tbb::blocked_range<size_t>( 1, ydim - 1 ),
                     [&]( const tbb::blocked_range<size_t>& range ) {
 
                     for ( size_t y = range.begin(); y < range.end(); ++y ) {
 
-                        for ( size_t x = 1; x < fs::settings::xdim - 1; ++x ) {
+                        for ( size_t x = 1; x < xdim - 1; ++x ) {
 
-                            double curl = u_y_data[ ( x + 1 ) + y * fs::settings::xdim ] 
-                                          - u_y_data[ ( x - 1 ) + y * fs::settings::xdim ]
-                                          - u_x_data[ x + ( y + 1 ) * fs::settings::xdim ] 
-                                          + u_x_data[ x + ( y - 1 ) * fs::settings::xdim ];
+                            double curl = u_y_data[ ( x + 1 ) + y * xdim ]
+                                          - u_y_data[ ( x - 1 ) + y * xdim ]
+                                          - u_x_data[ x + ( y + 1 ) * xdim ]
+                                          + u_x_data[ x + ( y - 1 ) * xdim ];
 
-                            curl_data[ x + y * fs::settings::xdim ] = curl;
+                            curl_data[ x + y * xdim ] = curl;
                         }
                     }
-                }   
+                }
             );
         }
 
+        inline void calculate_curl_v_tbb( double* D2Q9_data, double* curl_data ) {
+
+            calculate_curl_v_tbb( D2Q9_view( D2Q9_data ), curl_data );
+        }
+
         template<typename DataStorage, typename View>
         std::tuple<double, sim::grid<std::vector<double>, property_view>>
         calculate_curl_with_max( const sim::grid<DataStorage, View>& gd, const std::vector<double>& property_states ) {
@@ -334,52 +357,63 @@ namespace fs {
             return std::make_tuple( max_property, std::move( property_grid ) );
         }
 
-        inline void calculate_property_v_with_max_tbb( double* D2Q9_data,
-                                                       double* property_data,
-                                                       double& max_property,
-                                                       std::function<double( std::span<double> )> calculate_property ) {
+        template<typename View> requires ( View::rank() == 3 )
+        void calculate_property_v_with_max_tbb( const View& D2Q9,
+                                                double* property_data,
+                                                double& max_property,
+                                                std::function<double( std::span<double> )> calculate_property ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
 
             tbb::combinable<double> local_max_property( []{ return -std::numeric_limits<double>::infinity(); } );
 
             tbb::parallel_for(
-                tbb::blocked_range<size_t>( 0, fs::settings::ydim ),
+                tbb::blocked_range<size_t>( 0, D2Q9.extent( 0 ) ),
                 [&]( const tbb::blocked_range<size_t>& range ) {
 
                     double& thread_max = local_max_property.local();
 
                     for ( size_t y = range.begin(); y < range.end(); ++y ) {
-    
-                        for ( size_t x = 0; x < fs::settings::xdim; ++x ) {
 
-                            const size_t offset = ( x + y * fs::settings::xdim ) * 9;
+                        for ( size_t x = 0; x < xdim; ++x ) {
 
-                            // non-owning view of cell's Q9
-                            std::span<double> cell_state( &D2Q9_data[ offset ], 9 );
+                            std::array<double, 9> cell_state = get_cell_state( D2Q9, y, x );
 
                             double property = calculate_property( cell_state );
 
                             thread_max = std::max( thread_max, property );
 
-                            property_data[ x + y * fs::settings::xdim ] = property;
+                            property_data[ x + y * xdim ] = property;
                         }
                     }
-                }   
+                }
             );
 
             max_property = local_max_property.combine( []( double a, double b ) { return std::max( a, b ); } );
         }
 
-        inline void calculate_property_v_with_min_max_tbb( double* D2Q9_data,
-                                                           double* property_data,
-                                                           double& min_property,
-                                                           double& max_property,
-                                                           std::function<double( const std::span<double> )> calculate_property ) {
+        inline void calculate_property_v_with_max_tbb( double* D2Q9_data,
+                                                       double* property_data,
+                                                       double& max_property,
+                                                       std::function<double( std::span<double> )> calculate_property ) {
+
+            calculate_property_v_with_max_tbb( D2Q9_view( D2Q9_data ), property_data, max_property, calculate_property );
+        }
+
+        template<typename View> requires ( View::rank() == 3 )
+        void calculate_property_v_with_min_max_tbb( const View& D2Q9,
+                                                    double* property_data,
+                                                    double& min_property,
+                                                    double& max_property,
+                                                    std::function<double( const std::span<double> )> calculate_property ) {
+
+            const size_t xdim = D2Q9.extent( 1 );
 
             tbb::combinable<double> local_min_property( []{ return std::numeric_limits<double>::infinity(); } );
             tbb::combinable<double> local_max_property( []{ return -std::numeric_limits<double>::infinity(); } );
-            
+
             tbb::parallel_for(
-                tbb::blocked_range<size_t>( 0, fs::settings::ydim ),
+                tbb::blocked_range<size_t>( 0, D2Q9.extent( 0 ) ),
                     [&]( const tbb::blocked_range<size_t>& range ) {
 
                     double& thread_min = local_min_property.local();
@@ -387,28 +421,34 @@ namespace fs {
 
                     for ( size_t y = range.begin(); y < range.end(); ++y ) {
 
-                        for ( size_t x = 0; x < fs::settings::xdim; ++x ) {
+                        for ( size_t x = 0; x < xdim; ++x ) {
 
-                            const size_t offset = ( x + y * fs::settings::xdim ) * 9;
-
-                            // non-owning view of cell's Q9
-                            std::span<double> cell_state( &D2Q9_data[ offset ], 9 );
+                            std::array<double, 9> cell_state = get_cell_state( D2Q9, y, x );
 
                             double property = calculate_property( cell_state );
 
                             thread_min = std::min( thread_min, property );
                             thread_max = std::max( thread_max, property );
 
-                            property_data[ x + y * fs::settings::xdim ] = property;
+                            property_data[ x + y * xdim ] = property;
                         }
                     }
-                }   
+                }
             );
 
             min_property = local_min_property.combine( []( double a, double b ) { return std::min( a, b ); } );
             max_property = local_max_property.combine( []( double a, double b ) { return std::max( a, b ); } );
         }
 
+        inline void calculate_property_v_with_min_max_tbb( double* D2Q9_data,
+                                                           double* property_data,
+                                                           double& min_property,
+                                                           double& max_property,
+                                                           std::function<double( const std::span<double> )> calculate_property ) {
+
+            calculate_property_v_with_min_max_tbb( D2Q9_view( D2Q9_data ), property_data, min_property, max_property, calculate_property );
+        }
+
     } // lbm
 
 } // fs
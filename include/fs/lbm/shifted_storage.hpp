@@ -0,0 +1,138 @@
+#ifndef LBM_SHIFTED_STORAGE_HPP
+#define LBM_SHIFTED_STORAGE_HPP
+
+#include <cstddef>
+
+#include <type_traits>
+
+#include <mdspan-stable/include/mdspan/mdspan.hpp>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+
+/*
+    reduced-precision storage of the distributions.
+
+    a distribution is stored as its difference from the weight of its direction, f - w[ q ], in a
+    narrower type ( float or 16-bit float ) and converted back to T when it is read, so the kernels
+    still do their arithmetic in T. close to the rest state f is w[ q ] plus a small correction,
+    subtracting w[ q ] leaves the whole mantissa for the correction instead of spending it on w[ q ].
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+#ifdef __FLT16_MAX__
+        // IEEE half precision, 10-bit mantissa
+        using float16 = _Float16;
+#endif
+
+        /*
+            a stored distribution converted to T and back. Storage other than T holds f - weight,
+            types narrower than float are converted through float, which the hardware converts to
+            and from 16-bit floats ( F16C ) where double isn't.
+        */
+        template<typename Storage>
+        [[gnu::always_inline]] inline T from_storage( const Storage stored, const T weight ) {
+
+            if constexpr ( std::is_same_v<Storage, T> )
+                return stored;
+            else if constexpr ( sizeof( Storage ) < sizeof( float ) )
+                return static_cast<T>( static_cast<float>( stored ) ) + weight;
+            else
+                return static_cast<T>( stored ) + weight;
+        }
+
+        template<typename Storage>
+        [[gnu::always_inline]] inline Storage to_storage( const T f, const T weight ) {
+
+            if constexpr ( std::is_same_v<Storage, T> )
+                return f;
+            else if constexpr ( sizeof( Storage ) < sizeof( float ) )
+                return static_cast<Storage>( static_cast<float>( f - weight ) );
+            else
+                return static_cast<Storage>( f - weight );
+        }
+
+        /*
+            stands in for a T& to a stored distribution, reading and writing convert between
+            f and f - w[ q ] with from_storage and to_storage
+        */
+        template<typename Storage>
+        class shifted_reference {
+
+        public:
+
+            shifted_reference( Storage& stored, const T weight ) : stored_( stored ), weight_( weight ) {}
+
+            operator T() const {
+
+                return from_storage( stored_, weight_ );
+            }
+
+            shifted_reference& operator=( const T f ) {
+
+                stored_ = to_storage<Storage>( f, weight_ );
+
+                return *this;
+            }
+
+            shifted_reference& operator=( const shifted_reference& other ) {
+
+                return *this = static_cast<T>( other );
+            }
+
+        private:
+
+            Storage& stored_;
+            const T weight_;
+        };
+
+        /*
+            view of a grid of shifted distributions, indexed like a D2Q9 view with f[ y, x, q ] so the
+            kernels work with it unchanged
+        */
+        template<typename Storage, typename Layout>
+        class shifted_view {
+
+        public:
+
+            using storage_view = Kokkos::mdspan<Storage, Kokkos::extents<size_t, Kokkos::dynamic_extent, Kokkos::dynamic_extent, 9>, Layout>;
+
+            shifted_view( Storage* data, const size_t ydim, const size_t xdim )
+                : view_( make_lattice_view<Layout>( data, ydim, xdim ) ) {}
+
+            static constexpr size_t rank() { return 3; }
+
+            size_t extent( const size_t r ) const { return view_.extent( r ); }
+
+            shifted_reference<Storage> operator[]( const size_t y, const size_t x, const size_t q ) const {
+
+                return { view_[ y, x, q ], w[ q ] };
+            }
+
+        private:
+
+            storage_view view_;
+        };
+
+        /*
+            view of a grid stored as Storage: a plain D2Q9 view when Storage is T, otherwise a view
+            of shifted distributions
+        */
+        template<typename Storage, typename Layout>
+        auto make_storage_view( Storage* data, const size_t ydim, const size_t xdim ) {
+
+            if constexpr ( std::is_same_v<Storage, T> )
+                return make_lattice_view<Layout>( data, ydim, xdim );
+            else
+                return shifted_view<Storage, Layout>( data, ydim, xdim );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
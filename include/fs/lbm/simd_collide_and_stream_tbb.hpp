@@ -0,0 +1,255 @@
+#ifndef LBM_SIMD_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_SIMD_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <cstddef>
+#include <cstring>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+
+/*
+    hand-vectorized version of the fused pull kernel ( see fused_collide_and_stream_tbb.hpp ) for
+    grids in layout_soa. a row of a direction is contiguous in that layout, so the distributions of
+    W neighbouring cells are loaded into one vector and W cells are updated per instruction:
+    ( 1 ) sse4_2:  2 cells
+    ( 2 ) avx2:    4 cells
+    ( 3 ) avx512:  8 cells
+    the instruction set is picked when the program starts from what the CPU supports, with the
+    scalar kernel as the fallback. every variant is compiled from the same template with GCC vector
+    extensions and only differs in the vector width and the target it is compiled for.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        enum class simd_isa {
+            scalar,
+            sse4_2,
+            avx2,
+            avx512
+        };
+
+        // widest instruction set supported by the CPU running the program
+        inline simd_isa detect_simd_isa() {
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+            __builtin_cpu_init();
+
+            if ( __builtin_cpu_supports( "avx512f" ) )
+                return simd_isa::avx512;
+
+            if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+                return simd_isa::avx2;
+
+            if ( __builtin_cpu_supports( "sse4.2" ) )
+                return simd_isa::sse4_2;
+#endif
+
+            return simd_isa::scalar;
+        }
+
+        inline simd_isa get_simd_isa() {
+
+            static const simd_isa isa = detect_simd_isa();
+
+            return isa;
+        }
+
+        inline bool simd_isa_supported( const simd_isa isa ) {
+
+            return isa <= get_simd_isa();
+        }
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+
+        // W doubles, the width is a template parameter so a typedef is needed for the attribute
+        template<size_t W>
+        struct simd_vector {
+            typedef T type __attribute__(( vector_size( W * sizeof( T ) ) ));
+        };
+
+        // unaligned loads and stores, vectors are passed by reference to keep the ABI of the caller's target
+        template<typename V>
+        [[gnu::always_inline]] inline void load_v( V& v, const T* p ) {
+
+            std::memcpy( &v, p, sizeof( V ) );
+        }
+
+        template<typename V>
+        [[gnu::always_inline]] inline void store_v( T* p, const V& v ) {
+
+            std::memcpy( p, &v, sizeof( V ) );
+        }
+
+        /*
+            rows [ y_begin, y_end ) of the fused kernel on W cells at a time. D2Q9 and D2Q9_n are
+            layout_soa grids, direction q of cell i is at q * vec_len + i.
+        */
+        template<size_t W, typename Collision = collision_BGK>
+        [[gnu::always_inline]] inline void fused_collide_and_stream_simd_rows( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                                                               const size_t y_begin, const size_t y_end,
+                                                                               const size_t ydim, const size_t xdim, const T omega ) {
+
+            using vec = typename simd_vector<W>::type;
+
+            const size_t vec_len = ydim * xdim;
+
+            // offset of the cell each direction is pulled from
+            const std::ptrdiff_t source[ 9 ] = {
+                0,
+                -1,
+                -static_cast<std::ptrdiff_t>( xdim ),
+                1,
+                static_cast<std::ptrdiff_t>( xdim ),
+                -static_cast<std::ptrdiff_t>( xdim ) - 1,
+                -static_cast<std::ptrdiff_t>( xdim ) + 1,
+                static_cast<std::ptrdiff_t>( xdim ) + 1,
+                static_cast<std::ptrdiff_t>( xdim ) - 1
+            };
+
+            for ( size_t y = y_begin; y < y_end; ++y ) {
+
+                for ( size_t x = 1; x < xdim - 1; x += W ) {
+
+                    // the last chunk of a row is moved back to overlap the previous one
+                    if ( x + W > xdim - 1 )
+                        x = xdim - 1 - W;
+
+                    const size_t i = x + y * xdim;
+
+                    vec f[ 9 ];
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        load_v( f[ q ], D2Q9 + q * vec_len + i + source[ q ] );
+
+                    bool near_obstacle = false;
+
+                    for ( size_t k = 0; k < W + 2; ++k )
+                        near_obstacle |= obstacle[ i - xdim - 1 + k ] | obstacle[ i - 1 + k ] | obstacle[ i + xdim - 1 + k ];
+
+                    if ( near_obstacle ) {
+
+                        for ( size_t q = 1; q < 9; ++q ) {
+
+                            vec solid{};
+
+                            for ( size_t k = 0; k < W; ++k )
+                                solid[ k ] = obstacle[ i + k + source[ q ] ];
+
+                            // half-way bounce-back where the distribution would come out of an obstacle
+                            vec reflected;
+
+                            load_v( reflected, D2Q9 + opposite_q[ q ] * vec_len + i );
+
+                            f[ q ] = solid != 0 ? reflected : f[ q ];
+                        }
+                    }
+
+                    Collision::collide( f, omega );
+
+                    for ( size_t q = 0; q < 9; ++q )
+                        store_v( D2Q9_n + q * vec_len + i, f[ q ] );
+
+                    if ( x == xdim - 1 - W )
+                        break;
+                }
+            }
+        }
+
+        template<typename Collision = collision_BGK>
+        __attribute__(( target( "sse4.2" ) ))
+        inline void fused_collide_and_stream_sse4_2_rows( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                                          const size_t y_begin, const size_t y_end,
+                                                          const size_t ydim, const size_t xdim, const T omega ) {
+
+            fused_collide_and_stream_simd_rows<2, Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, ydim, xdim, omega );
+        }
+
+        template<typename Collision = collision_BGK>
+        __attribute__(( target( "avx2,fma" ) ))
+        inline void fused_collide_and_stream_avx2_rows( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                                        const size_t y_begin, const size_t y_end,
+                                                        const size_t ydim, const size_t xdim, const T omega ) {
+
+            fused_collide_and_stream_simd_rows<4, Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, ydim, xdim, omega );
+        }
+
+        template<typename Collision = collision_BGK>
+        __attribute__(( target( "avx512f" ) ))
+        inline void fused_collide_and_stream_avx512_rows( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                                          const size_t y_begin, const size_t y_end,
+                                                          const size_t ydim, const size_t xdim, const T omega ) {
+
+            fused_collide_and_stream_simd_rows<8, Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, ydim, xdim, omega );
+        }
+
+#endif
+
+        /*
+            rows [ y_begin, y_end ) of the fused kernel on layout_soa grids with the given instruction
+            set, which must be supported by the CPU. grids too narrow for a whole vector use the
+            scalar kernel.
+        */
+        template<typename Collision = collision_BGK>
+        void fused_collide_and_stream_isa_rows( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                                       const size_t y_begin, const size_t y_end,
+                                                       const size_t ydim, const size_t xdim, const T omega,
+                                                       const simd_isa isa = get_simd_isa() ) {
+
+            switch ( xdim < 2 + 8 ? simd_isa::scalar : isa ) {
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+                case simd_isa::avx512:
+
+                    fused_collide_and_stream_avx512_rows<Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, ydim, xdim, omega );
+
+                    break;
+
+                case simd_isa::avx2:
+
+                    fused_collide_and_stream_avx2_rows<Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, ydim, xdim, omega );
+
+                    break;
+
+                case simd_isa::sse4_2:
+
+                    fused_collide_and_stream_sse4_2_rows<Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, ydim, xdim, omega );
+
+                    break;
+#endif
+
+                default:
+
+                    fused_collide_and_stream_rows<Collision>( make_lattice_view<layout_soa>( D2Q9, ydim, xdim ),
+                                                              make_lattice_view<layout_soa>( D2Q9_n, ydim, xdim ),
+                                                              obstacle, y_begin, y_end, omega );
+
+                    break;
+            }
+        }
+
+        // one time-step of the fused kernel on layout_soa grids with the given instruction set
+        template<typename Collision = collision_BGK>
+        void fused_collide_and_stream_simd_tbb( const T* D2Q9, T* D2Q9_n, const unsigned char* obstacle,
+                                                       const size_t ydim, const size_t xdim, const T omega,
+                                                       const simd_isa isa = get_simd_isa() ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 1, ydim - 1 ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    fused_collide_and_stream_isa_rows<Collision>( D2Q9, D2Q9_n, obstacle, r.begin(), r.end(), ydim, xdim, omega, isa );
+                }
+            );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,432 @@
+#ifndef LBM_SPARSE_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_SPARSE_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/initialize_grid.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
+/*
+    sparse lattice of square tiles that only stores the tiles with fluid in them.
+
+    the grid is cut into tile x tile blocks of cells and a block that is all obstacle isn't stored
+    or updated, so memory and time go with the number of tiles with fluid rather than the area of
+    the grid. within a stored tile the distributions are [ q ][ y ][ x ], the tiles are stored one
+    after another. the fused kernel ( see fused_collide_and_stream_tbb.hpp ) runs on it unchanged:
+    ( 1 ) a distribution pulled from inside the tile is read from the tile.
+    ( 2 ) one pulled across an edge of the tile is read from the neighbouring tile, found in a
+          table of the eight neighbours of every tile.
+    ( 3 ) one pulled from an obstacle cell, or from a tile that isn't stored, which is all obstacle,
+          is bounced back.
+    obstacle cells in stored tiles are skipped through the tile's part of the obstacle mask.
+    as with the fused kernel the lattice holds post-collision distributions and the edge-cells of
+    the grid are left untouched by it, they are written by the boundary conditions after each step
+    ( see boundary_conditions.hpp ) through a view of the lattice by grid cell.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        constexpr size_t sparse_tile = 16;
+        constexpr size_t sparse_tile_cells = sparse_tile * sparse_tile;
+
+        // no tile is stored there
+        constexpr size_t no_tile = std::numeric_limits<size_t>::max();
+
+        struct sparse_cs_state_tbb {
+
+            std::vector<T> D2Q9_a;
+            std::vector<T> D2Q9_b;
+
+            // current lattice
+            T* D2Q9;
+            // lattice being streamed into
+            T* D2Q9_n;
+
+            // obstacle mask of the stored tiles, cells past the edge of the grid count as obstacle
+            std::vector<unsigned char> obstacle;
+
+            // row and column of the first cell of each stored tile
+            std::vector<std::pair<size_t, size_t>> tile_origin;
+
+            /*
+                stored tile next to each stored tile, indexed by ( dy + 1 ) * 3 + ( dx + 1 ) for
+                the tile dy tiles down and dx tiles across, no_tile if it isn't stored
+            */
+            std::vector<std::array<size_t, 9>> neighbours;
+
+            // stored tile of each block of the grid, row-major, no_tile if it is all obstacle
+            std::vector<size_t> tile_index;
+
+            size_t ydim;
+            size_t xdim;
+            size_t tiles_y;
+            size_t tiles_x;
+
+            // non-obstacle cells, the ones that are updated apart from the edge-cells
+            size_t fluid_cells;
+
+            T viscosity;
+            T omega;
+
+            boundary_conditions boundaries;
+
+            sparse_cs_state_tbb() = default;
+
+            // D2Q9 and D2Q9_n point into the buffers, so the state can be moved but not copied
+            sparse_cs_state_tbb( const sparse_cs_state_tbb& ) = delete;
+            sparse_cs_state_tbb& operator=( const sparse_cs_state_tbb& ) = delete;
+
+            sparse_cs_state_tbb( sparse_cs_state_tbb&& ) = default;
+            sparse_cs_state_tbb& operator=( sparse_cs_state_tbb&& ) = default;
+
+            size_t tiles() const { return tile_origin.size(); }
+
+            // index of direction q of cell ( y, x ) of a tile, in tile coordinates
+            static size_t index( const size_t tile, const size_t y, const size_t x, const size_t q ) {
+
+                return ( tile * 9 + q ) * sparse_tile_cells + y * sparse_tile + x;
+            }
+
+            // stored tile and cell of cell ( y, x ) of the grid, tile is no_tile if it isn't stored
+            std::pair<size_t, size_t> locate( const size_t y, const size_t x ) const {
+
+                const size_t tile = tile_index[ ( y / sparse_tile ) * tiles_x + x / sparse_tile ];
+
+                return { tile, ( y % sparse_tile ) * sparse_tile + x % sparse_tile };
+            }
+        };
+
+        /*
+            stands in for a T& to a distribution of the sparse lattice, one of a tile that isn't stored
+            reads as 0 and drops what is written to it
+        */
+        class sparse_reference {
+
+        public:
+
+            explicit sparse_reference( T* stored ) : stored_( stored ) {}
+
+            operator T() const {
+
+                return stored_ ? *stored_ : 0.0;
+            }
+
+            sparse_reference& operator=( const T f ) {
+
+                if ( stored_ )
+                    *stored_ = f;
+
+                return *this;
+            }
+
+            sparse_reference& operator=( const sparse_reference& other ) {
+
+                return *this = static_cast<T>( other );
+            }
+
+        private:
+
+            T* stored_;
+        };
+
+        /*
+            a lattice of the state by cell ( y, x ) of the grid, for the boundary conditions. cells of
+            tiles that aren't stored, all obstacle, read as 0 and writes to them are dropped.
+        */
+        struct sparse_view {
+
+            const sparse_cs_state_tbb* cs;
+            T* D2Q9;
+
+            size_t extent( const size_t d ) const { return d == 0 ? cs->ydim : ( d == 1 ? cs->xdim : 9 ); }
+
+            sparse_reference operator[]( const size_t y, const size_t x, const size_t q ) const {
+
+                const auto [ tile, cell ] = cs->locate( y, x );
+
+                return sparse_reference( tile == no_tile ? nullptr : D2Q9 + ( tile * 9 + q ) * sparse_tile_cells + cell );
+            }
+        };
+
+        // the obstacle mask of the state by x + y * xdim, cells of tiles that aren't stored are obstacle
+        struct sparse_obstacle {
+
+            const sparse_cs_state_tbb* cs;
+
+            unsigned char operator[]( const size_t i ) const {
+
+                const auto [ tile, cell ] = cs->locate( i / cs->xdim, i % cs->xdim );
+
+                return tile == no_tile ? 1 : cs->obstacle[ tile * sparse_tile_cells + cell ];
+            }
+        };
+
+        /*
+            D2Q9 is a grid in the AoS layout of D2Q9_view, only the tiles with fluid in them are
+            copied into the lattice
+        */
+        inline sparse_cs_state_tbb init_sparse_cs_tbb( const T* D2Q9, const unsigned char* obstacle,
+                                                       const size_t ydim, const size_t xdim, const T viscosity ) {
+
+            sparse_cs_state_tbb cs;
+
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+            cs.tiles_y = ( ydim + sparse_tile - 1 ) / sparse_tile;
+            cs.tiles_x = ( xdim + sparse_tile - 1 ) / sparse_tile;
+
+            cs.viscosity = viscosity;
+            cs.omega = 1.0 / ( 3.0 * viscosity + 0.5 );
+
+            cs.boundaries = make_boundary_conditions();
+
+            cs.fluid_cells = 0;
+
+            cs.tile_index.assign( cs.tiles_y * cs.tiles_x, no_tile );
+
+            for ( size_t i = 0; i < cs.tiles_y; ++i ) {
+
+                for ( size_t j = 0; j < cs.tiles_x; ++j ) {
+
+                    size_t fluid = 0;
+
+                    for ( size_t y = i * sparse_tile; y < std::min( ( i + 1 ) * sparse_tile, ydim ); ++y )
+                        for ( size_t x = j * sparse_tile; x < std::min( ( j + 1 ) * sparse_tile, xdim ); ++x )
+                            fluid += !obstacle[ x + y * xdim ];
+
+                    if ( fluid == 0 )
+                        continue;
+
+                    cs.fluid_cells += fluid;
+
+                    cs.tile_index[ i * cs.tiles_x + j ] = cs.tiles();
+                    cs.tile_origin.push_back( { i * sparse_tile, j * sparse_tile } );
+                }
+            }
+
+            cs.neighbours.resize( cs.tiles() );
+
+            for ( size_t tile = 0; tile < cs.tiles(); ++tile ) {
+
+                const size_t i = cs.tile_origin[ tile ].first / sparse_tile;
+                const size_t j = cs.tile_origin[ tile ].second / sparse_tile;
+
+                for ( size_t dy = 0; dy < 3; ++dy ) {
+
+                    for ( size_t dx = 0; dx < 3; ++dx ) {
+
+                        // size_t wraps around for i + dy - 1, j + dx - 1 < 0
+                        const size_t i_n = i + dy - 1;
+                        const size_t j_n = j + dx - 1;
+
+                        cs.neighbours[ tile ][ dy * 3 + dx ] = ( i_n < cs.tiles_y && j_n < cs.tiles_x )
+                                                               ? cs.tile_index[ i_n * cs.tiles_x + j_n ] : no_tile;
+                    }
+                }
+            }
+
+            cs.obstacle.assign( cs.tiles() * sparse_tile_cells, 1 );
+            cs.D2Q9_a.assign( cs.tiles() * sparse_tile_cells * 9, 0.0 );
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, cs.tiles() ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t tile = r.begin(); tile < r.end(); ++tile ) {
+
+                        const auto [ y_0, x_0 ] = cs.tile_origin[ tile ];
+
+                        for ( size_t y = 0; y < sparse_tile && y_0 + y < ydim; ++y ) {
+
+                            for ( size_t x = 0; x < sparse_tile && x_0 + x < xdim; ++x ) {
+
+                                const size_t i = ( x_0 + x ) + ( y_0 + y ) * xdim;
+
+                                cs.obstacle[ tile * sparse_tile_cells + y * sparse_tile + x ] = obstacle[ i ];
+
+                                for ( size_t q = 0; q < 9; ++q )
+                                    cs.D2Q9_a[ sparse_cs_state_tbb::index( tile, y, x, q ) ] = D2Q9[ i * 9 + q ];
+                            }
+                        }
+                    }
+                }
+            );
+
+            // the edge-cells of both lattices hold the boundary values
+            cs.D2Q9_b = cs.D2Q9_a;
+
+            cs.D2Q9 = cs.D2Q9_a.data();
+            cs.D2Q9_n = cs.D2Q9_b.data();
+
+            return cs;
+        }
+
+        /*
+            fused collide and stream of the stored tiles [ tile_begin, tile_end )
+        */
+        template<typename Collision = collision_BGK>
+        void sparse_collide_and_stream_tiles( const sparse_cs_state_tbb& cs, const T* D2Q9, T* D2Q9_n,
+                                              const size_t tile_begin, const size_t tile_end ) {
+
+            constexpr std::ptrdiff_t n = sparse_tile;
+
+            for ( size_t tile = tile_begin; tile < tile_end; ++tile ) {
+
+                const auto [ y_0, x_0 ] = cs.tile_origin[ tile ];
+
+                const unsigned char* obstacle = cs.obstacle.data() + tile * sparse_tile_cells;
+
+                const T* D2Q9_t = D2Q9 + tile * 9 * sparse_tile_cells;
+
+                // edge-cells and cells past the edge of the grid are left untouched
+                const size_t y_begin = y_0 == 0 ? 1 : 0;
+                const size_t x_begin = x_0 == 0 ? 1 : 0;
+                const size_t y_end = std::min( sparse_tile, cs.ydim - 1 - y_0 );
+                const size_t x_end = std::min( sparse_tile, cs.xdim - 1 - x_0 );
+
+                for ( size_t y = y_begin; y < y_end; ++y ) {
+
+                    for ( size_t x = x_begin; x < x_end; ++x ) {
+
+                        const size_t cell = y * sparse_tile + x;
+
+                        if ( obstacle[ cell ] )
+                            continue;
+
+                        T f[ 9 ];
+
+                        if ( y > 0 && y < sparse_tile - 1 && x > 0 && x < sparse_tile - 1 ) {
+
+                            // all the neighbours are in the tile
+                            for ( size_t q = 0; q < 9; ++q )
+                                f[ q ] = D2Q9_t[ q * sparse_tile_cells + cell - e[ q ].second * n - e[ q ].first ];
+
+                            const bool near_obstacle = obstacle[ cell - n - 1 ] | obstacle[ cell - n ] | obstacle[ cell - n + 1 ] |
+                                                       obstacle[ cell - 1 ] | obstacle[ cell + 1 ] |
+                                                       obstacle[ cell + n - 1 ] | obstacle[ cell + n ] | obstacle[ cell + n + 1 ];
+
+                            if ( near_obstacle ) {
+
+                                for ( size_t q = 1; q < 9; ++q ) {
+
+                                    // half-way bounce-back
+                                    if ( obstacle[ cell - e[ q ].second * n - e[ q ].first ] )
+                                        f[ q ] = D2Q9_t[ opposite_q[ q ] * sparse_tile_cells + cell ];
+                                }
+                            }
+
+                        } else {
+
+                            f[ 0 ] = D2Q9_t[ cell ];
+
+                            for ( size_t q = 1; q < 9; ++q ) {
+
+                                // neighbour the distribution streams in from, in the coordinates of this tile
+                                std::ptrdiff_t y_s = static_cast<std::ptrdiff_t>( y ) - e[ q ].second;
+                                std::ptrdiff_t x_s = static_cast<std::ptrdiff_t>( x ) - e[ q ].first;
+
+                                const std::ptrdiff_t dy = y_s < 0 ? -1 : ( y_s >= n ? 1 : 0 );
+                                const std::ptrdiff_t dx = x_s < 0 ? -1 : ( x_s >= n ? 1 : 0 );
+
+                                const size_t source = cs.neighbours[ tile ][ ( dy + 1 ) * 3 + ( dx + 1 ) ];
+
+                                y_s -= dy * n;
+                                x_s -= dx * n;
+
+                                // half-way bounce-back from obstacle cells and tiles that are all obstacle
+                                if ( source == no_tile || cs.obstacle[ source * sparse_tile_cells + y_s * n + x_s ] )
+                                    f[ q ] = D2Q9_t[ opposite_q[ q ] * sparse_tile_cells + cell ];
+                                else
+                                    f[ q ] = D2Q9[ sparse_cs_state_tbb::index( source, y_s, x_s, q ) ];
+                            }
+                        }
+
+                        Collision::collide( f, cs.omega );
+
+                        for ( size_t q = 0; q < 9; ++q )
+                            D2Q9_n[ ( tile * 9 + q ) * sparse_tile_cells + cell ] = f[ q ];
+                    }
+                }
+            }
+        }
+
+        /*
+            set the edge-cells of both lattices to the equilibrium of the boundary conditions,
+            edge-cells in tiles that aren't stored are obstacle
+        */
+        inline void set_grid_boundaries( sparse_cs_state_tbb& cs ) {
+
+            for ( T* D2Q9 : { cs.D2Q9, cs.D2Q9_n } )
+                set_edge_cells( sparse_view{ &cs, D2Q9 }, cs.boundaries );
+        }
+
+        /*
+            switch boundary conditions, which resets the edge-cells to the new equilibrium
+        */
+        inline void set_boundary_conditions( sparse_cs_state_tbb& cs, const boundary_conditions& bc ) {
+
+            cs.boundaries = bc;
+
+            set_grid_boundaries( cs );
+        }
+
+        template<typename Collision = collision_BGK>
+        void stateful_collide_and_stream_tbb( sparse_cs_state_tbb& cs, const size_t steps ) {
+
+            for ( size_t z = 0; z < steps; ++z ) {
+
+                tbb::parallel_for( tbb::blocked_range<size_t>( 0, cs.tiles() ),
+                    [&]( const tbb::blocked_range<size_t>& r ) {
+
+                        sparse_collide_and_stream_tiles<Collision>( cs, cs.D2Q9, cs.D2Q9_n, r.begin(), r.end() );
+                    }
+                );
+
+                apply_boundary_conditions<Collision>( sparse_view{ &cs, cs.D2Q9 }, sparse_view{ &cs, cs.D2Q9_n },
+                                                      sparse_obstacle{ &cs }, cs.boundaries, cs.omega, true );
+
+                std::swap( cs.D2Q9, cs.D2Q9_n );
+            }
+        }
+
+        /*
+            copy the stored tiles into D2Q9 in the AoS layout of D2Q9_view, cells of the tiles that
+            aren't stored are left as they are
+        */
+        inline void export_D2Q9( const sparse_cs_state_tbb& cs, T* D2Q9 ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, cs.tiles() ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t tile = r.begin(); tile < r.end(); ++tile ) {
+
+                        const auto [ y_0, x_0 ] = cs.tile_origin[ tile ];
+
+                        for ( size_t y = 0; y < sparse_tile && y_0 + y < cs.ydim; ++y )
+                            for ( size_t x = 0; x < sparse_tile && x_0 + x < cs.xdim; ++x )
+                                for ( size_t q = 0; q < 9; ++q )
+                                    D2Q9[ ( ( x_0 + x ) + ( y_0 + y ) * cs.xdim ) * 9 + q ] =
+                                        cs.D2Q9[ sparse_cs_state_tbb::index( tile, y, x, q ) ];
+                    }
+                }
+            );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef LBM_STATEFUL_COLLIDE_AND_STREAM_3D_TBB_HPP
+#define LBM_STATEFUL_COLLIDE_AND_STREAM_3D_TBB_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/lattice.hpp>
+#include <fs/lbm/numa_tbb.hpp>
+#include <fs/lbm/shifted_storage.hpp>
+
+/*
+    3D engine for the D3Q19 and D3Q27 lattices ( see lattice.hpp ).
+
+    ( 1 ) layout: the grid is stored a z-plane at a time, and within a plane as in layout_soa, so
+          direction q of cell ( z, y, x ) is at ( z * Q + q ) * stride + y * xdim + x. a slab of
+          planes is one contiguous block with all of its directions, so the slab a thread updates
+          is first written by and stays local to that thread ( see numa_tbb.hpp ). stride is the
+          plane padded so the Q planes a cell reads don't all map to the same cache sets when the
+          plane is a multiple of 4 KiB.
+    ( 2 ) sweep: the fused pull kernel, a cell pulls the post-collision distributions of its
+          neighbours, bounces back from obstacle voxels, collides and writes the other buffer.
+    ( 3 ) tiling: a cell reads the planes either side of it, so a whole-plane sweep has three
+          planes of every direction in flight. the slab is instead swept in tiles of rows: all the
+          planes of the slab for rows [ y, y + tile_ydim ), then the next rows, which keeps the
+          three planes of a tile in L2 while it moves along z.
+    ( 4 ) storage: Storage narrower than T stores f - w[ q ] ( see shifted_storage.hpp ), float
+          halves the footprint of the two buffers, which is about 2 * Q * cells * sizeof( Storage ).
+    as in 2D the edge-cells aren't updated and hold the boundary values.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        // the three planes of a tile of the sweep are kept to this many bytes
+        constexpr size_t tile_3D_bytes = size_t( 1 ) << 20;
+
+        // plane of "plane" elements padded to a whole number of cache lines that isn't a multiple of 4 KiB
+        template<typename Storage>
+        size_t get_plane_stride( const size_t plane ) {
+
+            constexpr size_t line = 64 / sizeof( Storage );
+
+            size_t stride = ( plane + line - 1 ) / line * line;
+
+            if ( stride * sizeof( Storage ) % 4096 == 0 )
+                stride += line;
+
+            return stride;
+        }
+
+        template<typename L = lattice_D3Q19, typename Storage = T>
+        struct cs_state_3D_tbb {
+
+            static_assert( L::D == 3 );
+
+            using lattice_type = L;
+            using storage_type = Storage;
+
+            numa_vector<Storage> f_a;
+            numa_vector<Storage> f_b;
+
+            // current grid
+            Storage* f;
+            // grid being streamed into
+            Storage* f_n;
+
+            // voxel obstacle mask, cell i = x + xdim * ( y + ydim * z )
+            std::vector<unsigned char> obstacle;
+
+            size_t zdim;
+            size_t ydim;
+            size_t xdim;
+
+            // cells in a z-plane
+            size_t plane;
+            size_t cells;
+
+            // elements between the planes of consecutive directions in a buffer
+            size_t stride;
+
+            T viscosity;
+            T omega;
+
+            size_t tile_ydim;
+
+            // a task_arena per NUMA node and the planes each one owns
+            numa_partition numa;
+
+            cs_state_3D_tbb() = default;
+
+            // f and f_n point into the buffers, so the state can be moved but not copied
+            cs_state_3D_tbb( const cs_state_3D_tbb& ) = delete;
+            cs_state_3D_tbb& operator=( const cs_state_3D_tbb& ) = delete;
+
+            cs_state_3D_tbb( cs_state_3D_tbb&& ) = default;
+            cs_state_3D_tbb& operator=( cs_state_3D_tbb&& ) = default;
+
+            // position of direction q of cell ( z, y, x ) in a buffer
+            size_t index( const size_t z, const size_t y, const size_t x, const size_t q ) const {
+
+                return ( z * L::Q + q ) * stride + y * xdim + x;
+            }
+        };
+
+        /*
+            the fused kernel on planes [ z_begin, z_end ) of the interior, in tiles of tile_ydim rows
+        */
+        template<typename L, typename Storage>
+        void collide_and_stream_3D_slab( const Storage* f, Storage* f_n, const unsigned char* obstacle,
+                                         const size_t ydim, const size_t xdim, const size_t stride,
+                                         const size_t z_begin, const size_t z_end,
+                                         const size_t tile_ydim, const T omega ) {
+
+            const std::ptrdiff_t plane = static_cast<std::ptrdiff_t>( ydim * xdim );
+            const std::ptrdiff_t row = static_cast<std::ptrdiff_t>( xdim );
+            const std::ptrdiff_t stride_q = static_cast<std::ptrdiff_t>( stride );
+
+            // offset of the cell each direction streams in from, within a plane of the mask
+            std::array<std::ptrdiff_t, L::Q> source{};
+
+            // the same in a buffer, where each plane holds every direction
+            std::array<std::ptrdiff_t, L::Q> source_f{};
+
+            unroll<L::Q>( [&]( auto q ) {
+
+                const std::ptrdiff_t in_plane = -L::c[ q ][ 1 ] * row - L::c[ q ][ 0 ];
+
+                source[ q ] = in_plane - L::c[ q ][ 2 ] * plane;
+                source_f[ q ] = in_plane - L::c[ q ][ 2 ] * stride_q * static_cast<std::ptrdiff_t>( L::Q ) + q * stride_q;
+            } );
+
+            for ( size_t y_tile = 1; y_tile < ydim - 1; y_tile += tile_ydim ) {
+
+                const size_t y_end = std::min( y_tile + tile_ydim, ydim - 1 );
+
+                for ( size_t z = z_begin; z < z_end; ++z ) {
+                    for ( size_t y = y_tile; y < y_end; ++y ) {
+
+                        const unsigned char* obstacle_row = obstacle + z * plane + y * row;
+
+                        const Storage* f_row = f + z * L::Q * stride_q + y * row;
+                        Storage* f_n_row = f_n + z * L::Q * stride_q + y * row;
+
+                        // the rows each direction streams in from
+                        const unsigned char* obstacle_source[ L::Q ];
+                        const Storage* f_source[ L::Q ];
+
+                        for ( size_t q = 0; q < L::Q; ++q ) {
+
+                            obstacle_source[ q ] = obstacle_row + source[ q ];
+                            f_source[ q ] = f_row + source_f[ q ];
+                        }
+
+                        for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                            if ( obstacle_row[ x ] )
+                                continue;
+
+                            T f_i[ L::Q ];
+
+                            unroll<L::Q>( [&]( auto q ) {
+
+                                constexpr size_t o = L::opposite[ q ];
+
+                                if constexpr ( q == 0 )
+                                    f_i[ q ] = from_storage( f_row[ x ], L::w[ q ] );
+                                else if ( obstacle_source[ q ][ x ] )
+                                    // half-way bounce-back from an obstacle voxel
+                                    f_i[ q ] = from_storage( f_row[ o * stride_q + x ], L::w[ o ] );
+                                else
+                                    f_i[ q ] = from_storage( f_source[ q ][ x ], L::w[ q ] );
+                            } );
+
+                            lattice_collide_BGK<L>( f_i, omega );
+
+                            unroll<L::Q>( [&]( auto q ) { f_n_row[ q * stride_q + x ] = to_storage<Storage>( f_i[ q ], L::w[ q ] ); } );
+                        }
+                    }
+                }
+            }
+        }
+
+        template<typename L, typename Storage>
+        void set_viscosity( cs_state_3D_tbb<L, Storage>& cs, const T viscosity ) {
+
+            cs.viscosity = viscosity;
+            cs.omega = 1.0 / ( viscosity / L::c_s2 + 0.5 );
+        }
+
+        /*
+            set every cell of both buffers to the equilibrium with density rho and velocity u, each
+            slab written first by the node that updates it: split as the interior planes the kernel
+            updates, with the edge planes added to the first and last slabs
+        */
+        template<typename L, typename Storage>
+        void set_equilibrium( cs_state_3D_tbb<L, Storage>& cs, const T rho, const std::array<T, 3>& u ) {
+
+            T f_eq[ L::Q ];
+
+            lattice_f_eq<L>( f_eq, rho, u );
+
+            cs.numa.parallel_grid_rows( cs.zdim,
+                [&]( const size_t z_begin, const size_t z_end ) {
+
+                    for ( Storage* f : { cs.f, cs.f_n } )
+                        for ( size_t z = z_begin; z < z_end; ++z )
+                            for ( size_t q = 0; q < L::Q; ++q )
+                                std::fill_n( f + cs.index( z, 0, 0, q ), cs.plane, to_storage<Storage>( f_eq[ q ], L::w[ q ] ) );
+                }
+            );
+        }
+
+        /*
+            set every cell of both buffers to the boundary values, flow at 0.1 along x as in 2D.
+            only the edge-cells keep them, the interior evolves from there.
+        */
+        template<typename L, typename Storage>
+        void set_grid_boundaries( cs_state_3D_tbb<L, Storage>& cs ) {
+
+            set_equilibrium( cs, 1.0, { 0.1, 0.0, 0.0 } );
+        }
+
+        /*
+            the engine for a voxel obstacle mask of zdim * ydim * xdim cells, starting from the
+            boundary equilibrium everywhere
+        */
+        template<typename L = lattice_D3Q19, typename Storage = T>
+        cs_state_3D_tbb<L, Storage> init_cs_3D_tbb( const unsigned char* obstacle,
+                                                    const size_t zdim, const size_t ydim, const size_t xdim,
+                                                    const T viscosity, const size_t tile_ydim = 0 ) {
+
+            cs_state_3D_tbb<L, Storage> cs;
+
+            cs.zdim = zdim;
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+            cs.plane = ydim * xdim;
+            cs.cells = zdim * cs.plane;
+            cs.stride = get_plane_stride<Storage>( cs.plane );
+
+            // by default as many rows as fit tile_3D_bytes
+            cs.tile_ydim = tile_ydim ? tile_ydim : std::max<size_t>( 1, tile_3D_bytes / ( 3 * L::Q * xdim * sizeof( Storage ) ) );
+
+            cs.obstacle.assign( obstacle, obstacle + cs.cells );
+
+            set_viscosity( cs, viscosity );
+
+            // allocated without being written, set_equilibrium places the pages
+            cs.f_a.resize( zdim * L::Q * cs.stride );
+            cs.f_b.resize( zdim * L::Q * cs.stride );
+
+            cs.f = cs.f_a.data();
+            cs.f_n = cs.f_b.data();
+
+            set_grid_boundaries( cs );
+
+            return cs;
+        }
+
+        template<typename L, typename Storage>
+        void stateful_collide_and_stream_tbb( cs_state_3D_tbb<L, Storage>& cs, const size_t steps ) {
+
+            for ( size_t s = 0; s < steps; ++s ) {
+
+                cs.numa.parallel_rows( 1, cs.zdim - 1,
+                    [&]( const size_t z_begin, const size_t z_end ) {
+
+                        collide_and_stream_3D_slab<L>( cs.f, cs.f_n, cs.obstacle.data(), cs.ydim, cs.xdim, cs.stride,
+                                                       z_begin, z_end, cs.tile_ydim, cs.omega );
+                    }
+                );
+
+                std::swap( cs.f, cs.f_n );
+            }
+        }
+
+        // million lattice-cell updates per second over "steps" time-steps
+        template<typename L, typename Storage>
+        double benchmark_cs( cs_state_3D_tbb<L, Storage>& cs, const size_t steps ) {
+
+            auto start = std::chrono::steady_clock::now();
+
+            stateful_collide_and_stream_tbb( cs, steps );
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            return static_cast<double>( cs.cells ) * steps / elapsed.count() / 1e6;
+        }
+
+        /*
+            copy the current distributions into f as T, direction q of cell i at q * cells + i,
+            the layout of lattice_collide_and_stream_tbb
+        */
+        template<typename L, typename Storage>
+        void export_distributions( const cs_state_3D_tbb<L, Storage>& cs, T* f ) {
+
+            for ( size_t z = 0; z < cs.zdim; ++z )
+                for ( size_t q = 0; q < L::Q; ++q )
+                    for ( size_t i = 0; i < cs.plane; ++i )
+                        f[ q * cs.cells + z * cs.plane + i ] = from_storage( cs.f[ cs.index( z, 0, 0, q ) + i ], L::w[ q ] );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,570 @@
+#ifndef LBM_STATEFUL_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_STATEFUL_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <grid.hpp>
+
+#include <settings.hpp>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/initialize_grid.hpp>
+#include <fs/lbm/collide_and_stream_tbb.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+#include <fs/lbm/aa_collide_and_stream_tbb.hpp>
+#include <fs/lbm/simd_collide_and_stream_tbb.hpp>
+#include <fs/lbm/blocked_collide_and_stream_tbb.hpp>
+#include <fs/lbm/shifted_storage.hpp>
+#include <fs/lbm/numa_tbb.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            kernel used to advance the simulation:
+            ( 1 ) split: separate collide, stream and bounce-back sweeps, as in collide_and_stream_tbb.
+                  the grid holds pre-collision distributions.
+            ( 2 ) fused: a single pull sweep with inline bounce-back.
+                  the grid holds post-collision distributions.
+            ( 3 ) aa: in-place AA-pattern streaming on a single grid, see aa_collide_and_stream_tbb.hpp.
+                  the grid holds pre-collision distributions after an even number of steps.
+            ( 4 ) simd: the fused kernel vectorized for the CPU's instruction set, see
+                  simd_collide_and_stream_tbb.hpp. it needs layout_soa and T storage.
+            ( 5 ) blocked: the fused kernel run several steps at a time on cache-sized tiles, see
+                  blocked_collide_and_stream_tbb.hpp. same result as fused.
+            density and velocity are the same either way since collision conserves them.
+            the aa kernel keeps the edge-cells at their equilibrium and the blocked kernel runs several
+            steps between boundary updates, so both only take equilibrium boundary conditions. the
+            others apply them every step, see boundary_conditions.hpp.
+        */
+        enum class cs_kernel {
+            split,
+            fused,
+            aa,
+            simd,
+            blocked
+        };
+
+        /*
+            copy rows [ y_begin, y_end ) between views of the same dimensions, e.g. to change the layout
+        */
+        template<typename View, typename View_d>
+        void copy_D2Q9_rows( const View& src, const View_d& dst, const size_t y_begin, const size_t y_end ) {
+
+            const size_t xdim = src.extent( 1 );
+
+            for ( size_t y = y_begin; y < y_end; ++y )
+                for ( size_t x = 0; x < xdim; ++x )
+                    for ( size_t q = 0; q < 9; ++q )
+                        dst[ y, x, q ] = src[ y, x, q ];
+        }
+
+        template<typename View, typename View_d>
+        void copy_D2Q9( const View& src, const View_d& dst ) {
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, src.extent( 0 ) ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    copy_D2Q9_rows( src, dst, r.begin(), r.end() );
+                }
+            );
+        }
+
+        /*
+            this is a handle to the state of the simulation on the CPU, the counterpart of
+            fs::dpcxx::lbm::cs_state. the state owns both ping-pong buffers and the obstacle mask so
+            advancing the simulation doesn't allocate or copy the grid on every call.
+            the aa kernel only needs the one buffer, D2Q9_b is left empty and D2Q9_n null.
+
+            Layout is the memory layout of the buffers, see layout.hpp. the kernels are the same
+            for every layout, so it can be chosen per machine.
+            Storage is the type the distributions are stored as. anything narrower than T stores
+            them shifted by their weights, see shifted_storage.hpp. the arithmetic is done in T.
+            Collision is the collision operator every kernel uses, see collision.hpp.
+
+            the buffers are first written and updated through the same NUMA partition of the
+            interior rows, see numa_tbb.hpp.
+        */
+        template<typename Layout = layout_aos, typename Storage = T, typename Collision = collision_BGK>
+        struct cs_state_tbb {
+
+            using layout_type = Layout;
+            using storage_type = Storage;
+            using collision_type = Collision;
+            using view_type = decltype( make_storage_view<Storage, Layout>( nullptr, 0, 0 ) );
+
+            numa_vector<Storage> D2Q9_a;
+            numa_vector<Storage> D2Q9_b;
+
+            // current grid
+            Storage* D2Q9;
+            // grid being streamed into
+            Storage* D2Q9_n;
+
+            std::vector<unsigned char> obstacle;
+
+            // split kernel: the obstacle compiled into fluid-obstacle links for bounce-back
+            std::vector<boundary_link> links;
+
+            size_t ydim;
+            size_t xdim;
+            size_t vec_len;
+
+            // elements in each buffer, at least vec_len * 9 depending on the layout
+            size_t span_size;
+
+            T viscosity;
+            T omega;
+
+            cs_kernel kernel;
+
+            boundary_conditions boundaries;
+
+            // aa kernel: 1 when the grid is half-way through a pair of steps
+            size_t parity;
+
+            // aa kernel: boundary values of the edge-cells, which the odd step overwrites
+            std::vector<size_t> edge_cells;
+            std::vector<T> edge_states;
+
+            // a task_arena per NUMA node and the rows each one owns
+            numa_partition numa;
+
+            cs_state_tbb() = default;
+
+            // D2Q9 and D2Q9_n point into the buffers, so the state can be moved but not copied
+            cs_state_tbb( const cs_state_tbb& ) = delete;
+            cs_state_tbb& operator=( const cs_state_tbb& ) = delete;
+
+            cs_state_tbb( cs_state_tbb&& ) = default;
+            cs_state_tbb& operator=( cs_state_tbb&& ) = default;
+
+            view_type view( Storage* D2Q9_data ) const {
+
+                return make_storage_view<Storage, Layout>( D2Q9_data, ydim, xdim );
+            }
+
+            // the stored values, without converting them to T
+            auto storage_view( Storage* D2Q9_data ) const {
+
+                return make_lattice_view<Layout>( D2Q9_data, ydim, xdim );
+            }
+        };
+
+        /*
+            the aa and blocked kernels have no step to apply boundary conditions in, throws
+            std::invalid_argument unless they're equilibrium
+        */
+        inline void expect_boundary_conditions( const cs_kernel kernel, const boundary_conditions& bc ) {
+
+            if ( kernel == cs_kernel::aa && !bc.equilibrium() )
+                throw std::invalid_argument( "the aa kernel only takes equilibrium boundary conditions" );
+
+            if ( kernel == cs_kernel::blocked && !bc.equilibrium() )
+                throw std::invalid_argument( "the blocked kernel only takes equilibrium boundary conditions" );
+        }
+
+        /*
+            the aa kernel leaves the grid in a swapped layout after an odd number of steps, throws
+            std::logic_error rather than let it be read then
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        void expect_readable( const cs_state_tbb<Layout, Storage, Collision>& cs ) {
+
+            if ( cs.parity != 0 )
+                throw std::logic_error( "the aa grid is only readable after an even number of steps" );
+        }
+
+        template<typename Layout, typename Storage, typename Collision>
+        void set_viscosity( cs_state_tbb<Layout, Storage, Collision>& cs, const T viscosity ) {
+
+            cs.viscosity = viscosity;
+            cs.omega = 1.0 / ( 3.0 * viscosity + 0.5 );
+        }
+
+        /*
+            switch kernels between calls. switching from split to fused skips one collision since the
+            two kernels leave the grid in different states, see cs_kernel. switching away from aa
+            allocates the second buffer and can only be done after an even number of aa steps.
+            switching to aa or blocked throws std::invalid_argument unless the boundary conditions are
+            equilibrium, and switching to simd unless the state is layout_soa with T storage.
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        void set_kernel( cs_state_tbb<Layout, Storage, Collision>& cs, const cs_kernel kernel ) {
+
+            expect_readable( cs );
+
+            expect_boundary_conditions( kernel, cs.boundaries );
+
+            if ( kernel == cs_kernel::simd && !( std::is_same_v<Layout, layout_soa> && std::is_same_v<Storage, T> ) )
+                throw std::invalid_argument( "the simd kernel needs layout_soa and T storage" );
+
+            if ( kernel != cs_kernel::aa && cs.D2Q9_n == nullptr ) {
+
+                cs.D2Q9_b.resize( cs.span_size );
+                cs.D2Q9_n = cs.D2Q9_b.data();
+
+                cs.numa.parallel_grid_rows( cs.ydim,
+                    [&]( const size_t y_begin, const size_t y_end ) {
+
+                        copy_D2Q9_rows( cs.storage_view( cs.D2Q9 ), cs.storage_view( cs.D2Q9_n ), y_begin, y_end );
+                    }
+                );
+            }
+
+            if ( kernel == cs_kernel::aa ) {
+
+                cs.edge_cells = get_edge_cells( cs.ydim, cs.xdim );
+
+                save_edge_cells( cs.view( cs.D2Q9 ), cs.edge_cells, cs.edge_states );
+            }
+
+            cs.kernel = kernel;
+        }
+
+        template<typename Layout, typename Storage, typename Collision>
+        void set_obstacle( cs_state_tbb<Layout, Storage, Collision>& cs, const unsigned char* obstacle ) {
+
+            std::memcpy( cs.obstacle.data(), obstacle, cs.vec_len * sizeof( unsigned char ) );
+
+            cs.links = get_boundary_links( obstacle, cs.ydim, cs.xdim );
+        }
+
+        /*
+            D2Q9 is a grid in the AoS layout of D2Q9_view, it is converted to the state's layout
+        */
+        template<typename Layout = layout_aos, typename Storage = T, typename Collision = collision_BGK>
+        cs_state_tbb<Layout, Storage, Collision> init_cs_tbb( const T* D2Q9, const unsigned char* obstacle,
+                                                              const size_t ydim, const size_t xdim, const T viscosity,
+                                                              const cs_kernel kernel = cs_kernel::split ) {
+
+            cs_state_tbb<Layout, Storage, Collision> cs;
+
+            cs.parity = 0;
+
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+            cs.vec_len = ydim * xdim;
+            cs.span_size = lattice_span_size<Layout>( ydim, xdim );
+
+            set_viscosity( cs, viscosity );
+
+            // the only full-grid copies the state makes, written first by the node that owns the rows
+            cs.D2Q9_a.resize( cs.span_size );
+
+            cs.D2Q9 = cs.D2Q9_a.data();
+            cs.D2Q9_n = nullptr;
+
+            cs.numa.parallel_grid_rows( ydim,
+                [&]( const size_t y_begin, const size_t y_end ) {
+
+                    copy_D2Q9_rows( make_lattice_view<layout_aos>( D2Q9, ydim, xdim ), cs.view( cs.D2Q9 ), y_begin, y_end );
+                }
+            );
+
+            cs.obstacle.resize( cs.vec_len );
+
+            set_obstacle( cs, obstacle );
+
+            cs.boundaries = make_boundary_conditions();
+
+            // allocates the second buffer unless the kernel streams in place
+            set_kernel( cs, kernel );
+
+            return cs;
+        }
+
+        template<typename Layout = layout_aos, typename Storage = T, typename Collision = collision_BGK,
+                 typename DataStorage, typename View>
+        cs_state_tbb<Layout, Storage, Collision> init_cs_tbb( sim::grid<DataStorage, View>& gd, std::vector<unsigned char>& obstacle, const T viscosity,
+                                                              const cs_kernel kernel = cs_kernel::split ) {
+
+            return init_cs_tbb<Layout, Storage, Collision>( gd.get_data_handle(), obstacle.data(), gd.get_dim( 0 ), gd.get_dim( 1 ), viscosity, kernel );
+        }
+
+        /*
+            set the edge-cells of both buffers so the cells the stream step leaves untouched hold
+            the boundary values whichever buffer is current
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        void set_grid_boundaries( cs_state_tbb<Layout, Storage, Collision>& cs ) {
+
+            for ( Storage* D2Q9_data : { cs.D2Q9, cs.D2Q9_n } ) {
+
+                if ( D2Q9_data == nullptr )
+                    continue;
+
+                set_edge_cells( cs.view( D2Q9_data ), cs.boundaries );
+            }
+
+            // between steps the aa kernel keeps the edge-cells in the natural layout
+            if ( cs.kernel == cs_kernel::aa )
+                save_edge_cells( cs.view( cs.D2Q9 ), cs.edge_cells, cs.edge_states );
+        }
+
+        /*
+            switch boundary conditions, which resets the edge-cells to the new equilibrium. the aa and
+            blocked kernels have no step to apply the others in, they throw std::invalid_argument
+            unless bc.equilibrium(), switch to another kernel first.
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        void set_boundary_conditions( cs_state_tbb<Layout, Storage, Collision>& cs, const boundary_conditions& bc ) {
+
+            expect_boundary_conditions( cs.kernel, bc );
+
+            cs.boundaries = bc;
+
+            set_grid_boundaries( cs );
+        }
+
+        // the density and velocity of the current grid, see macroscopic.hpp
+        template<typename Layout, typename Storage, typename Collision>
+        void calculate_macroscopic( cs_state_tbb<Layout, Storage, Collision>& cs, const macroscopic_fields& fields ) {
+
+            expect_readable( cs );
+
+            cs.numa.parallel_grid_rows( cs.ydim,
+                [&]( const size_t y_begin, const size_t y_end ) {
+
+                    calculate_macroscopic_rows( cs.view( cs.D2Q9 ), fields, y_begin, y_end );
+                }
+            );
+        }
+
+        /*
+            advance the simulation by "steps" time-steps with the state's kernel. the result is left in
+            the current grid, which is only swapped, never copied. with the aa kernel "steps" should be
+            even for the grid to be readable afterwards.
+            the density and velocity after the last step are stored in "fields" if it has any. the
+            fused kernel stores them as it updates the cells, the others read the grid once more.
+            with the aa kernel that throws std::logic_error, before any step, if the grid wouldn't be
+            readable after the last one.
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        void stateful_collide_and_stream_tbb( cs_state_tbb<Layout, Storage, Collision>& cs, const size_t steps,
+                                              const macroscopic_fields& fields = {} ) {
+
+            if ( fields && cs.kernel == cs_kernel::aa && ( cs.parity + steps ) % 2 != 0 )
+                throw std::logic_error( "the aa grid is only readable after an even number of steps" );
+
+            const unsigned char* obstacle = cs.obstacle.data();
+
+            const cs_kernel kernel = cs.kernel;
+
+            if ( kernel == cs_kernel::blocked ) {
+
+                for ( size_t z = 0; z < steps; z += blocked_steps ) {
+
+                    const size_t pass = std::min( blocked_steps, steps - z );
+
+                    fused_collide_and_stream_blocked_tbb<Collision>( cs.view( cs.D2Q9 ), cs.view( cs.D2Q9_n ), obstacle, pass, cs.omega,
+                        [&]( const size_t y_begin, const size_t y_end, const auto& f ) { cs.numa.parallel_rows( y_begin, y_end, f ); } );
+
+                    // after an odd number of steps the result is in the other grid
+                    if ( pass % 2 == 1 )
+                        std::swap( cs.D2Q9, cs.D2Q9_n );
+                }
+
+                if ( fields )
+                    calculate_macroscopic( cs, fields );
+
+                return;
+            }
+
+            for ( size_t z = 0; z < steps; ++z ) {
+
+                if ( kernel == cs_kernel::aa ) {
+
+                    auto D2Q9 = cs.view( cs.D2Q9 );
+
+                    if ( cs.parity == 0 ) {
+
+                        cs.numa.parallel_rows( 1, cs.ydim - 1,
+                            [&]( const size_t y_begin, const size_t y_end ) {
+
+                                aa_even_step_rows<Collision>( D2Q9, obstacle, y_begin, y_end, cs.omega );
+                            }
+                        );
+
+                    } else {
+
+                        restore_edge_cells( D2Q9, cs.edge_cells, cs.edge_states, true );
+
+                        cs.numa.parallel_rows( 1, cs.ydim - 1,
+                            [&]( const size_t y_begin, const size_t y_end ) {
+
+                                aa_odd_step_rows<Collision>( D2Q9, obstacle, y_begin, y_end, cs.omega );
+                            }
+                        );
+
+                        restore_edge_cells( D2Q9, cs.edge_cells, cs.edge_states, false );
+
+                        stream_edge_cells( D2Q9, obstacle, cs.edge_cells, cs.edge_states );
+                    }
+
+                    cs.parity ^= 1;
+
+                    continue;
+                }
+
+                auto D2Q9 = cs.view( cs.D2Q9 );
+                auto D2Q9_n = cs.view( cs.D2Q9_n );
+
+                switch ( kernel ) {
+
+                    case cs_kernel::split:
+
+                        // the edge-cells are collided too, they stream into the interior
+                        cs.numa.parallel_grid_rows( cs.ydim,
+                            [&]( const size_t y_begin, const size_t y_end ) {
+
+                                collide_rows<Collision>( D2Q9, y_begin, y_end, cs.omega );
+                            }
+                        );
+
+                        cs.numa.parallel_rows( 1, cs.ydim - 1,
+                            [&]( const size_t y_begin, const size_t y_end ) {
+
+                                stream_rows( D2Q9, D2Q9_n, y_begin, y_end );
+                            }
+                        );
+
+                        bounce_back_tbb( D2Q9_n, cs.links );
+
+                        break;
+
+                    case cs_kernel::fused:
+
+                        cs.numa.parallel_rows( 1, cs.ydim - 1,
+                            [&]( const size_t y_begin, const size_t y_end ) {
+
+                                fused_collide_and_stream_rows<Collision>( D2Q9, D2Q9_n, obstacle, y_begin, y_end, cs.omega,
+                                                                          z + 1 == steps ? fields : macroscopic_fields{} );
+                            }
+                        );
+
+                        break;
+
+                    case cs_kernel::simd:
+
+                        cs.numa.parallel_rows( 1, cs.ydim - 1,
+                            [&]( const size_t y_begin, const size_t y_end ) {
+
+                                // set_kernel only takes simd on such a state
+                                if constexpr ( std::is_same_v<Layout, layout_soa> && std::is_same_v<Storage, T> )
+                                    fused_collide_and_stream_isa_rows<Collision>( cs.D2Q9, cs.D2Q9_n, obstacle, y_begin, y_end, cs.ydim, cs.xdim, cs.omega );
+                            }
+                        );
+
+                        break;
+
+                    // handled above
+                    case cs_kernel::aa:
+                    case cs_kernel::blocked:
+
+                        break;
+                }
+
+                apply_boundary_conditions<Collision>( D2Q9, D2Q9_n, obstacle, cs.boundaries, cs.omega, kernel != cs_kernel::split );
+
+                std::swap( cs.D2Q9, cs.D2Q9_n );
+            }
+
+            if ( !fields )
+                return;
+
+            // the fused kernel leaves the edge-cells to the boundary conditions
+            if ( kernel == cs_kernel::fused && steps > 0 )
+                calculate_macroscopic_edges( cs.view( cs.D2Q9 ), fields );
+            else
+                calculate_macroscopic( cs, fields );
+        }
+
+        /*
+            advance the simulation by "steps" time-steps and return the throughput in
+            million lattice updates per second ( MLUPS )
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        double benchmark_cs( cs_state_tbb<Layout, Storage, Collision>& cs, const size_t steps ) {
+
+            auto start = std::chrono::steady_clock::now();
+
+            stateful_collide_and_stream_tbb( cs, steps );
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            return static_cast<double>( cs.vec_len ) * steps / elapsed.count() / 1e6;
+        }
+
+        /*
+            the memory bandwidth each node achieves in GB/s running the state's kernel, with every node
+            updating its rows at the same time: the bytes of the node's rows over "steps" time-steps
+            of benchmark_cs, counting a read and a write of each distribution per cell update, the
+            effective bandwidth whatever the kernel. the state is left "steps" steps further on.
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        std::vector<double> numa_kernel_bandwidth( cs_state_tbb<Layout, Storage, Collision>& cs, const size_t steps ) {
+
+            const double mlups = benchmark_cs( cs, steps );
+
+            const double elapsed = static_cast<double>( cs.vec_len ) * steps / ( mlups * 1e6 );
+
+            std::vector<double> bandwidth;
+
+            for ( size_t node = 0; node < cs.numa.nodes(); ++node ) {
+
+                const auto [ y_begin, y_end ] = cs.numa.node_rows( node, 1, cs.ydim - 1 );
+
+                const double bytes = 2.0 * 9 * sizeof( Storage ) * ( y_end - y_begin ) * cs.xdim * steps;
+
+                bandwidth.push_back( bytes / elapsed / 1e9 );
+            }
+
+            return bandwidth;
+        }
+
+        /*
+            non-owning pointer to the current grid in the state's layout and storage, invalidated by the next call
+            to collide and stream
+        */
+        template<typename Layout, typename Storage, typename Collision>
+        Storage* get_D2Q9( cs_state_tbb<Layout, Storage, Collision>& cs ) {
+
+            return cs.D2Q9;
+        }
+
+        template<typename Layout, typename Storage, typename Collision>
+        typename cs_state_tbb<Layout, Storage, Collision>::view_type get_D2Q9_view( cs_state_tbb<Layout, Storage, Collision>& cs ) {
+
+            return cs.view( cs.D2Q9 );
+        }
+
+        // copy the current grid into D2Q9 in the AoS layout of D2Q9_view, whatever the state's layout and storage
+        template<typename Layout, typename Storage, typename Collision>
+        void export_D2Q9( cs_state_tbb<Layout, Storage, Collision>& cs, T* D2Q9 ) {
+
+            expect_readable( cs );
+
+            if constexpr ( std::is_same_v<Layout, layout_aos> && std::is_same_v<Storage, T> )
+                std::memcpy( D2Q9, cs.D2Q9, cs.vec_len * 9 * sizeof( T ) );
+            else
+                copy_D2Q9( cs.view( cs.D2Q9 ), make_lattice_view<layout_aos>( D2Q9, cs.ydim, cs.xdim ) );
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef LBM_SUBDOMAIN_COLLIDE_AND_STREAM_TBB_HPP
+#define LBM_SUBDOMAIN_COLLIDE_AND_STREAM_TBB_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/layout.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/initialize_grid.hpp>
+#include <fs/lbm/fused_collide_and_stream_tbb.hpp>
+#include <fs/lbm/numa_tbb.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
+/*
+    shared-memory engine where every worker owns a subdomain of its own.
+
+    the interior rows of the grid are split into slabs, one per worker. a subdomain stores its slab
+    with a ghost row either side in buffers of its own, first written by the worker that updates it,
+    so no two workers write the same cache line and a slab stays in the caches of its worker between
+    steps. the fused pull kernel ( see fused_collide_and_stream_tbb.hpp ) runs on a subdomain
+    unchanged. each step a subdomain:
+    ( 1 ) copies into its ghost rows the distributions its neighbours' edge rows send it, those
+          moving up ( 2, 5, 6 ) into the row below it and those moving down ( 4, 7, 8 ) into the row
+          above it. the other six directions of a ghost row are never pulled.
+    ( 2 ) updates its rows.
+    ( 3 ) applies the boundary conditions to the edge-cells of its rows ( see boundary_conditions.hpp ),
+          the first and last subdomains also to the edge-rows of the grid.
+    the subdomains are mapped to the workers of the state's task_arena by a static partitioner, so
+    the same subdomain goes to the same worker every step. the first and last subdomains' outer ghost
+    rows are the edge-rows of the grid, which hold boundary values and aren't exchanged.
+
+    load balancing: a slab with more obstacle walls takes longer to update, since cells next to an
+    obstacle bounce back. with subdomain_balance::measured every subdomain times its updates and
+    every rebalance_steps steps the rows are split again in proportion to the measured cost of
+    each row.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            how the rows are split between the subdomains:
+            ( 1 ) rows: the same number of rows for each, fixed.
+            ( 2 ) measured: to begin with the same, then in proportion to the time each row took.
+        */
+        enum class subdomain_balance {
+            rows,
+            measured
+        };
+
+        // steps between rebalancing with subdomain_balance::measured
+        constexpr size_t rebalance_steps = 100;
+
+        // the slowest subdomain has to be this much slower than the average to split the rows again
+        constexpr double rebalance_tolerance = 0.05;
+
+        // directions moving up and down, the only ones that cross between subdomains
+        constexpr std::array<size_t, 3> subdomain_up_q = { 2, 5, 6 };
+        constexpr std::array<size_t, 3> subdomain_down_q = { 4, 7, 8 };
+
+        // a cache line of its own, the workers write their subdomain's timing every step
+        struct alignas( 64 ) subdomain {
+
+            // interior rows [ y_begin, y_end ) of the grid, local row 0 is row y_begin - 1 of the grid
+            size_t y_begin;
+            size_t y_end;
+
+            numa_vector<T> D2Q9_a;
+            numa_vector<T> D2Q9_b;
+
+            // current slab
+            T* D2Q9;
+            // slab being streamed into
+            T* D2Q9_n;
+
+            // obstacle of the slab and its ghost rows
+            std::vector<unsigned char> obstacle;
+
+            // time spent updating the slab since the rows were last split
+            double seconds;
+
+            size_t rows() const { return y_end - y_begin; }
+        };
+
+        struct subdomain_cs_state_tbb {
+
+            std::vector<subdomain> subdomains;
+
+            size_t ydim;
+            size_t xdim;
+
+            T viscosity;
+            T omega;
+
+            boundary_conditions boundaries;
+
+            subdomain_balance balance;
+
+            // steps since the rows were last split
+            size_t steps;
+
+            // the workers, each with the same subdomains every step
+            tbb::task_arena arena;
+
+            subdomain_cs_state_tbb() = default;
+
+            // the subdomains point into their buffers, so the state can be moved but not copied
+            subdomain_cs_state_tbb( const subdomain_cs_state_tbb& ) = delete;
+            subdomain_cs_state_tbb& operator=( const subdomain_cs_state_tbb& ) = delete;
+
+            subdomain_cs_state_tbb( subdomain_cs_state_tbb&& ) = default;
+            subdomain_cs_state_tbb& operator=( subdomain_cs_state_tbb&& ) = default;
+
+            auto view( T* D2Q9_data, const subdomain& sd ) const {
+
+                return make_lattice_view<layout_aos>( D2Q9_data, sd.rows() + 2, xdim );
+            }
+
+            // call f( subdomain ) for every subdomain, each on the worker that owns it
+            template<typename F>
+            void for_each_subdomain( const F& f ) {
+
+                arena.execute( [&] {
+
+                    tbb::parallel_for( tbb::blocked_range<size_t>( 0, subdomains.size(), 1 ),
+                        [&]( const tbb::blocked_range<size_t>& r ) {
+
+                            for ( size_t k = r.begin(); k < r.end(); ++k )
+                                f( subdomains[ k ] );
+                        },
+                        tbb::static_partitioner()
+                    );
+                } );
+            }
+        };
+
+        /*
+            split the subdomains' interior rows at "bounds", bounds[ k ] being the first row of
+            subdomain k and bounds.back() the last interior row plus one, copying the grid from
+            D2Q9. each subdomain's buffers are first written by its worker.
+        */
+        inline void split_subdomains( subdomain_cs_state_tbb& cs, const T* D2Q9, const unsigned char* obstacle,
+                                      const std::vector<size_t>& bounds ) {
+
+            const size_t row = cs.xdim * 9;
+
+            cs.subdomains = std::vector<subdomain>( bounds.size() - 1 );
+
+            for ( size_t k = 0; k < cs.subdomains.size(); ++k ) {
+
+                subdomain& sd = cs.subdomains[ k ];
+
+                sd.y_begin = bounds[ k ];
+                sd.y_end = bounds[ k + 1 ];
+                sd.seconds = 0.0;
+
+                sd.obstacle.assign( obstacle + ( sd.y_begin - 1 ) * cs.xdim, obstacle + ( sd.y_end + 1 ) * cs.xdim );
+            }
+
+            cs.for_each_subdomain( [&]( subdomain& sd ) {
+
+                const size_t size = ( sd.rows() + 2 ) * row;
+
+                sd.D2Q9_a.resize( size );
+                sd.D2Q9_b.resize( size );
+
+                std::memcpy( sd.D2Q9_a.data(), D2Q9 + ( sd.y_begin - 1 ) * row, size * sizeof( T ) );
+                std::memcpy( sd.D2Q9_b.data(), sd.D2Q9_a.data(), size * sizeof( T ) );
+
+                sd.D2Q9 = sd.D2Q9_a.data();
+                sd.D2Q9_n = sd.D2Q9_b.data();
+            } );
+
+            cs.steps = 0;
+        }
+
+        /*
+            the engine for a ydim x xdim grid in layout_aos. "subdomains" is the number of workers
+            and subdomains, by default one for each thread TBB would use.
+        */
+        inline subdomain_cs_state_tbb init_subdomain_cs_tbb( const T* D2Q9, const unsigned char* obstacle,
+                                                             const size_t ydim, const size_t xdim, const T viscosity,
+                                                             const subdomain_balance balance = subdomain_balance::rows,
+                                                             size_t subdomains = 0 ) {
+
+            subdomain_cs_state_tbb cs;
+
+            if ( subdomains == 0 )
+                subdomains = static_cast<size_t>( tbb::this_task_arena::max_concurrency() );
+
+            // at least a row each
+            subdomains = std::clamp<size_t>( subdomains, 1, ydim - 2 );
+
+            // a worker owns several subdomains when there are more of them than threads
+            cs.arena.initialize( std::min( static_cast<int>( subdomains ), tbb::this_task_arena::max_concurrency() ) );
+
+            cs.ydim = ydim;
+            cs.xdim = xdim;
+
+            cs.viscosity = viscosity;
+            cs.omega = 1.0 / ( 3.0 * viscosity + 0.5 );
+
+            cs.boundaries = make_boundary_conditions();
+
+            cs.balance = balance;
+
+            std::vector<size_t> bounds( subdomains + 1 );
+
+            for ( size_t k = 0; k <= subdomains; ++k )
+                bounds[ k ] = 1 + ( ydim - 2 ) * k / subdomains;
+
+            split_subdomains( cs, D2Q9, obstacle, bounds );
+
+            return cs;
+        }
+
+        /*
+            copy the current distributions of the whole grid, ghost rows aside, into D2Q9 in layout_aos
+        */
+        inline void export_D2Q9( const subdomain_cs_state_tbb& cs, T* D2Q9 ) {
+
+            const size_t row = cs.xdim * 9;
+
+            for ( size_t k = 0; k < cs.subdomains.size(); ++k ) {
+
+                const subdomain& sd = cs.subdomains[ k ];
+
+                // the first and last subdomains also hold the edge-rows of the grid
+                const size_t first = k == 0 ? 0 : 1;
+                const size_t last = k + 1 == cs.subdomains.size() ? sd.rows() + 2 : sd.rows() + 1;
+
+                std::memcpy( D2Q9 + ( sd.y_begin - 1 + first ) * row, sd.D2Q9 + first * row, ( last - first ) * row * sizeof( T ) );
+            }
+        }
+
+        /*
+            set the edge-cells of the grid in both buffers of the subdomains that hold them to the
+            equilibrium of the boundary conditions, as set_grid_boundaries does for the whole grid
+        */
+        inline void set_grid_boundaries( subdomain_cs_state_tbb& cs ) {
+
+            for ( size_t k = 0; k < cs.subdomains.size(); ++k ) {
+
+                subdomain& sd = cs.subdomains[ k ];
+
+                const size_t local_ydim = sd.rows() + 2;
+
+                for ( T* D2Q9_data : { sd.D2Q9, sd.D2Q9_n } ) {
+
+                    auto D2Q9 = cs.view( D2Q9_data, sd );
+
+                    for ( size_t y = 0; y < local_ydim; ++y ) {
+
+                        // inlet
+                        set_cell( D2Q9, y, 0, cs.boundaries.f_eq );
+                        // outlet
+                        set_cell( D2Q9, y, cs.xdim - 1, cs.boundaries.f_eq );
+                    }
+
+                    for ( size_t x = 0; x < cs.xdim; ++x ) {
+
+                        // top boundary
+                        if ( k == 0 )
+                            set_cell( D2Q9, 0, x, cs.boundaries.f_eq );
+                        // bottom boundary
+                        if ( k + 1 == cs.subdomains.size() )
+                            set_cell( D2Q9, local_ydim - 1, x, cs.boundaries.f_eq );
+                    }
+                }
+            }
+        }
+
+        /*
+            switch boundary conditions, which resets the edge-cells to the new equilibrium
+        */
+        inline void set_boundary_conditions( subdomain_cs_state_tbb& cs, const boundary_conditions& bc ) {
+
+            cs.boundaries = bc;
+
+            set_grid_boundaries( cs );
+        }
+
+        /*
+            split the rows again so every subdomain takes about the same time, given the time each
+            subdomain took per row since the last split. nothing changes while the slowest subdomain
+            is within rebalance_tolerance of the average. returns whether the rows were split again.
+        */
+        inline bool rebalance_subdomains( subdomain_cs_state_tbb& cs ) {
+
+            const size_t n = cs.subdomains.size();
+
+            double total{}, slowest{};
+
+            for ( const subdomain& sd : cs.subdomains ) {
+
+                total += sd.seconds;
+                slowest = std::max( slowest, sd.seconds );
+            }
+
+            if ( n == 1 || total <= 0.0 || slowest <= ( 1.0 + rebalance_tolerance ) * total / n ) {
+
+                for ( subdomain& sd : cs.subdomains )
+                    sd.seconds = 0.0;
+
+                cs.steps = 0;
+
+                return false;
+            }
+
+            // cost of each interior row, from the time of the subdomain it was in
+            std::vector<double> cost;
+
+            for ( const subdomain& sd : cs.subdomains )
+                cost.insert( cost.end(), sd.rows(), sd.seconds / sd.rows() );
+
+            std::vector<size_t> bounds( n + 1 );
+
+            bounds[ 0 ] = 1;
+            bounds[ n ] = cs.ydim - 1;
+
+            double accumulated{};
+
+            // rows given to the subdomains so far
+            size_t i = 0;
+
+            for ( size_t k = 1; k < n; ++k ) {
+
+                // at least a row for subdomain k - 1 and for each of the rest
+                const size_t i_min = bounds[ k - 1 ];
+                const size_t i_max = cost.size() - ( n - k );
+
+                // rows until the subdomains so far have k / n of the cost
+                while ( i < i_max && ( i < i_min || accumulated + 0.5 * cost[ i ] < total * k / n ) )
+                    accumulated += cost[ i++ ];
+
+                bounds[ k ] = 1 + i;
+            }
+
+            std::vector<T> D2Q9( cs.ydim * cs.xdim * 9 );
+            std::vector<unsigned char> obstacle( cs.ydim * cs.xdim );
+
+            export_D2Q9( cs, D2Q9.data() );
+
+            for ( const subdomain& sd : cs.subdomains )
+                std::memcpy( obstacle.data() + ( sd.y_begin - 1 ) * cs.xdim, sd.obstacle.data(), sd.obstacle.size() );
+
+            split_subdomains( cs, D2Q9.data(), obstacle.data(), bounds );
+
+            return true;
+        }
+
+        /*
+            advance the simulation by "steps" time-steps. the neighbours' edge rows are read at the
+            start of a step, after every subdomain finished the one before, and the buffers are only
+            swapped once all of them are done.
+        */
+        template<typename Collision = collision_BGK>
+        void stateful_collide_and_stream_tbb( subdomain_cs_state_tbb& cs, const size_t steps ) {
+
+            const size_t xdim = cs.xdim;
+            const size_t n = cs.subdomains.size();
+
+            // copy "directions" of row y_src of src into row y_dst of dst
+            auto copy_halo = [xdim]( const T* src, const size_t y_src, T* dst, const size_t y_dst,
+                                     const std::array<size_t, 3>& directions ) {
+
+                const T* src_row = src + y_src * xdim * 9;
+                T* dst_row = dst + y_dst * xdim * 9;
+
+                for ( size_t x = 0; x < xdim; ++x )
+                    for ( const size_t q : directions )
+                        dst_row[ x * 9 + q ] = src_row[ x * 9 + q ];
+            };
+
+            for ( size_t s = 0; s < steps; ++s ) {
+
+                cs.for_each_subdomain( [&]( subdomain& sd ) {
+
+                    const size_t k = static_cast<size_t>( &sd - cs.subdomains.data() );
+
+                    auto start = std::chrono::steady_clock::now();
+
+                    if ( k > 0 ) {
+
+                        const subdomain& below = cs.subdomains[ k - 1 ];
+
+                        copy_halo( below.D2Q9, below.rows(), sd.D2Q9, 0, subdomain_up_q );
+                    }
+
+                    if ( k + 1 < n ) {
+
+                        const subdomain& above = cs.subdomains[ k + 1 ];
+
+                        copy_halo( above.D2Q9, 1, sd.D2Q9, sd.rows() + 1, subdomain_down_q );
+                    }
+
+                    fused_collide_and_stream_rows<Collision>( cs.view( sd.D2Q9, sd ), cs.view( sd.D2Q9_n, sd ), sd.obstacle.data(),
+                                                              1, sd.rows() + 1, cs.omega );
+
+                    /*
+                        the ghost rows of the slab are set as edge-rows too, they are only read in the
+                        directions copied from the neighbours before the next step
+                    */
+                    apply_boundary_conditions<Collision>( cs.view( sd.D2Q9, sd ), cs.view( sd.D2Q9_n, sd ), sd.obstacle.data(),
+                                                          cs.boundaries, cs.omega, true );
+
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                    sd.seconds += elapsed.count();
+                } );
+
+                for ( subdomain& sd : cs.subdomains )
+                    std::swap( sd.D2Q9, sd.D2Q9_n );
+
+                if ( cs.balance == subdomain_balance::measured && ++cs.steps == rebalance_steps )
+                    rebalance_subdomains( cs );
+            }
+        }
+
+        /*
+            advance the simulation by "steps" time-steps and return the throughput in
+            million lattice updates per second ( MLUPS )
+        */
+        inline double benchmark_cs( subdomain_cs_state_tbb& cs, const size_t steps ) {
+
+            auto start = std::chrono::steady_clock::now();
+
+            stateful_collide_and_stream_tbb( cs, steps );
+
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            return static_cast<double>( cs.ydim * cs.xdim ) * steps / elapsed.count() / 1e6;
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef LBM_WARM_START_HPP
+#define LBM_WARM_START_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <fs/global_aliases.hpp>
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/collision.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
+/*
+    warm start: the starting grid of a new case from the solution of a previous one, e.g. the
+    neighbouring angle of attack of a sweep, rather than the uniform flow of initialize_grid.
+
+    the previous grid may have other dimensions, it is mapped onto the new one with the edges lined
+    up, cell ( y, x ) at ( y ( ydim_prev - 1 ) / ( ydim - 1 ), x ( xdim_prev - 1 ) / ( xdim - 1 ) ).
+    ( 1 ) a grid of the same dimensions is copied, distributions and all, cell by cell.
+    ( 2 ) otherwise the density and momentum are interpolated bilinearly from the four previous
+          cells around, leaving out those that were obstacles, and the cell starts at their
+          equilibrium. the non-equilibrium part depends on the spacing and comes back within a
+          few relaxation times.
+    ( 3 ) obstacle cells of the new grid hold the equilibrium of the free stream, as they would
+          after initialize_grid.
+    ( 4 ) fluid cells with no previous fluid cell around, where the obstacle was and isn't any
+          more, are filled from the cells next to them that have been, one layer at a time, with
+          the equilibrium of their mean density and velocity.
+    the edge-cells are whatever the mapping gives, the engines reset them with set_grid_boundaries.
+*/
+
+namespace fs {
+
+    namespace lbm {
+
+        /*
+            D2Q9, ydim x xdim with obstacle, from D2Q9_prev, ydim_prev x xdim_prev with obstacle_prev.
+            both are in the AoS layout of D2Q9_view, D2Q9 can be passed on to init_cs_tbb.
+        */
+        inline void warm_start_D2Q9( const T* D2Q9_prev, const unsigned char* obstacle_prev,
+                                     const size_t ydim_prev, const size_t xdim_prev,
+                                     T* D2Q9, const unsigned char* obstacle, const size_t ydim, const size_t xdim,
+                                     const boundary_conditions& bc = make_boundary_conditions() ) {
+
+            const bool same = ydim == ydim_prev && xdim == xdim_prev;
+
+            // whether the cell has a value the cells next to it can be filled from
+            std::vector<unsigned char> filled( ydim * xdim, 0 );
+
+            // position of n in a previous dimension of dim_prev cells, with the ends lined up
+            auto map = []( const size_t n, const size_t dim, const size_t dim_prev ) {
+
+                const T p = dim > 1 ? static_cast<T>( n ) * ( dim_prev - 1 ) / ( dim - 1 ) : 0.0;
+
+                const size_t n_0 = std::min( static_cast<size_t>( p ), dim_prev - 1 );
+                const size_t n_1 = std::min( n_0 + 1, dim_prev - 1 );
+
+                return std::make_tuple( n_0, n_1, p - n_0 );
+            };
+
+            tbb::parallel_for( tbb::blocked_range<size_t>( 0, ydim ),
+                [&]( const tbb::blocked_range<size_t>& r ) {
+
+                    for ( size_t y = r.begin(); y < r.end(); ++y ) {
+                        for ( size_t x = 0; x < xdim; ++x ) {
+
+                            const size_t i = x + y * xdim;
+
+                            T* f = D2Q9 + i * 9;
+
+                            if ( obstacle[ i ] ) {
+
+                                std::copy( bc.f_eq.begin(), bc.f_eq.end(), f );
+
+                                continue;
+                            }
+
+                            if ( same ) {
+
+                                if ( !obstacle_prev[ i ] ) {
+
+                                    std::copy( D2Q9_prev + i * 9, D2Q9_prev + i * 9 + 9, f );
+
+                                    filled[ i ] = 1;
+                                }
+
+                                continue;
+                            }
+
+                            const auto [ y_0, y_1, w_y ] = map( y, ydim, ydim_prev );
+                            const auto [ x_0, x_1, w_x ] = map( x, xdim, xdim_prev );
+
+                            const std::pair<size_t, T> corners[ 4 ] = {
+                                { x_0 + y_0 * xdim_prev, ( 1.0 - w_y ) * ( 1.0 - w_x ) },
+                                { x_1 + y_0 * xdim_prev, ( 1.0 - w_y ) * w_x },
+                                { x_0 + y_1 * xdim_prev, w_y * ( 1.0 - w_x ) },
+                                { x_1 + y_1 * xdim_prev, w_y * w_x }
+                            };
+
+                            T weight = 0.0;
+                            T rho = 0.0;
+                            T j_x = 0.0;
+                            T j_y = 0.0;
+
+                            for ( const auto& [ c, w_c ] : corners ) {
+
+                                if ( obstacle_prev[ c ] )
+                                    continue;
+
+                                const T* f_c = D2Q9_prev + c * 9;
+
+                                weight += w_c;
+                                rho += w_c * ( f_c[ 0 ] + f_c[ 1 ] + f_c[ 2 ] + f_c[ 3 ] + f_c[ 4 ] + f_c[ 5 ] + f_c[ 6 ] + f_c[ 7 ] + f_c[ 8 ] );
+                                j_x += w_c * ( f_c[ 1 ] + f_c[ 5 ] + f_c[ 8 ] - f_c[ 3 ] - f_c[ 6 ] - f_c[ 7 ] );
+                                j_y += w_c * ( f_c[ 2 ] + f_c[ 5 ] + f_c[ 6 ] - f_c[ 4 ] - f_c[ 7 ] - f_c[ 8 ] );
+                            }
+
+                            // only previous obstacles around, filled below
+                            if ( weight <= 0.0 )
+                                continue;
+
+                            T f_eq[ 9 ];
+
+                            get_f_eq( f_eq, rho / weight, j_x / rho, j_y / rho );
+
+                            std::copy( f_eq, f_eq + 9, f );
+
+                            filled[ i ] = 1;
+                        }
+                    }
+                }
+            );
+
+            // cells uncovered by the obstacle, a layer at a time from the filled cells next to them
+            std::vector<size_t> empty;
+
+            for ( size_t i = 0; i < ydim * xdim; ++i )
+                if ( !obstacle[ i ] && !filled[ i ] )
+                    empty.push_back( i );
+
+            while ( !empty.empty() ) {
+
+                std::vector<std::pair<size_t, std::array<T, 9>>> layer;
+                std::vector<size_t> remaining;
+
+                for ( const size_t i : empty ) {
+
+                    const size_t y = i / xdim;
+                    const size_t x = i % xdim;
+
+                    T n = 0.0;
+                    T rho = 0.0;
+                    T u_x = 0.0;
+                    T u_y = 0.0;
+
+                    for ( size_t q = 1; q < 9; ++q ) {
+
+                        const size_t y_n = y + e[ q ].second;
+                        const size_t x_n = x + e[ q ].first;
+
+                        // off the grid, unsigned
+                        if ( y_n >= ydim || x_n >= xdim )
+                            continue;
+
+                        const size_t i_n = x_n + y_n * xdim;
+
+                        if ( !filled[ i_n ] )
+                            continue;
+
+                        const T* f_n = D2Q9 + i_n * 9;
+
+                        const T rho_n = f_n[ 0 ] + f_n[ 1 ] + f_n[ 2 ] + f_n[ 3 ] + f_n[ 4 ] + f_n[ 5 ] + f_n[ 6 ] + f_n[ 7 ] + f_n[ 8 ];
+
+                        n += 1.0;
+                        rho += rho_n;
+                        u_x += ( f_n[ 1 ] + f_n[ 5 ] + f_n[ 8 ] - f_n[ 3 ] - f_n[ 6 ] - f_n[ 7 ] ) / rho_n;
+                        u_y += ( f_n[ 2 ] + f_n[ 5 ] + f_n[ 6 ] - f_n[ 4 ] - f_n[ 7 ] - f_n[ 8 ] ) / rho_n;
+                    }
+
+                    if ( n == 0.0 ) {
+
+                        remaining.push_back( i );
+
+                        continue;
+                    }
+
+                    T f_eq[ 9 ];
+
+                    get_f_eq( f_eq, rho / n, u_x / n, u_y / n );
+
+                    std::array<T, 9> f;
+
+                    std::copy( f_eq, f_eq + 9, f.begin() );
+
+                    layer.emplace_back( i, f );
+                }
+
+                // no fluid cell was filled at all, start the rest from the free stream
+                if ( layer.empty() ) {
+
+                    for ( const size_t i : remaining )
+                        std::copy( bc.f_eq.begin(), bc.f_eq.end(), D2Q9 + i * 9 );
+
+                    break;
+                }
+
+                for ( const auto& [ i, f ] : layer ) {
+
+                    std::copy( f.begin(), f.end(), D2Q9 + i * 9 );
+
+                    filled[ i ] = 1;
+                }
+
+                empty = std::move( remaining );
+            }
+        }
+
+    } // lbm
+
+} // fs
+
+#endif
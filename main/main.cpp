@@ -96,20 +96,22 @@ int main() {
 
             // end grid buffer set up
 
-            // start boundary setting
-
-            fs::lbm::set_boundaries( D2Q9_grid );
-
-            // end boundary setting
-
 #ifndef GPU
 
+            // collide_and_stream_tbb applies the boundary conditions every step
+
             // start collide and stream
 
             fs::lbm::collide_and_stream_tbb( D2Q9_grid.get_data_handle(), barrier.data(), steps_per_frame );
 
             // end collide and stream
 #else
+            // start boundary setting
+
+            fs::lbm::set_boundaries( D2Q9_grid );
+
+            // end boundary setting
+
             // start collide and stream
 
             fs::dpcxx::lbm::collide_and_stream( D2Q9_grid, barrier.data(), steps_per_frame );
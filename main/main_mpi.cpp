@@ -0,0 +1,53 @@
+/*
+    headless run of the airfoil split across MPI ranks, e.g. mpirun -np 4 ./main_mpi [ steps ]
+*/
+#include <mpi.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <grid.hpp>
+#include <settings.hpp>
+
+#include <fs/lbm/lbm.hpp>
+#include <fs/lbm/mpi_collide_and_stream.hpp>
+
+int main( int argc, char** argv ) {
+
+    MPI_Init( &argc, &argv );
+
+    const size_t steps = argc > 1 ? std::stoul( argv[ 1 ] ) : 1000;
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> D2Q9_grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( D2Q9_grid );
+
+    fs::lbm::obstacle_coords = fs::lbm::get_airfoil_coords_aoa( 0.04, 0.4, 0.12, 0.0 );
+
+    std::vector<unsigned char> barrier( fs::settings::ydim * fs::settings::xdim, 0 );
+
+    for ( auto xy : fs::lbm::obstacle_coords ) {
+        barrier[ xy.second + xy.first * fs::settings::xdim ] = 1;
+    }
+
+    {
+        fs::lbm::mpi_cs_state cs_state = fs::lbm::init_mpi_cs( D2Q9_grid.get_data_handle(), barrier.data(),
+                                                               fs::settings::ydim, fs::settings::xdim, 0.005 );
+
+        fs::lbm::set_grid_boundaries( cs_state );
+
+        const fs::lbm::mpi_benchmark result = fs::lbm::benchmark_mpi_cs( cs_state, steps );
+
+        if ( cs_state.rank == 0 ) {
+
+            std::cout << cs_state.ranks << " ranks, " << steps << " steps" << std::endl;
+            std::cout << "MLUPS: " << result.mlups << std::endl;
+            std::cout << "parallel efficiency: " << result.efficiency << std::endl;
+        }
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
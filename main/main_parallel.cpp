@@ -9,6 +9,7 @@
 #include <opencv2/opencv.hpp>
 
 #include <iostream>
+#include <string_view>
 
 #include <chrono>
 #include <thread>
@@ -35,11 +36,51 @@ const size_t save_interval = 10;
 
 const size_t steps_per_frame = 20;
 
-int main() {
+// the entries of app::gui::properties, in order
+enum property { property_density, property_speed, property_u_x, property_u_y, property_curl };
+
+/*
+    the selected property of app::gui::properties ( density, u, u_x, u_y, curl ) from the density
+    and velocity the engine stores on the last step of a frame
+*/
+void fields_to_property( const fs::lbm::macroscopic_fields& fields, double* property_data, const int selected_property ) {
+
+    const size_t vec_len = fs::settings::ydim * fs::settings::xdim;
+
+    if ( selected_property == property_curl ) {
+
+        fs::lbm::calculate_curl_tbb( fields.u_x, fields.u_y, property_data, fs::settings::ydim, fs::settings::xdim );
+
+        return;
+    }
+
+    tbb::parallel_for( tbb::blocked_range<size_t>( 0, vec_len ),
+        [&]( const tbb::blocked_range<size_t>& r ) {
+
+            for ( size_t i = r.begin(); i < r.end(); ++i ) {
+
+                switch ( selected_property ) {
+                    case property_density: property_data[ i ] = fields.rho[ i ]; break;
+                    case property_speed: property_data[ i ] = std::sqrt( fields.u_x[ i ] * fields.u_x[ i ] + fields.u_y[ i ] * fields.u_y[ i ] ); break;
+                    case property_u_x: property_data[ i ] = fields.u_x[ i ]; break;
+                    case property_u_y: property_data[ i ] = fields.u_y[ i ]; break;
+                }
+            }
+        }
+    );
+}
+
+// --bandwidth measures the STREAM-triad ceiling and the bandwidth the kernel achieves on each NUMA node before the simulation starts
+int main( int argc, char** argv ) {
+
+    [[maybe_unused]] const bool measure_bandwidth = argc > 1 && std::string_view( argv[ 1 ] ) == "--bandwidth";
 
     sim::grid<std::vector<double>, fs::lbm::D2Q9_view> D2Q9_grid( fs::lbm::D2Q9_states );
 
+#ifdef GPU
+
     sim::grid<std::vector<double>, fs::lbm::D2Q9_view> D2Q9_grid_copy( fs::lbm::D2Q9_states );
+#endif
 
     sim::grid<std::vector<double>, fs::property_view> property_grid( fs::lbm::property_states );
 
@@ -58,6 +99,47 @@ int main() {
     void* cs_state = fs::dpcxx::lbm::init_cs( D2Q9_grid, barrier, 0.005 );
 #endif
 
+#ifndef GPU
+
+    // owns the grids being simulated from here on, D2Q9_grid is only used for initialization
+    fs::lbm::cs_state_tbb<> cs_state = fs::lbm::init_cs_tbb( D2Q9_grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+    /*
+        density and velocity after a frame, the fused kernel stores them as it updates the grid. one
+        set is written while the other is drawn, so the grid itself is never copied.
+    */
+    std::vector<double> rho[ 2 ], u_x[ 2 ], u_y[ 2 ];
+
+    for ( size_t i = 0; i < 2; ++i ) {
+
+        rho[ i ].resize( fs::settings::ydim * fs::settings::xdim );
+        u_x[ i ].resize( fs::settings::ydim * fs::settings::xdim );
+        u_y[ i ].resize( fs::settings::ydim * fs::settings::xdim );
+    }
+
+    const fs::lbm::macroscopic_fields fields[ 2 ] = { { rho[ 0 ].data(), u_x[ 0 ].data(), u_y[ 0 ].data() },
+                                                      { rho[ 1 ].data(), u_x[ 1 ].data(), u_y[ 1 ].data() } };
+
+    size_t drawn = 0;
+
+    fs::lbm::calculate_macroscopic( cs_state, fields[ drawn ] );
+
+    // the memory bandwidth of each NUMA node bounds the throughput of the kernels
+    if ( measure_bandwidth ) {
+
+        const std::vector<double> ceiling = fs::lbm::numa_triad_ceiling( cs_state.numa );
+
+        // on a state of its own, so the simulation starts where it would without --bandwidth
+        fs::lbm::cs_state_tbb<> probe = fs::lbm::init_cs_tbb( D2Q9_grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+        const std::vector<double> achieved = fs::lbm::numa_kernel_bandwidth( probe, 100 );
+
+        for ( size_t node = 0; node < ceiling.size(); ++node )
+            std::cout << "NUMA node " << node << ": kernel " << achieved[ node ] << " GB/s, STREAM triad ceiling "
+                      << ceiling[ node ] << " GB/s" << std::endl;
+    }
+#endif
+
     // initialize GLFW and OpenGL context
     GLFWwindow* window = app::initialize_window();
 
@@ -97,6 +179,7 @@ int main() {
         if ( simulation_running ) {
 
             
+#ifdef GPU
 #ifndef SF
 
             // start boundary setting
@@ -104,13 +187,14 @@ int main() {
             fs::lbm::set_boundaries( D2Q9_grid );
 
             // end boundary setting
-#endif
+#endif // SF
 
             // start grid copy
 
             D2Q9_grid_copy = D2Q9_grid;
 
             // end grid copy
+#endif // GPU
 
             // start parallel tasks
 
@@ -120,7 +204,7 @@ int main() {
 
                 // start collide and stream
             
-                fs::lbm::collide_and_stream_tbb( D2Q9_grid.get_data_handle(), barrier.data(), steps_per_frame );
+                fs::lbm::stateful_collide_and_stream_tbb( cs_state, steps_per_frame, fields[ 1 - drawn ] );
             
                 // end collide and stream
 #else // GPU
@@ -147,6 +231,10 @@ int main() {
                 // end grid buffer set up
 
                 // start property calculation
+#ifndef GPU
+
+                fields_to_property( fields[ drawn ], property_grid.get_data_handle(), app::gui::selected_property );
+#else // GPU
             
                 // selected_property = curl
                 if ( std::strcmp( app::gui::properties[ app::gui::selected_property ], "curl" ) == 0 ) {
@@ -155,6 +243,7 @@ int main() {
                     fs::lbm::calculate_property_v_tbb( D2Q9_grid_copy.get_data_handle(), property_grid.get_data_handle(),
                                                        app::gui::physical_properties[ app::gui::selected_property ] );    
                 }
+#endif // GPU
 
                 // end property calculation
 
@@ -205,6 +294,12 @@ int main() {
 
             group.wait();
 
+#ifndef GPU
+
+            // draw what the kernel just stored
+            drawn = 1 - drawn;
+#endif
+
             // end parallel tasks
         } else {
 
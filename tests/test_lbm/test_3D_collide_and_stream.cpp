@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+    constexpr size_t zdim = 14;
+    constexpr size_t ydim = 18;
+    constexpr size_t xdim = 30;
+    constexpr size_t cells = zdim * ydim * xdim;
+
+    // a sphere of obstacle voxels a third of the way along the channel
+    std::vector<unsigned char> sphere_obstacle() {
+
+        std::vector<unsigned char> obstacle( cells, 0 );
+
+        for ( size_t z = 0; z < zdim; ++z ) {
+            for ( size_t y = 0; y < ydim; ++y ) {
+                for ( size_t x = 0; x < xdim; ++x ) {
+
+                    const double dz = z - zdim / 2.0;
+                    const double dy = y - ydim / 2.0;
+                    const double dx = x - xdim / 3.0;
+
+                    obstacle[ x + xdim * ( y + ydim * z ) ] = dx * dx + dy * dy + dz * dz < 16.0;
+                }
+            }
+        }
+
+        return obstacle;
+    }
+
+    /*
+        largest difference between the engine and the generated kernel of lattice.hpp on the
+        fluid cells after "steps" time-steps from the same start
+    */
+    template<typename L, typename Storage>
+    double difference_from_generated( const size_t steps, const size_t tile_ydim ) {
+
+        const std::vector<unsigned char> obstacle = sphere_obstacle();
+
+        auto cs = fs::lbm::init_cs_3D_tbb<L, Storage>( obstacle.data(), zdim, ydim, xdim, 0.02, tile_ydim );
+
+        std::vector<double> f( cells * L::Q );
+
+        fs::lbm::export_distributions( cs, f.data() );
+
+        std::vector<double> f_n = f;
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, steps );
+
+        for ( size_t s = 0; s < steps; ++s ) {
+
+            fs::lbm::lattice_collide_and_stream_tbb<L>( f.data(), f_n.data(), obstacle.data(), { xdim, ydim, zdim }, cs.omega );
+
+            std::swap( f, f_n );
+        }
+
+        std::vector<double> exported( cells * L::Q );
+
+        fs::lbm::export_distributions( cs, exported.data() );
+
+        double max_difference{};
+
+        for ( size_t q = 0; q < L::Q; ++q )
+            for ( size_t i = 0; i < cells; ++i )
+                if ( !obstacle[ i ] )
+                    max_difference = std::max( max_difference, std::fabs( exported[ q * cells + i ] - f[ q * cells + i ] ) );
+
+        return max_difference;
+    }
+}
+
+TEST( LBMTests, CollideAndStream3D ) {
+
+    // the same kernel with the same order of operations in a different layout and sweep order, tiles of 0 rows are the default
+    EXPECT_EQ( ( difference_from_generated<fs::lbm::lattice_D3Q19, double>( 12, 0 ) ), 0.0 );
+    EXPECT_EQ( ( difference_from_generated<fs::lbm::lattice_D3Q19, double>( 12, 5 ) ), 0.0 );
+    EXPECT_EQ( ( difference_from_generated<fs::lbm::lattice_D3Q27, double>( 12, 0 ) ), 0.0 );
+
+    // float storage rounds every step
+    EXPECT_LT( ( difference_from_generated<fs::lbm::lattice_D3Q19, float>( 12, 0 ) ), 1e-6 );
+
+    // the sphere slows the flow behind it
+    const std::vector<unsigned char> obstacle = sphere_obstacle();
+
+    auto cs = fs::lbm::init_cs_3D_tbb<fs::lbm::lattice_D3Q19>( obstacle.data(), zdim, ydim, xdim, 0.02 );
+
+    fs::lbm::stateful_collide_and_stream_tbb( cs, 40 );
+
+    std::vector<double> f( cells * 19 );
+
+    fs::lbm::export_distributions( cs, f.data() );
+
+    double rho[ 2 ] = {}, j_x[ 2 ] = {};
+
+    // cells just behind the sphere and at the same x towards the corner of the channel
+    const size_t behind[ 2 ] = { xdim / 3 + 5 + xdim * ( ydim / 2 + ydim * ( zdim / 2 ) ), xdim / 3 + 5 + xdim * ( 2 + ydim * 2 ) };
+
+    for ( size_t k = 0; k < 2; ++k ) {
+        for ( size_t q = 0; q < 19; ++q ) {
+
+            rho[ k ] += f[ q * cells + behind[ k ] ];
+            j_x[ k ] += f[ q * cells + behind[ k ] ] * fs::lbm::lattice_D3Q19::c[ q ][ 0 ];
+        }
+    }
+
+    EXPECT_LT( j_x[ 0 ] / rho[ 0 ], j_x[ 1 ] / rho[ 1 ] );
+}
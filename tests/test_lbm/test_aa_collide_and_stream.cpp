@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, AACollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    auto fused = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+    auto aa = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::aa );
+
+    // streaming in place needs only the one grid
+    EXPECT_TRUE( aa.D2Q9_b.empty() );
+
+    for ( size_t frame = 0; frame < 3; ++frame ) {
+
+        fs::lbm::set_grid_boundaries( fused );
+        fs::lbm::set_grid_boundaries( aa );
+
+        fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+        fs::lbm::stateful_collide_and_stream_tbb( aa, 20 );
+
+        // aa holds pre-collision and fused post-collision distributions, compare what collision conserves
+        EXPECT_LT( test::max_moment_difference( fs::lbm::get_D2Q9( fused ), fs::lbm::get_D2Q9( aa ),
+                                                fused.vec_len, barrier.data() ), 1e-12 ) << "frame " << frame;
+    }
+
+    // half-way through a pair of steps the grid is in the swapped layout, and isn't read
+    const size_t vec_len = aa.vec_len;
+
+    std::vector<double> D2Q9( vec_len * 9 ), rho( vec_len );
+
+    fs::lbm::stateful_collide_and_stream_tbb( aa, 1 );
+
+    EXPECT_THROW( fs::lbm::export_D2Q9( aa, D2Q9.data() ), std::logic_error );
+    EXPECT_THROW( fs::lbm::calculate_macroscopic( aa, { rho.data(), nullptr, nullptr } ), std::logic_error );
+    EXPECT_THROW( fs::lbm::stateful_collide_and_stream_tbb( aa, 2, { rho.data(), nullptr, nullptr } ), std::logic_error );
+    EXPECT_THROW( fs::lbm::set_kernel( aa, fs::lbm::cs_kernel::fused ), std::logic_error );
+
+    fs::lbm::stateful_collide_and_stream_tbb( aa, 1, { rho.data(), nullptr, nullptr } );
+
+    EXPECT_NO_THROW( fs::lbm::export_D2Q9( aa, D2Q9.data() ) );
+
+    // so the convergence monitor only samples it after an even number of steps
+    EXPECT_THROW( fs::lbm::collide_and_stream_to_convergence_tbb( aa, { fs::lbm::convergence_field::velocity, 25, 1e-7, 100 } ),
+                  std::invalid_argument );
+}
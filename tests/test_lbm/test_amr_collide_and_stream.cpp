@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, AMRCollideAndStream ) {
+
+    const size_t ydim = 64;
+    const size_t xdim = 192;
+
+    // the free stream crosses every level unchanged
+    {
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        // any block is split
+        fs::lbm::amr_criterion criterion{ -1.0, -2.0, 2, 10 };
+
+        auto cs = fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02, criterion );
+
+        fs::lbm::set_grid_boundaries( cs );
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 30 );
+
+        EXPECT_FALSE( cs.leaves[ 1 ].empty() );
+        EXPECT_FALSE( cs.leaves[ 2 ].empty() );
+
+        const fs::lbm::boundary_conditions bc = fs::lbm::make_boundary_conditions();
+
+        std::vector<double> D2Q9_fine( ( ydim << 2 ) * ( xdim << 2 ) * 9 );
+
+        fs::lbm::export_D2Q9( cs, D2Q9_fine.data(), 2 );
+
+        for ( size_t i = 0; i < D2Q9_fine.size(); ++i )
+            ASSERT_NEAR( D2Q9_fine[ i ], bc.f_eq[ i % 9 ], 1e-12 );
+    }
+
+    auto cylinder = []( const double y, const double x ) {
+
+        return ( y - 31.7 ) * ( y - 31.7 ) + ( x - 40.0 ) * ( x - 40.0 ) < 6.0 * 6.0;
+    };
+
+    std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+    for ( size_t y = 1; y < ydim - 1; ++y )
+        for ( size_t x = 1; x < xdim - 1; ++x )
+            barrier[ x + y * xdim ] = cylinder( y, x );
+
+    // regridding moves the mass and momentum of the cells to the new ones
+    {
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+
+        fs::lbm::amr_criterion criterion{ 0.0, 0.0, 1, 0 };
+
+        auto cs = fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02, criterion, cylinder );
+
+        fs::lbm::set_grid_boundaries( cs );
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 50 );
+
+        double mass = fs::lbm::amr_mass( cs );
+
+        ASSERT_TRUE( fs::lbm::regrid_amr( cs ) );
+        EXPECT_FALSE( cs.leaves[ 1 ].empty() );
+        EXPECT_NEAR( fs::lbm::amr_mass( cs ), mass, 1e-12 * mass );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 50 );
+
+        // every block merged back
+        cs.criterion.refine = 1.0;
+        cs.criterion.coarsen = 1.0;
+
+        mass = fs::lbm::amr_mass( cs );
+
+        ASSERT_TRUE( fs::lbm::regrid_amr( cs ) );
+        EXPECT_TRUE( cs.leaves[ 1 ].empty() );
+        EXPECT_NEAR( fs::lbm::amr_mass( cs ), mass, 1e-12 * mass );
+    }
+
+    /*
+        the boundary conditions are applied to the edge-cells: without refinement the grid follows the
+        single-grid engine with the same ones, not the equilibrium edges, and with it the free stream
+        still crosses every level unchanged
+    */
+    {
+        fs::lbm::boundary_conditions absorbing = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+        absorbing.sponge.width = 16;
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim, absorbing );
+
+        auto cs = fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02, { 0.0, 0.0, 0, 0 } );
+        auto cs_equilibrium = fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02, { 0.0, 0.0, 0, 0 } );
+        auto cs_grid = fs::lbm::init_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_boundary_conditions( cs, absorbing );
+        fs::lbm::set_grid_boundaries( cs_equilibrium );
+        fs::lbm::set_boundary_conditions( cs_grid, absorbing );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 300 );
+        fs::lbm::stateful_collide_and_stream_tbb( cs_equilibrium, 300 );
+        fs::lbm::stateful_collide_and_stream_tbb( cs_grid, 300 );
+
+        std::vector<double> D2Q9_amr( ydim * xdim * 9 );
+        std::vector<double> D2Q9_equilibrium( ydim * xdim * 9 );
+
+        fs::lbm::export_D2Q9( cs, D2Q9_amr.data() );
+        fs::lbm::export_D2Q9( cs_equilibrium, D2Q9_equilibrium.data() );
+
+        const double* D2Q9_grid = fs::lbm::get_D2Q9( cs_grid );
+
+        double difference_grid = 0.0;
+        double difference_equilibrium = 0.0;
+
+        for ( size_t i = 0; i < D2Q9_amr.size(); ++i ) {
+
+            difference_grid = std::max( difference_grid, std::abs( D2Q9_amr[ i ] - D2Q9_grid[ i ] ) );
+            difference_equilibrium = std::max( difference_equilibrium, std::abs( D2Q9_amr[ i ] - D2Q9_equilibrium[ i ] ) );
+        }
+
+        EXPECT_LT( difference_grid, 1e-13 );
+        EXPECT_GT( difference_equilibrium, 1e-4 );
+
+        std::vector<double> D2Q9_free = test::free_stream( ydim, xdim, absorbing );
+        std::vector<unsigned char> barrier_free( ydim * xdim, 0 );
+
+        // any block is split, but those under the sponge layer
+        auto cs_free = fs::lbm::init_amr_cs_tbb( D2Q9_free.data(), barrier_free.data(), ydim, xdim, 0.02, { -1.0, -2.0, 2, 10 } );
+
+        fs::lbm::set_boundary_conditions( cs_free, absorbing );
+        fs::lbm::stateful_collide_and_stream_tbb( cs_free, 30 );
+
+        EXPECT_FALSE( cs_free.leaves[ 2 ].empty() );
+
+        std::vector<double> D2Q9_fine( ( ydim << 2 ) * ( xdim << 2 ) * 9 );
+
+        fs::lbm::export_D2Q9( cs_free, D2Q9_fine.data(), 2 );
+
+        for ( size_t i = 0; i < D2Q9_fine.size(); ++i )
+            ASSERT_NEAR( D2Q9_fine[ i ], absorbing.f_eq[ i % 9 ], 1e-12 );
+
+        // the sponge layer can't be moved over refined blocks
+        absorbing.sponge.width = 64;
+
+        EXPECT_THROW( fs::lbm::set_boundary_conditions( cs_free, absorbing ), std::invalid_argument );
+    }
+
+    /*
+        the wake of the cylinder, refined as it develops, is closer to the whole grid refined than the
+        coarse grid alone, with a fraction of the cells
+    */
+    {
+        const double visc = 0.02;
+        const size_t steps = 600;
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+
+        auto coarse = fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, visc, { 0.0, 0.0, 0, 0 } );
+        auto amr = fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, visc, { 0.005, 0.001, 1, 25 }, cylinder );
+
+        // the whole grid at the spacing of level 1, twice the steps and twice the viscosity in its units
+        const size_t ydim_f = 2 * ydim;
+        const size_t xdim_f = 2 * xdim;
+
+        std::vector<unsigned char> barrier_f( ydim_f * xdim_f, 0 );
+
+        for ( size_t y = 1; y < ydim_f - 1; ++y )
+            for ( size_t x = 1; x < xdim_f - 1; ++x )
+                barrier_f[ x + y * xdim_f ] = cylinder( 0.5 * y - 0.25, 0.5 * x - 0.25 );
+
+        std::vector<double> D2Q9_f = test::free_stream( ydim_f, xdim_f );
+
+        auto uniform = fs::lbm::init_amr_cs_tbb( D2Q9_f.data(), barrier_f.data(), ydim_f, xdim_f, 2.0 * visc, { 0.0, 0.0, 0, 0 } );
+
+        fs::lbm::set_grid_boundaries( coarse );
+        fs::lbm::set_grid_boundaries( amr );
+        fs::lbm::set_grid_boundaries( uniform );
+
+        fs::lbm::stateful_collide_and_stream_tbb( coarse, steps );
+        fs::lbm::stateful_collide_and_stream_tbb( amr, steps );
+        fs::lbm::stateful_collide_and_stream_tbb( uniform, 2 * steps );
+
+        EXPECT_FALSE( amr.leaves[ 1 ].empty() );
+        EXPECT_LT( fs::lbm::amr_cell_count( amr ), ydim_f * xdim_f / 2 );
+
+        std::vector<double> D2Q9_coarse( ydim * xdim * 9 );
+        std::vector<double> D2Q9_amr( ydim_f * xdim_f * 9 );
+
+        fs::lbm::export_D2Q9( coarse, D2Q9_coarse.data() );
+        fs::lbm::export_D2Q9( amr, D2Q9_amr.data(), 1 );
+        fs::lbm::export_D2Q9( uniform, D2Q9_f.data() );
+
+        double error_coarse = 0.0;
+        double error_amr = 0.0;
+
+        for ( size_t y = 2 * 16; y < 2 * 48; ++y ) {
+            for ( size_t x = 2 * 48; x < 2 * 112; ++x ) {
+
+                const double u_x = test::u_x_at( D2Q9_f, xdim_f, y, x );
+
+                ASSERT_TRUE( std::isfinite( test::u_x_at( D2Q9_amr, xdim_f, y, x ) ) );
+
+                error_coarse = std::max( error_coarse, std::abs( test::u_x_at( D2Q9_coarse, xdim, y / 2, x / 2 ) - u_x ) );
+                error_amr = std::max( error_amr, std::abs( test::u_x_at( D2Q9_amr, xdim_f, y, x ) - u_x ) );
+            }
+        }
+
+        EXPECT_LT( error_amr, 0.5 * error_coarse );
+    }
+
+    // the grid must be a whole number of blocks
+    {
+        std::vector<double> D2Q9 = test::free_stream( 100, xdim );
+        std::vector<unsigned char> barrier( 100 * xdim, 0 );
+
+        EXPECT_THROW( fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), 100, xdim, 0.02, {}, {}, 16 ), std::invalid_argument );
+        EXPECT_THROW( fs::lbm::init_amr_cs_tbb( D2Q9.data(), barrier.data(), 100, xdim, 0.02, {}, {}, 0 ), std::invalid_argument );
+    }
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, BlockedCollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    auto fused = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+    auto blocked = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::blocked );
+
+    // 20 steps is two whole passes and an odd-sized one
+    for ( const size_t steps : { 20, 7 } ) {
+
+        fs::lbm::set_grid_boundaries( fused );
+        fs::lbm::set_grid_boundaries( blocked );
+
+        fs::lbm::stateful_collide_and_stream_tbb( fused, steps );
+        fs::lbm::stateful_collide_and_stream_tbb( blocked, steps );
+
+        // every cell is updated exactly as by the fused kernel
+        const double* a = fs::lbm::get_D2Q9( fused );
+        const double* b = fs::lbm::get_D2Q9( blocked );
+
+        for ( size_t i = 0; i < fused.vec_len * 9; ++i )
+            ASSERT_EQ( a[ i ], b[ i ] ) << "steps " << steps << " index " << i;
+    }
+}
+
+TEST( LBMTests, BlockedCollideAndStreamTiles ) {
+
+    const size_t ydim = 37;
+    const size_t xdim = 53;
+
+    std::vector<unsigned char> obstacle = test::block_obstacle( ydim, xdim );
+
+    std::vector<double> D2Q9( ydim * xdim * 9 );
+
+    for ( size_t i = 0; i < ydim * xdim; ++i )
+        for ( size_t q = 0; q < 9; ++q )
+            D2Q9[ i * 9 + q ] = fs::lbm::w[ q ] * ( 1.0 + 0.01 * ( ( i * 7 + q * 3 ) % 11 ) );
+
+    // tiles that don't divide the grid, and tiles smaller than the number of steps
+    for ( const size_t tile : { 2, 5, 16, 64 } ) {
+
+        std::vector<double> a = D2Q9, a_n = D2Q9;
+        std::vector<double> b = D2Q9, b_n = D2Q9;
+
+        for ( size_t z = 0; z < 6; ++z ) {
+
+            fs::lbm::fused_collide_and_stream_tbb( a.data(), a_n.data(), obstacle.data(), ydim, xdim, 1.2 );
+
+            std::swap( a, a_n );
+        }
+
+        fs::lbm::fused_collide_and_stream_blocked_tbb( fs::lbm::make_lattice_view<fs::lbm::layout_aos>( b.data(), ydim, xdim ),
+                                                       fs::lbm::make_lattice_view<fs::lbm::layout_aos>( b_n.data(), ydim, xdim ),
+                                                       obstacle.data(), 6, 1.2, tile, tile + 1 );
+
+        EXPECT_EQ( a, b ) << "tile " << tile;
+    }
+}
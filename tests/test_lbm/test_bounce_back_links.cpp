@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, BounceBackLinks ) {
+
+    const size_t ydim = 12;
+    const size_t xdim = 16;
+
+    std::vector<unsigned char> obstacle = test::block_obstacle( ydim, xdim );
+
+    // a distinct value in every slot, so a wrong source shows up
+    std::vector<double> expected( ydim * xdim * 9 );
+
+    for ( size_t i = 0; i < expected.size(); ++i )
+        expected[ i ] = static_cast<double>( i );
+
+    std::vector<double> linked = expected;
+
+    // the serial scan over the obstacle cells that the links replace
+    for ( size_t y = 1; y < ydim - 1; ++y ) {
+        for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+            if ( !obstacle[ x + y * xdim ] )
+                continue;
+
+            for ( size_t q = 1; q < 9; ++q ) {
+
+                const size_t n = ( x + fs::lbm::e[ q ].first ) + ( y + fs::lbm::e[ q ].second ) * xdim;
+
+                expected[ n * 9 + q ] = expected[ ( x + y * xdim ) * 9 + fs::lbm::opposite_q[ q ] ];
+            }
+        }
+    }
+
+    const std::vector<fs::lbm::boundary_link> links = fs::lbm::get_boundary_links( obstacle.data(), ydim, xdim );
+
+    // one link per fluid neighbour of the 6 x 4 block: 3 for each side cell, 5 for each corner cell
+    EXPECT_EQ( links.size(), ( 2 * ( 6 - 2 ) + 2 * ( 4 - 2 ) ) * 3 + 4 * 5 );
+
+    fs::lbm::bounce_back_tbb( linked.data(), links, ydim, xdim );
+
+    for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+        if ( obstacle[ i ] )
+            continue;
+
+        for ( size_t q = 0; q < 9; ++q )
+            EXPECT_EQ( linked[ i * 9 + q ], expected[ i * 9 + q ] ) << "cell " << i << " direction " << q;
+    }
+}
+
+TEST( LBMTests, BounceBackLinksFollowObstacle ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    auto cs = fs::lbm::init_cs_tbb( grid, barrier, 0.005 );
+
+    EXPECT_FALSE( cs.links.empty() );
+
+    // the links are rebuilt when the obstacle changes
+    std::vector<unsigned char> no_barrier( barrier.size(), 0 );
+
+    fs::lbm::set_obstacle( cs, no_barrier.data() );
+
+    EXPECT_TRUE( cs.links.empty() );
+}
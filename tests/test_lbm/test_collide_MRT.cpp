@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+namespace {
+
+    template<typename Rates>
+    double closed_form_difference( const double omega ) {
+
+        double max_difference{};
+
+        for ( const double u_x : { -0.1, 0.0, 0.05, 0.2 } ) {
+            for ( const double u_y : { -0.15, 0.0, 0.1 } ) {
+
+                double f[ 9 ], f_dense[ 9 ];
+
+                test::get_test_cell( f, u_x, u_y );
+                test::get_test_cell( f_dense, u_x, u_y );
+
+                fs::lbm::collide_MRT<Rates>( f, omega );
+                fs::lbm::collide_MRT_dense( f_dense, fs::lbm::get_mrt_rates<Rates>( omega ) );
+
+                for ( size_t q = 0; q < 9; ++q )
+                    max_difference = std::max( max_difference, std::fabs( f[ q ] - f_dense[ q ] ) );
+            }
+        }
+
+        return max_difference;
+    }
+}
+
+TEST( LBMTests, CollideMRT ) {
+
+    for ( const double omega : { 0.8, 1.2, 1.97 } ) {
+
+        EXPECT_LT( closed_form_difference<fs::lbm::mrt_rates_lallemand_luo>( omega ), 1e-15 ) << "omega " << omega;
+        EXPECT_LT( closed_form_difference<fs::lbm::mrt_rates_bgk>( omega ), 1e-15 ) << "omega " << omega;
+    }
+
+    // with a single rate MRT is BGK
+    double f[ 9 ], f_BGK[ 9 ];
+
+    test::get_test_cell( f, 0.1, -0.05 );
+    test::get_test_cell( f_BGK, 0.1, -0.05 );
+
+    fs::lbm::collide_MRT<fs::lbm::mrt_rates_bgk>( f, 1.5 );
+    fs::lbm::collide_BGK( f_BGK, 1.5 );
+
+    for ( size_t q = 0; q < 9; ++q )
+        EXPECT_NEAR( f[ q ], f_BGK[ q ], 1e-15 ) << "direction " << q;
+}
+
+TEST( LBMTests, CollideAndStreamMRT ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    std::vector<double> D2Q9_BGK( grid.get_data_handle(), grid.get_data_handle() + fs::settings::ydim * fs::settings::xdim * 9 );
+    std::vector<double> D2Q9_MRT = D2Q9_BGK;
+
+    fs::lbm::collide_and_stream_tbb( D2Q9_BGK.data(), barrier.data(), 20 );
+    fs::lbm::collide_and_stream_MRT_tbb<fs::lbm::mrt_rates_bgk>( D2Q9_MRT.data(), barrier.data(), 20 );
+
+    EXPECT_LT( test::max_moment_difference( D2Q9_BGK.data(), D2Q9_MRT.data(), fs::settings::ydim * fs::settings::xdim,
+                                            barrier.data() ), 1e-12 );
+
+    // with the same boundary conditions
+    const auto zou_he = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::zero_gradient );
+
+    fs::lbm::collide_and_stream_tbb( D2Q9_BGK.data(), barrier.data(), 20, zou_he );
+    fs::lbm::collide_and_stream_MRT_tbb<fs::lbm::mrt_rates_bgk>( D2Q9_MRT.data(), barrier.data(), 20, zou_he );
+
+    EXPECT_LT( test::max_moment_difference( D2Q9_BGK.data(), D2Q9_MRT.data(), fs::settings::ydim * fs::settings::xdim,
+                                            barrier.data() ), 1e-12 );
+
+    // the default rates stay stable
+    fs::lbm::collide_and_stream_MRT_tbb( D2Q9_MRT.data(), barrier.data(), 20 );
+
+    for ( const double f : D2Q9_MRT )
+        ASSERT_TRUE( std::isfinite( f ) );
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+namespace {
+
+    // largest change in density or momentum made by a collision
+    template<typename Collision>
+    double conservation_error( const double omega ) {
+
+        double max_error{};
+
+        for ( const double u_x : { -0.1, 0.0, 0.2 } ) {
+            for ( const double u_y : { -0.15, 0.0, 0.1 } ) {
+
+                double f[ 9 ];
+
+                test::get_test_cell( f, u_x, u_y );
+
+                double before[ 3 ] = {};
+                double after[ 3 ] = {};
+
+                for ( size_t q = 0; q < 9; ++q ) {
+
+                    before[ 0 ] += f[ q ];
+                    before[ 1 ] += f[ q ] * fs::lbm::e[ q ].first;
+                    before[ 2 ] += f[ q ] * fs::lbm::e[ q ].second;
+                }
+
+                Collision::collide( f, omega );
+
+                for ( size_t q = 0; q < 9; ++q ) {
+
+                    after[ 0 ] += f[ q ];
+                    after[ 1 ] += f[ q ] * fs::lbm::e[ q ].first;
+                    after[ 2 ] += f[ q ] * fs::lbm::e[ q ].second;
+                }
+
+                for ( size_t m = 0; m < 3; ++m )
+                    max_error = std::max( max_error, std::fabs( after[ m ] - before[ m ] ) );
+            }
+        }
+
+        return max_error;
+    }
+
+    // "steps" time-steps of the engine with a kernel and collision policy from the initial grid
+    template<typename Collision, typename Layout = fs::lbm::layout_aos>
+    std::vector<double> run_engine( const fs::lbm::cs_kernel kernel, const size_t steps ) {
+
+        sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+        fs::lbm::initialize_grid( grid );
+
+        std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+        auto cs = fs::lbm::init_cs_tbb<Layout, double, Collision>( grid, barrier, 0.005, kernel );
+
+        fs::lbm::set_grid_boundaries( cs );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, steps );
+
+        std::vector<double> D2Q9( fs::settings::ydim * fs::settings::xdim * 9 );
+
+        fs::lbm::export_D2Q9( cs, D2Q9.data() );
+
+        return D2Q9;
+    }
+
+    double max_difference( const std::vector<double>& a, const std::vector<double>& b ) {
+
+        double max_difference{};
+
+        for ( size_t i = 0; i < a.size(); ++i )
+            max_difference = std::max( max_difference, std::fabs( a[ i ] - b[ i ] ) );
+
+        return max_difference;
+    }
+}
+
+TEST( LBMTests, CollisionConservesMoments ) {
+
+    for ( const double omega : { 0.8, 1.2, 1.97 } ) {
+
+        EXPECT_LT( conservation_error<fs::lbm::collision_BGK>( omega ), 1e-15 ) << "omega " << omega;
+        EXPECT_LT( conservation_error<fs::lbm::collision_TRT>( omega ), 1e-15 ) << "omega " << omega;
+        EXPECT_LT( conservation_error<fs::lbm::collision_regularized>( omega ), 1e-15 ) << "omega " << omega;
+        EXPECT_LT( conservation_error<fs::lbm::collision_MRT<>>( omega ), 1e-15 ) << "omega " << omega;
+    }
+}
+
+TEST( LBMTests, CollisionReducesToBGK ) {
+
+    const double omega = 1.5;
+
+    double f_BGK[ 9 ], f_TRT[ 9 ];
+
+    test::get_test_cell( f_BGK, 0.1, -0.05 );
+    test::get_test_cell( f_TRT, 0.1, -0.05 );
+
+    fs::lbm::collide_BGK( f_BGK, omega );
+
+    // the magic parameter of a single rate
+    fs::lbm::collide_TRT( f_TRT, omega, ( 1.0 / omega - 0.5 ) * ( 1.0 / omega - 0.5 ) );
+
+    for ( size_t q = 0; q < 9; ++q )
+        EXPECT_NEAR( f_TRT[ q ], f_BGK[ q ], 1e-15 ) << "direction " << q;
+
+    // at omega = 1 every operator leaves the cell at equilibrium
+    double f_regularized[ 9 ], f_eq[ 9 ];
+
+    test::get_test_cell( f_regularized, 0.1, -0.05 );
+
+    fs::lbm::get_f_eq( f_eq, f_regularized );
+    fs::lbm::collide_regularized( f_regularized, 1.0 );
+
+    for ( size_t q = 0; q < 9; ++q )
+        EXPECT_NEAR( f_regularized[ q ], f_eq[ q ], 1e-15 ) << "direction " << q;
+}
+
+TEST( LBMTests, CollisionPolicyKernels ) {
+
+    using fs::lbm::cs_kernel;
+
+    const std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+    const size_t vec_len = fs::settings::ydim * fs::settings::xdim;
+
+    for ( const cs_kernel kernel : { cs_kernel::split, cs_kernel::fused, cs_kernel::aa, cs_kernel::blocked } ) {
+
+        // MRT with a single rate is BGK
+        EXPECT_LT( max_difference( run_engine<fs::lbm::collision_MRT<fs::lbm::mrt_rates_bgk>>( kernel, 20 ),
+                                   run_engine<fs::lbm::collision_BGK>( kernel, 20 ) ), 1e-12 )
+            << "kernel " << static_cast<int>( kernel );
+    }
+
+    // every kernel applies the policy it is given in the same way, the tolerances are those of the BGK kernel tests
+    const std::vector<double> TRT = run_engine<fs::lbm::collision_TRT>( cs_kernel::fused, 20 );
+    const std::vector<double> regularized = run_engine<fs::lbm::collision_regularized>( cs_kernel::fused, 20 );
+
+    EXPECT_GT( test::max_moment_difference( TRT.data(), run_engine<fs::lbm::collision_BGK>( cs_kernel::fused, 20 ).data(),
+                                            vec_len, barrier.data() ), 1e-9 );
+    EXPECT_GT( test::max_moment_difference( regularized.data(), TRT.data(), vec_len, barrier.data() ), 1e-9 );
+
+    for ( const cs_kernel kernel : { cs_kernel::split, cs_kernel::aa, cs_kernel::blocked } ) {
+
+        const double tolerance = kernel == cs_kernel::split ? 1e-6 : 1e-12;
+
+        EXPECT_LT( test::max_moment_difference( run_engine<fs::lbm::collision_TRT>( kernel, 20 ).data(), TRT.data(),
+                                                vec_len, barrier.data() ), tolerance )
+            << "kernel " << static_cast<int>( kernel );
+        EXPECT_LT( test::max_moment_difference( run_engine<fs::lbm::collision_regularized>( kernel, 20 ).data(), regularized.data(),
+                                                vec_len, barrier.data() ), tolerance )
+            << "kernel " << static_cast<int>( kernel );
+    }
+
+    // the vectorized kernel collides several cells at once with the same policy
+    EXPECT_LT( test::max_moment_difference( run_engine<fs::lbm::collision_TRT, fs::lbm::layout_soa>( cs_kernel::simd, 20 ).data(),
+                                            TRT.data(), vec_len, barrier.data() ), 1e-12 );
+    EXPECT_LT( test::max_moment_difference( run_engine<fs::lbm::collision_regularized, fs::lbm::layout_soa>( cs_kernel::simd, 20 ).data(),
+                                            regularized.data(), vec_len, barrier.data() ), 1e-12 );
+    EXPECT_LT( max_difference( run_engine<fs::lbm::collision_MRT<>, fs::lbm::layout_soa>( cs_kernel::simd, 20 ),
+                               run_engine<fs::lbm::collision_MRT<>>( cs_kernel::fused, 20 ) ), 1e-12 );
+}
@@ -0,0 +1,102 @@
+#ifndef TEST_LBM_CONSTANTS_HPP
+#define TEST_LBM_CONSTANTS_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#include <algorithm>
+#include <vector>
+
+#include <fs/lbm/common.hpp>
+#include <fs/lbm/boundary_conditions.hpp>
+
+namespace test {
+
+    // a small block of obstacle cells in the middle of a ydim x xdim grid
+    inline std::vector<unsigned char> block_obstacle( const size_t ydim, const size_t xdim ) {
+
+        std::vector<unsigned char> obstacle( ydim * xdim, 0 );
+
+        for ( size_t y = ydim / 2 - 3; y < ydim / 2 + 3; ++y ) {
+            for ( size_t x = xdim / 4 - 2; x < xdim / 4 + 2; ++x ) {
+
+                obstacle[ x + y * xdim ] = 1;
+            }
+        }
+
+        return obstacle;
+    }
+
+    // a cell moving at ( u_x, u_y ) and slightly away from equilibrium
+    inline void get_test_cell( double ( &f )[ 9 ], const double u_x, const double u_y ) {
+
+        for ( size_t q = 0; q < 9; ++q )
+            f[ q ] = fs::lbm::calculate_f_eq( q, 1.0, u_x, u_y ) * ( 1.0 + 0.01 * ( ( q * 5 ) % 7 ) );
+    }
+
+    // a ydim x xdim grid in layout_aos at the equilibrium of the free stream of bc
+    inline std::vector<double> free_stream( const size_t ydim, const size_t xdim,
+                                            const fs::lbm::boundary_conditions& bc = fs::lbm::make_boundary_conditions() ) {
+
+        std::vector<double> D2Q9( ydim * xdim * 9 );
+
+        for ( size_t i = 0; i < ydim * xdim; ++i )
+            for ( size_t q = 0; q < 9; ++q )
+                D2Q9[ i * 9 + q ] = bc.f_eq[ q ];
+
+        return D2Q9;
+    }
+
+    // x-velocity of cell ( y, x ) of a D2Q9 grid in layout_aos
+    inline double u_x_at( const std::vector<double>& D2Q9, const size_t xdim, const size_t y, const size_t x ) {
+
+        const double* f = D2Q9.data() + ( x + y * xdim ) * 9;
+
+        double rho = 0.0;
+
+        for ( size_t q = 0; q < 9; ++q )
+            rho += f[ q ];
+
+        return ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho;
+    }
+
+    /*
+        largest difference in density or velocity between two D2Q9 grids, comparing the cells
+        where mask is zero ( all cells if mask is null )
+    */
+    inline double max_moment_difference( const double* a, const double* b, const size_t vec_len,
+                                         const unsigned char* mask = nullptr ) {
+
+        double max_difference{};
+
+        for ( size_t i = 0; i < vec_len; ++i ) {
+
+            if ( mask && mask[ i ] )
+                continue;
+
+            double rho_a{}, rho_b{}, u_x_a{}, u_x_b{}, u_y_a{}, u_y_b{};
+
+            for ( size_t q = 0; q < 9; ++q ) {
+
+                rho_a += a[ i * 9 + q ];
+                rho_b += b[ i * 9 + q ];
+
+                u_x_a += fs::lbm::e[ q ].first * a[ i * 9 + q ];
+                u_x_b += fs::lbm::e[ q ].first * b[ i * 9 + q ];
+
+                u_y_a += fs::lbm::e[ q ].second * a[ i * 9 + q ];
+                u_y_b += fs::lbm::e[ q ].second * b[ i * 9 + q ];
+            }
+
+            max_difference = std::max( { max_difference, 
+                                         std::fabs( rho_a - rho_b ), 
+                                         std::fabs( u_x_a - u_x_b ), 
+                                         std::fabs( u_y_a - u_y_b ) } );
+        }
+
+        return max_difference;
+    }
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, Convergence ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> clear( fs::settings::ydim * fs::settings::xdim, 0 );
+
+    // a uniform flow is already steady
+    for ( const auto field : { fs::lbm::convergence_field::velocity, fs::lbm::convergence_field::density } ) {
+
+        auto uniform = fs::lbm::init_cs_tbb( grid, clear, 0.005, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_grid_boundaries( uniform );
+
+        const auto result = fs::lbm::collide_and_stream_to_convergence_tbb( uniform, { field, 10, 1e-12, 1000 } );
+
+        EXPECT_TRUE( result.converged );
+        EXPECT_EQ( result.steps, 10 );
+        ASSERT_EQ( result.history.size(), 1 );
+        EXPECT_LT( result.history[ 0 ].l_inf, 1e-12 );
+    }
+
+    /*
+        the flow around a block at Re = 2, on a grid small enough for the viscosity to damp the
+        start-up transient in about 10^4 steps. once the change is below 1e-8 a step the field is
+        that of a run ten times as long, to within the residual over the decay rate of the slowest
+        mode, about 1e-5.
+    */
+    const size_t ydim = 24;
+    const size_t xdim = 48;
+    const double viscosity = 0.3;
+
+    std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+    std::vector<unsigned char> block = test::block_obstacle( ydim, xdim );
+
+    auto cs = fs::lbm::init_cs_tbb( D2Q9.data(), block.data(), ydim, xdim, viscosity, fs::lbm::cs_kernel::fused );
+    auto reference = fs::lbm::init_cs_tbb( D2Q9.data(), block.data(), ydim, xdim, viscosity, fs::lbm::cs_kernel::fused );
+
+    fs::lbm::set_grid_boundaries( cs );
+    fs::lbm::set_grid_boundaries( reference );
+
+    const auto result = fs::lbm::collide_and_stream_to_convergence_tbb( cs, { fs::lbm::convergence_field::velocity, 100, 1e-8, 100000 } );
+
+    ASSERT_TRUE( result.converged );
+    EXPECT_EQ( result.steps, result.history.size() * 100 );
+    EXPECT_LT( result.history.back().l2, 1e-8 );
+
+    for ( size_t i = 0; i + 1 < result.history.size(); ++i ) {
+
+        EXPECT_EQ( result.history[ i ].step, ( i + 1 ) * 100 );
+        EXPECT_GE( result.history[ i ].l2, 1e-8 );
+    }
+
+    fs::lbm::stateful_collide_and_stream_tbb( reference, 10 * result.steps );
+
+    std::vector<double> u_x( ydim * xdim ), u_y( ydim * xdim ), u_x_ref( ydim * xdim ), u_y_ref( ydim * xdim );
+
+    fs::lbm::calculate_macroscopic( cs, { nullptr, u_x.data(), u_y.data() } );
+    fs::lbm::calculate_macroscopic( reference, { nullptr, u_x_ref.data(), u_y_ref.data() } );
+
+    double difference_2 = 0.0;
+    double reference_2 = 0.0;
+
+    for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+        if ( block[ i ] )
+            continue;
+
+        difference_2 += ( u_x[ i ] - u_x_ref[ i ] ) * ( u_x[ i ] - u_x_ref[ i ] ) + ( u_y[ i ] - u_y_ref[ i ] ) * ( u_y[ i ] - u_y_ref[ i ] );
+        reference_2 += u_x_ref[ i ] * u_x_ref[ i ] + u_y_ref[ i ] * u_y_ref[ i ];
+    }
+
+    EXPECT_LT( std::sqrt( difference_2 / reference_2 ), 1e-4 );
+
+    // or stops at the limit
+    const auto limited = fs::lbm::collide_and_stream_to_convergence_tbb( cs, { fs::lbm::convergence_field::velocity, 40, 0.0, 100 } );
+
+    EXPECT_FALSE( limited.converged );
+    EXPECT_EQ( limited.steps, 80 );
+    EXPECT_EQ( limited.history.size(), 2 );
+}
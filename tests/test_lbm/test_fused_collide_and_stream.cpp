@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, FusedCollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    auto split = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::split );
+    auto fused = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+    for ( size_t frame = 0; frame < 3; ++frame ) {
+
+        fs::lbm::set_grid_boundaries( split );
+        fs::lbm::set_grid_boundaries( fused );
+
+        fs::lbm::stateful_collide_and_stream_tbb( split, 20 );
+        fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+
+        // split holds pre-collision and fused post-collision distributions, compare what collision conserves
+        EXPECT_LT( test::max_moment_difference( fs::lbm::get_D2Q9( split ), fs::lbm::get_D2Q9( fused ),
+                                                split.vec_len, barrier.data() ), 1e-12 ) << "frame " << frame;
+    }
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+namespace {
+
+    // the weights sum to one and the second moment of the weights is c_s^2 times the identity
+    template<typename L>
+    void expect_isotropic() {
+
+        double w_sum{};
+
+        for ( size_t q = 0; q < L::Q; ++q ) {
+
+            w_sum += L::w[ q ];
+
+            EXPECT_EQ( L::opposite[ L::opposite[ q ] ], q );
+
+            for ( size_t k = 0; k < L::D; ++k )
+                EXPECT_EQ( L::c[ L::opposite[ q ] ][ k ], -L::c[ q ][ k ] );
+        }
+
+        EXPECT_NEAR( w_sum, 1.0, 1e-15 );
+
+        for ( size_t a = 0; a < L::D; ++a ) {
+            for ( size_t b = 0; b < L::D; ++b ) {
+
+                double second{};
+
+                for ( size_t q = 0; q < L::Q; ++q )
+                    second += L::w[ q ] * L::c[ q ][ a ] * L::c[ q ][ b ];
+
+                EXPECT_NEAR( second, a == b ? L::c_s2 : 0.0, 1e-15 ) << "components " << a << " " << b;
+            }
+        }
+    }
+
+    /*
+        a uniform flow on a grid of the given extents, with the edge-cells at the same equilibrium,
+        is left unchanged by the generated kernel
+    */
+    template<typename L>
+    double uniform_flow_drift( const std::array<size_t, L::D>& extents, const size_t steps ) {
+
+        const size_t cells = fs::lbm::lattice_cells( extents );
+
+        std::array<double, L::D> u{};
+
+        u[ 0 ] = 0.1;
+        u[ L::D - 1 ] += 0.05;
+
+        double f_eq[ L::Q ];
+
+        fs::lbm::lattice_f_eq<L>( f_eq, 1.0, u );
+
+        std::vector<double> f( cells * L::Q );
+
+        for ( size_t q = 0; q < L::Q; ++q )
+            std::fill_n( f.begin() + q * cells, cells, f_eq[ q ] );
+
+        std::vector<double> f_n = f;
+        std::vector<unsigned char> obstacle( cells, 0 );
+
+        for ( size_t z = 0; z < steps; ++z ) {
+
+            fs::lbm::lattice_collide_and_stream_tbb<L>( f.data(), f_n.data(), obstacle.data(), extents, 1.2 );
+
+            std::swap( f, f_n );
+        }
+
+        double max_difference{};
+
+        for ( size_t q = 0; q < L::Q; ++q )
+            for ( size_t i = 0; i < cells; ++i )
+                max_difference = std::max( max_difference, std::fabs( f[ q * cells + i ] - f_eq[ q ] ) );
+
+        return max_difference;
+    }
+}
+
+TEST( LBMTests, LatticeDescriptors ) {
+
+    expect_isotropic<fs::lbm::lattice_D2Q9>();
+    expect_isotropic<fs::lbm::lattice_D2Q5>();
+    expect_isotropic<fs::lbm::lattice_D3Q19>();
+
+    // the generated D2Q9 equilibrium and collision are the hand-written ones
+    double f[ 9 ], f_BGK[ 9 ], f_eq[ 9 ];
+
+    fs::lbm::lattice_f_eq<fs::lbm::lattice_D2Q9>( f_eq, 1.1, std::array<double, 2>{ 0.1, -0.05 } );
+
+    for ( size_t q = 0; q < 9; ++q ) {
+
+        EXPECT_NEAR( f_eq[ q ], fs::lbm::calculate_f_eq( q, 1.1, 0.1, -0.05 ), 1e-15 ) << "direction " << q;
+
+        f[ q ] = f_BGK[ q ] = f_eq[ q ] * ( 1.0 + 0.01 * ( ( q * 5 ) % 7 ) );
+    }
+
+    fs::lbm::lattice_collide_BGK<fs::lbm::lattice_D2Q9>( f, 1.5 );
+    fs::lbm::collide_BGK( f_BGK, 1.5 );
+
+    for ( size_t q = 0; q < 9; ++q )
+        EXPECT_NEAR( f[ q ], f_BGK[ q ], 1e-15 ) << "direction " << q;
+}
+
+TEST( LBMTests, LatticeCollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    const size_t ydim = fs::settings::ydim;
+    const size_t xdim = fs::settings::xdim;
+
+    auto fused = fs::lbm::init_cs_tbb<fs::lbm::layout_soa>( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+    auto generated = fs::lbm::init_cs_tbb<fs::lbm::layout_soa>( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+    fs::lbm::set_grid_boundaries( fused );
+    fs::lbm::set_grid_boundaries( generated );
+
+    fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+
+    for ( size_t z = 0; z < 20; ++z ) {
+
+        fs::lbm::lattice_collide_and_stream_tbb<fs::lbm::lattice_D2Q9>( generated.D2Q9, generated.D2Q9_n, generated.obstacle.data(),
+                                                                        { xdim, ydim }, generated.omega );
+
+        std::swap( generated.D2Q9, generated.D2Q9_n );
+    }
+
+    // the generated kernel leaves obstacle cells alone, the fused kernel collides them
+    double max_difference{};
+
+    for ( size_t q = 0; q < 9; ++q ) {
+        for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+            if ( !barrier[ i ] )
+                max_difference = std::max( max_difference, std::fabs( generated.D2Q9[ q * ydim * xdim + i ] - fused.D2Q9[ q * ydim * xdim + i ] ) );
+        }
+    }
+
+    EXPECT_LT( max_difference, 1e-12 );
+
+    EXPECT_LT( uniform_flow_drift<fs::lbm::lattice_D2Q5>( { 40, 30 }, 10 ), 1e-15 );
+    EXPECT_LT( uniform_flow_drift<fs::lbm::lattice_D3Q19>( { 20, 16, 12 }, 10 ), 1e-15 );
+}
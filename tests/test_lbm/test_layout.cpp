@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <vector>
+
+#include "test_constants.hpp"
+
+// every ( y, x, q ) maps to a different element inside the span
+template<typename Layout>
+void expect_unique_mapping( const size_t ydim, const size_t xdim ) {
+
+    const size_t span_size = fs::lbm::lattice_span_size<Layout>( ydim, xdim );
+
+    std::vector<double> data( span_size, 0.0 );
+
+    auto view = fs::lbm::make_lattice_view<Layout>( data.data(), ydim, xdim );
+
+    for ( size_t y = 0; y < ydim; ++y )
+        for ( size_t x = 0; x < xdim; ++x )
+            for ( size_t q = 0; q < 9; ++q )
+                view[ y, x, q ] += 1.0;
+
+    size_t mapped{};
+
+    for ( double d : data ) {
+
+        EXPECT_LE( d, 1.0 );
+
+        mapped += static_cast<size_t>( d );
+    }
+
+    EXPECT_EQ( mapped, ydim * xdim * 9 );
+}
+
+TEST( LBMTests, LayoutMapping ) {
+
+    // 7 x 5 cells doesn't fill a whole number of blocks
+    expect_unique_mapping<fs::lbm::layout_aos>( 7, 5 );
+    expect_unique_mapping<fs::lbm::layout_soa>( 7, 5 );
+    expect_unique_mapping<fs::lbm::layout_aosoa<4>>( 7, 5 );
+    expect_unique_mapping<fs::lbm::layout_aosoa<8>>( 7, 5 );
+}
+
+template<typename Layout>
+void expect_same_as_aos( const fs::lbm::cs_kernel kernel ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    auto aos = fs::lbm::init_cs_tbb( grid, barrier, 0.005, kernel );
+    auto other = fs::lbm::init_cs_tbb<Layout>( grid, barrier, 0.005, kernel );
+
+    std::vector<double> exported( aos.vec_len * 9 );
+
+    for ( size_t frame = 0; frame < 2; ++frame ) {
+
+        fs::lbm::set_grid_boundaries( aos );
+        fs::lbm::set_grid_boundaries( other );
+
+        fs::lbm::stateful_collide_and_stream_tbb( aos, 20 );
+        fs::lbm::stateful_collide_and_stream_tbb( other, 20 );
+
+        fs::lbm::export_D2Q9( other, exported.data() );
+
+        // the kernels do the same arithmetic whatever the layout
+        EXPECT_EQ( test::max_moment_difference( fs::lbm::get_D2Q9( aos ), exported.data(), aos.vec_len ), 0.0 )
+            << "frame " << frame;
+    }
+}
+
+TEST( LBMTests, LayoutCollideAndStream ) {
+
+    for ( auto kernel : { fs::lbm::cs_kernel::split, fs::lbm::cs_kernel::fused, fs::lbm::cs_kernel::aa } ) {
+
+        expect_same_as_aos<fs::lbm::layout_soa>( kernel );
+        expect_same_as_aos<fs::lbm::layout_aosoa<4>>( kernel );
+        expect_same_as_aos<fs::lbm::layout_aosoa<8>>( kernel );
+    }
+}
+
+TEST( LBMTests, LayoutProperty ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    auto aos = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+    auto soa = fs::lbm::init_cs_tbb<fs::lbm::layout_soa>( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+    fs::lbm::stateful_collide_and_stream_tbb( aos, 20 );
+    fs::lbm::stateful_collide_and_stream_tbb( soa, 20 );
+
+    std::vector<double> curl_aos( aos.vec_len, 0.0 );
+    std::vector<double> curl_soa( soa.vec_len, 0.0 );
+
+    fs::lbm::calculate_curl_v_tbb( fs::lbm::get_D2Q9( aos ), curl_aos.data() );
+    fs::lbm::calculate_curl_v_tbb( fs::lbm::get_D2Q9_view( soa ), curl_soa.data() );
+
+    EXPECT_EQ( curl_aos, curl_soa );
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+namespace {
+
+    /*
+        largest difference between the fields a kernel stores on the last step and those read from
+        the grid afterwards
+    */
+    double stored_field_difference( const fs::lbm::cs_kernel kernel, const fs::lbm::boundary_conditions& bc ) {
+
+        sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+        fs::lbm::initialize_grid( grid );
+
+        const size_t vec_len = fs::settings::ydim * fs::settings::xdim;
+
+        std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+        auto cs = fs::lbm::init_cs_tbb( grid, barrier, 0.005, kernel );
+
+        fs::lbm::set_boundary_conditions( cs, bc );
+
+        std::vector<double> rho( vec_len, -1.0 ), u_x( vec_len, -1.0 ), u_y( vec_len, -1.0 );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 20, { rho.data(), u_x.data(), u_y.data() } );
+
+        std::vector<double> rho_read( vec_len ), u_x_read( vec_len ), u_y_read( vec_len );
+
+        fs::lbm::calculate_macroscopic( cs, { rho_read.data(), u_x_read.data(), u_y_read.data() } );
+
+        double max_difference{};
+
+        for ( size_t i = 0; i < vec_len; ++i )
+            max_difference = std::max( { max_difference, std::fabs( rho[ i ] - rho_read[ i ] ),
+                                         std::fabs( u_x[ i ] - u_x_read[ i ] ), std::fabs( u_y[ i ] - u_y_read[ i ] ) } );
+
+        return max_difference;
+    }
+}
+
+TEST( LBMTests, MacroscopicFields ) {
+
+    const auto equilibrium = fs::lbm::make_boundary_conditions();
+    const auto zou_he = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::zero_gradient );
+
+    // the fused kernel stores the moments of the distributions it pulled, which collision conserves
+    EXPECT_LT( stored_field_difference( fs::lbm::cs_kernel::fused, equilibrium ), 1e-14 );
+    EXPECT_LT( stored_field_difference( fs::lbm::cs_kernel::fused, zou_he ), 1e-14 );
+
+    // the others read the grid once the steps are done
+    EXPECT_EQ( stored_field_difference( fs::lbm::cs_kernel::split, zou_he ), 0.0 );
+    EXPECT_EQ( stored_field_difference( fs::lbm::cs_kernel::aa, equilibrium ), 0.0 );
+    EXPECT_EQ( stored_field_difference( fs::lbm::cs_kernel::blocked, equilibrium ), 0.0 );
+
+    // a null field isn't written
+    fs::lbm::macroscopic_fields fields;
+
+    EXPECT_FALSE( fields );
+
+    double rho = -1.0, f[ 9 ];
+
+    for ( size_t q = 0; q < 9; ++q )
+        f[ q ] = fs::lbm::calculate_f_eq( q, 1.2, 0.1, -0.05 );
+
+    fields.rho = &rho;
+    fields.store( 0, f );
+
+    EXPECT_NEAR( rho, 1.2, 1e-15 );
+}
+
+TEST( LBMTests, CurlFromVelocity ) {
+
+    const size_t ydim = 12;
+    const size_t xdim = 17;
+
+    // solid-body rotation u = a ( -y, x ) has a curl of 2a, 4a without the half of the central differences
+    std::vector<double> u_x( ydim * xdim ), u_y( ydim * xdim ), curl( ydim * xdim, 0.0 );
+
+    for ( size_t y = 0; y < ydim; ++y ) {
+        for ( size_t x = 0; x < xdim; ++x ) {
+
+            u_x[ x + y * xdim ] = -0.01 * y;
+            u_y[ x + y * xdim ] = 0.01 * x;
+        }
+    }
+
+    fs::lbm::calculate_curl_tbb( u_x.data(), u_y.data(), curl.data(), ydim, xdim );
+
+    for ( size_t y = 1; y < ydim - 1; ++y )
+        for ( size_t x = 1; x < xdim - 1; ++x )
+            EXPECT_NEAR( curl[ x + y * xdim ], 0.04, 1e-15 );
+
+    EXPECT_EQ( curl[ 0 ], 0.0 );
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, MomentCollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    const size_t ydim = fs::settings::ydim;
+    const size_t xdim = fs::settings::xdim;
+
+    std::vector<unsigned char> barrier = test::block_obstacle( ydim, xdim );
+
+    fs::lbm::boundary_conditions zero_gradient = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::zero_gradient );
+    fs::lbm::boundary_conditions absorbing = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+    absorbing.sponge = { 16, 0.2, 2.0 };
+
+    for ( const fs::lbm::boundary_conditions& bc : { zero_gradient, absorbing } ) {
+
+        // the regularized collision leaves distributions the moments rebuild exactly
+        auto fused = fs::lbm::init_cs_tbb<fs::lbm::layout_aos, double, fs::lbm::collision_regularized>(
+            grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005, fs::lbm::cs_kernel::fused );
+
+        auto moments = fs::lbm::init_moment_cs_tbb( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005 );
+        auto moments_soa = fs::lbm::init_moment_cs_tbb<fs::lbm::layout_soa>( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005 );
+
+        // 6 values a cell instead of 9
+        EXPECT_EQ( moments.span_size * 3, fused.span_size * 2 );
+
+        fs::lbm::set_boundary_conditions( fused, bc );
+        fs::lbm::set_boundary_conditions( moments, bc );
+        fs::lbm::set_boundary_conditions( moments_soa, bc );
+
+        const size_t steps = 100;
+
+        std::vector<double> rho( ydim * xdim ), u_x( ydim * xdim ), u_y( ydim * xdim );
+
+        fs::lbm::stateful_collide_and_stream_tbb( fused, steps );
+        fs::lbm::stateful_collide_and_stream_tbb( moments, steps, { rho.data(), u_x.data(), u_y.data() } );
+        fs::lbm::stateful_collide_and_stream_tbb( moments_soa, steps );
+
+        std::vector<double> D2Q9_moments( ydim * xdim * 9 );
+        std::vector<double> D2Q9_moments_soa( ydim * xdim * 9 );
+
+        fs::lbm::export_D2Q9( moments, D2Q9_moments.data() );
+        fs::lbm::export_D2Q9( moments_soa, D2Q9_moments_soa.data() );
+
+        const double* D2Q9_fused = fs::lbm::get_D2Q9( fused );
+
+        for ( size_t i = 0; i < ydim * xdim * 9; ++i ) {
+
+            ASSERT_NEAR( D2Q9_moments[ i ], D2Q9_fused[ i ], 1e-12 ) << "index " << i;
+            ASSERT_EQ( D2Q9_moments[ i ], D2Q9_moments_soa[ i ] ) << "index " << i;
+        }
+
+        // the stored fields are the moments of the cells
+        for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+            const double* f = D2Q9_fused + i * 9;
+
+            double rho_i = 0.0;
+
+            for ( size_t q = 0; q < 9; ++q )
+                rho_i += f[ q ];
+
+            ASSERT_NEAR( rho[ i ], rho_i, 1e-12 );
+            ASSERT_NEAR( u_x[ i ], ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho_i, 1e-12 );
+            ASSERT_NEAR( u_y[ i ], ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho_i, 1e-12 );
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifdef FS_MPI
+
+#include <gtest/gtest.h>
+
+#include <mpi.h>
+
+#include <fs/lbm/lbm.hpp>
+#include <fs/lbm/mpi_collide_and_stream.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "test_constants.hpp"
+
+/*
+    only built with -DFS_MPI, as its own MPI executable with its own main rather than as part of
+    fs_test, e.g. from the repository root:
+
+        mpicxx -std=c++23 -O2 -DFS_MPI -Iinclude -Iinline -o fs_test_mpi \
+            src/lbm/common.cpp tests/test_lbm/test_mpi_collide_and_stream.cpp -ltbb -lgtest
+        mpirun -np 4 ./fs_test_mpi
+
+    it passes with any number of ranks.
+*/
+
+TEST( LBMTests, MPICollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    const size_t ydim = fs::settings::ydim;
+    const size_t xdim = fs::settings::xdim;
+
+    fs::lbm::boundary_conditions absorbing = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+    absorbing.sponge.width = 16;
+
+    for ( const auto& bc : { fs::lbm::make_boundary_conditions(), absorbing } ) {
+
+        auto cs = fs::lbm::init_mpi_cs( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005 );
+
+        fs::lbm::set_boundary_conditions( cs, bc );
+
+        fs::lbm::stateful_collide_and_stream_mpi( cs, 20 );
+
+        std::vector<double> gathered( cs.rank == 0 ? ydim * xdim * 9 : 0 );
+
+        fs::lbm::gather_D2Q9( cs, gathered.data() );
+
+        if ( cs.rank != 0 )
+            continue;
+
+        // the same fused kernel and boundary conditions on the whole grid, each cell sees the same values in the same order
+        auto fused = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_boundary_conditions( fused, bc );
+
+        fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+
+        double max_difference{};
+
+        for ( size_t i = 0; i < ydim * xdim * 9; ++i )
+            max_difference = std::max( max_difference, std::fabs( gathered[ i ] - fused.D2Q9[ i ] ) );
+
+        EXPECT_EQ( max_difference, 0.0 );
+    }
+
+    // a grid with fewer interior rows than ranks is refused on every rank
+    int ranks;
+
+    MPI_Comm_size( MPI_COMM_WORLD, &ranks );
+
+    const size_t ydim_small = static_cast<size_t>( ranks ) + 1;
+
+    std::vector<double> D2Q9_small = test::free_stream( ydim_small, xdim );
+    std::vector<unsigned char> barrier_small( ydim_small * xdim, 0 );
+
+    EXPECT_THROW( fs::lbm::init_mpi_cs( D2Q9_small.data(), barrier_small.data(), ydim_small, xdim, 0.005 ), std::invalid_argument );
+}
+
+int main( int argc, char** argv ) {
+
+    MPI_Init( &argc, &argv );
+
+    ::testing::InitGoogleTest( &argc, argv );
+
+    int rank;
+
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+
+    // only rank 0 reports
+    if ( rank != 0 )
+        delete ::testing::UnitTest::GetInstance()->listeners().Release( ::testing::UnitTest::GetInstance()->listeners().default_result_printer() );
+
+    const int result = RUN_ALL_TESTS();
+
+    MPI_Finalize();
+
+    return result;
+}
+
+#endif // FS_MPI
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, MultiblockCollideAndStream ) {
+
+    // the free stream crosses two nested blocks unchanged, the rescaling leaves the equilibrium alone
+    {
+        const size_t ydim = 40;
+        const size_t xdim = 80;
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        auto cs = fs::lbm::init_multiblock_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02,
+                                                   { { 10, 30, 20, 50 }, { 5, 35, 10, 50 } } );
+
+        fs::lbm::set_grid_boundaries( cs );
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 50 );
+
+        const fs::lbm::boundary_conditions bc = fs::lbm::make_boundary_conditions();
+
+        for ( size_t l = 0; l < 3; ++l ) {
+
+            const fs::lbm::refinement_level& level = cs.levels[ l ];
+
+            std::vector<double> D2Q9_l( level.ydim * level.xdim * 9 );
+
+            fs::lbm::export_D2Q9( cs, D2Q9_l.data(), l );
+
+            for ( size_t i = 0; i < D2Q9_l.size(); ++i )
+                EXPECT_NEAR( D2Q9_l[ i ], bc.f_eq[ i % 9 ], 1e-12 );
+        }
+    }
+
+    /*
+        a cylinder in a channel. refining a block around it brings the wake closer to the whole grid
+        refined than the coarse grid alone
+    */
+    {
+        const size_t ydim = 41;
+        const size_t xdim = 121;
+
+        const double visc = 0.02;
+        const size_t steps = 400;
+
+        auto cylinder = []( const double y, const double x ) {
+
+            return ( y - 20.3 ) * ( y - 20.3 ) + ( x - 30.0 ) * ( x - 30.0 ) < 4.5 * 4.5;
+        };
+
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        for ( size_t y = 1; y < ydim - 1; ++y )
+            for ( size_t x = 1; x < xdim - 1; ++x )
+                barrier[ x + y * xdim ] = cylinder( y, x );
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+
+        auto coarse = fs::lbm::init_multiblock_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, visc, {} );
+
+        const fs::lbm::refinement_block block = fs::lbm::get_refinement_block( barrier.data(), ydim, xdim, 6 );
+
+        auto refined = fs::lbm::init_multiblock_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, visc, { block }, cylinder );
+
+        // the whole grid at the spacing of the block, twice the steps and twice the viscosity in its units
+        const size_t ydim_f = 2 * ydim - 1;
+        const size_t xdim_f = 2 * xdim - 1;
+
+        std::vector<unsigned char> barrier_f( ydim_f * xdim_f, 0 );
+
+        for ( size_t y = 1; y < ydim_f - 1; ++y )
+            for ( size_t x = 1; x < xdim_f - 1; ++x )
+                barrier_f[ x + y * xdim_f ] = cylinder( 0.5 * y, 0.5 * x );
+
+        std::vector<double> D2Q9_f = test::free_stream( ydim_f, xdim_f );
+
+        auto uniform = fs::lbm::init_multiblock_cs_tbb( D2Q9_f.data(), barrier_f.data(), ydim_f, xdim_f, 2.0 * visc, {} );
+
+        fs::lbm::set_grid_boundaries( coarse );
+        fs::lbm::set_grid_boundaries( refined );
+        fs::lbm::set_grid_boundaries( uniform );
+
+        fs::lbm::stateful_collide_and_stream_tbb( coarse, steps );
+        fs::lbm::stateful_collide_and_stream_tbb( refined, steps );
+        fs::lbm::stateful_collide_and_stream_tbb( uniform, 2 * steps );
+
+        std::vector<double> D2Q9_coarse( ydim * xdim * 9 );
+        std::vector<double> D2Q9_refined( ydim * xdim * 9 );
+
+        fs::lbm::export_D2Q9( coarse, D2Q9_coarse.data() );
+        fs::lbm::export_D2Q9( refined, D2Q9_refined.data() );
+        fs::lbm::export_D2Q9( uniform, D2Q9_f.data() );
+
+        // the wake, behind the cylinder and across the interface
+        double error_coarse = 0.0;
+        double error_refined = 0.0;
+
+        for ( size_t y = 10; y < 31; ++y ) {
+            for ( size_t x = 36; x < 70; ++x ) {
+
+                const double u_x = test::u_x_at( D2Q9_f, xdim_f, 2 * y, 2 * x );
+
+                ASSERT_TRUE( std::isfinite( test::u_x_at( D2Q9_refined, xdim, y, x ) ) );
+
+                error_coarse = std::max( error_coarse, std::abs( test::u_x_at( D2Q9_coarse, xdim, y, x ) - u_x ) );
+                error_refined = std::max( error_refined, std::abs( test::u_x_at( D2Q9_refined, xdim, y, x ) - u_x ) );
+            }
+        }
+
+        EXPECT_LT( error_refined, 0.5 * error_coarse );
+    }
+
+    // the airfoil refined twice, for a fraction of the updates of refining the whole grid twice
+    {
+        const size_t ydim = fs::settings::ydim;
+        const size_t xdim = fs::settings::xdim;
+
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        for ( auto xy : fs::lbm::get_airfoil_coords_aoa( 0.04, 0.4, 0.12, 0.0 ) )
+            barrier[ xy.second + xy.first * xdim ] = 1;
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+
+        const fs::lbm::refinement_block outer = fs::lbm::get_refinement_block( barrier.data(), ydim, xdim, 16 );
+
+        // the inner block, 4 nodes of the coarse grid around the airfoil, in the nodes of the outer one
+        const fs::lbm::refinement_block inner = { 24, 2 * ( outer.y_end - outer.y_begin ) - 24,
+                                                  24, 2 * ( outer.x_end - outer.x_begin ) - 24 };
+
+        auto cs = fs::lbm::init_multiblock_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.005, { outer, inner } );
+
+        fs::lbm::set_grid_boundaries( cs );
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 20 );
+
+        EXPECT_LT( fs::lbm::cell_updates_per_step( cs ), fs::lbm::uniform_cell_updates_per_step( cs ) / 5 );
+
+        const fs::lbm::refinement_level& finest = cs.levels.back();
+
+        std::vector<double> D2Q9_finest( finest.ydim * finest.xdim * 9 );
+
+        fs::lbm::export_D2Q9( cs, D2Q9_finest.data(), 2 );
+
+        for ( const double f : D2Q9_finest )
+            ASSERT_TRUE( std::isfinite( f ) );
+    }
+}
@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+namespace {
+
+    /*
+        the density and velocity along x of the first "columns" columns after "steps" steps of the flow
+        around a cylinder, in a channel of length xdim
+    */
+    std::vector<double> cylinder_wake( const size_t xdim, const fs::lbm::boundary_conditions& bc,
+                                       const size_t steps, const size_t columns ) {
+
+        const size_t ydim = 64;
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim, bc );
+
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        for ( size_t y = 1; y < ydim - 1; ++y )
+            for ( size_t x = 1; x < xdim - 1; ++x )
+                barrier[ x + y * xdim ] = ( y - 31.7 ) * ( y - 31.7 ) + ( x - 40.0 ) * ( x - 40.0 ) < 6.0 * 6.0;
+
+        auto cs = fs::lbm::init_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.005, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_boundary_conditions( cs, bc );
+
+        std::vector<double> rho( ydim * xdim ), u_x( ydim * xdim );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, steps, { rho.data(), u_x.data(), nullptr } );
+
+        std::vector<double> wake;
+
+        for ( size_t y = 0; y < ydim; ++y ) {
+            for ( size_t x = 0; x < columns; ++x ) {
+
+                wake.push_back( rho[ x + y * xdim ] );
+                wake.push_back( u_x[ x + y * xdim ] );
+            }
+        }
+
+        return wake;
+    }
+
+    /*
+        the density of the first "columns" columns after "steps" steps of a free stream with a gaussian
+        pressure pulse at ( 32, 100 ), in a channel of length xdim
+    */
+    std::vector<double> pressure_pulse( const size_t xdim, const fs::lbm::boundary_conditions& bc,
+                                        const size_t steps, const size_t columns ) {
+
+        const size_t ydim = 64;
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim, bc );
+
+        for ( size_t y = 1; y < ydim - 1; ++y ) {
+            for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                const double r2 = ( y - 32.0 ) * ( y - 32.0 ) + ( x - 100.0 ) * ( x - 100.0 );
+
+                double f[ 9 ];
+
+                fs::lbm::get_f_eq( f, bc.rho * ( 1.0 + 1e-3 * std::exp( -r2 / 50.0 ) ), bc.u_x, 0.0 );
+
+                for ( size_t q = 0; q < 9; ++q )
+                    D2Q9[ ( x + y * xdim ) * 9 + q ] = f[ q ];
+            }
+        }
+
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        auto cs = fs::lbm::init_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.005, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_boundary_conditions( cs, bc );
+
+        std::vector<double> rho( ydim * xdim );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, steps, { rho.data(), nullptr, nullptr } );
+
+        std::vector<double> pulse;
+
+        for ( size_t y = 1; y < ydim - 1; ++y )
+            for ( size_t x = 1; x < columns; ++x )
+                pulse.push_back( rho[ x + y * xdim ] );
+
+        return pulse;
+    }
+
+}
+
+TEST( LBMTests, NonReflectingOutlet ) {
+
+    // the free stream passes through the outlet and the sponge layer unchanged
+    {
+        const size_t ydim = 24;
+        const size_t xdim = 48;
+
+        fs::lbm::boundary_conditions bc = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+        bc.sponge = { 16, 0.2, 2.0 };
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim, bc );
+
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        auto cs = fs::lbm::init_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.005, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_boundary_conditions( cs, bc );
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 100 );
+
+        const double* f = fs::lbm::get_D2Q9( cs );
+
+        for ( size_t i = 0; i < D2Q9.size(); ++i )
+            ASSERT_NEAR( f[ i ], bc.f_eq[ i % 9 ], 1e-14 );
+    }
+
+    /*
+        a wake, a deficit of velocity along x varying across the channel at the free-stream density,
+        comes out of the sponge layer unchanged while a density disturbance is damped
+    */
+    {
+        const size_t ydim = 24;
+        const size_t xdim = 48;
+
+        fs::lbm::boundary_conditions bc = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+        bc.sponge = { 16, 0.2, 2.0 };
+
+        auto wake_cell = [&]( const size_t y, const double rho, double ( &f )[ 9 ] ) {
+
+            const double u_x = bc.u_x * ( 1.0 - 0.5 * std::exp( -( y - 12.0 ) * ( y - 12.0 ) / 8.0 ) );
+
+            fs::lbm::get_f_eq( f, rho, u_x, 0.02 * std::sin( 0.5 * y ) );
+        };
+
+        std::vector<double> wake( ydim * xdim * 9 );
+        std::vector<double> disturbed( ydim * xdim * 9 );
+
+        for ( size_t y = 0; y < ydim; ++y ) {
+            for ( size_t x = 0; x < xdim; ++x ) {
+
+                double f[ 9 ], f_d[ 9 ];
+
+                wake_cell( y, bc.rho, f );
+                wake_cell( y, 1.01 * bc.rho, f_d );
+
+                for ( size_t q = 0; q < 9; ++q ) {
+
+                    wake[ ( x + y * xdim ) * 9 + q ] = f[ q ];
+                    disturbed[ ( x + y * xdim ) * 9 + q ] = f_d[ q ];
+                }
+            }
+        }
+
+        const std::vector<double> wake_before = wake;
+        const std::vector<double> disturbed_before = disturbed;
+
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        fs::lbm::apply_sponge_layer( fs::lbm::make_lattice_view<fs::lbm::layout_aos>( wake.data(), ydim, xdim ), barrier.data(), bc );
+        fs::lbm::apply_sponge_layer( fs::lbm::make_lattice_view<fs::lbm::layout_aos>( disturbed.data(), ydim, xdim ), barrier.data(), bc );
+
+        for ( size_t i = 0; i < wake.size(); ++i )
+            ASSERT_NEAR( wake[ i ], wake_before[ i ], 1e-15 ) << "index " << i;
+
+        // the last column of the layer is damped by the full strength, at its own velocity
+        for ( size_t y = 1; y < ydim - 1; ++y ) {
+
+            const size_t x = xdim - 2;
+
+            double rho = 0.0, rho_before = 0.0;
+
+            for ( size_t q = 0; q < 9; ++q ) {
+
+                rho += disturbed[ ( x + y * xdim ) * 9 + q ];
+                rho_before += disturbed_before[ ( x + y * xdim ) * 9 + q ];
+            }
+
+            EXPECT_NEAR( rho - bc.rho, ( 1.0 - 0.2 ) * ( rho_before - bc.rho ), 1e-14 ) << "row " << y;
+            EXPECT_NEAR( test::u_x_at( disturbed, xdim, y, x ), test::u_x_at( disturbed_before, xdim, y, x ), 1e-14 ) << "row " << y;
+        }
+    }
+
+    /*
+        a pressure pulse in the free stream reflects from the characteristic outlet far less than from
+        the equilibrium outlet, measured against a channel long enough for nothing to come back
+    */
+    {
+        const size_t steps = 400;
+        const size_t columns = 180;
+
+        const std::vector<double> rho_non_reflecting = pressure_pulse( 200, fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting ), steps, columns );
+        const std::vector<double> rho_equilibrium = pressure_pulse( 200, fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he ), steps, columns );
+        const std::vector<double> rho = pressure_pulse( 800, fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he ), steps, columns );
+
+        double error_non_reflecting = 0.0;
+        double error_equilibrium = 0.0;
+
+        for ( size_t i = 0; i < rho.size(); ++i ) {
+
+            error_non_reflecting = std::max( error_non_reflecting, std::abs( rho_non_reflecting[ i ] - rho[ i ] ) );
+            error_equilibrium = std::max( error_equilibrium, std::abs( rho_equilibrium[ i ] - rho[ i ] ) );
+        }
+
+        EXPECT_LT( error_non_reflecting, 0.2 * error_equilibrium );
+    }
+
+    /*
+        once the wake of a cylinder has left both channels, the flow close to the cylinder in a channel
+        of 200 cells with the characteristic outlet and a sponge layer is closer to a channel long
+        enough for the outlet not to matter than in a channel twice as long with the equilibrium outlet
+    */
+    {
+        const size_t steps = 6000;
+        const size_t columns = 110;
+
+        fs::lbm::boundary_conditions absorbing = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+        fs::lbm::boundary_conditions equilibrium = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he );
+
+        absorbing.sponge = { 60, 0.05, 2.0 };
+
+        const std::vector<double> wake_short = cylinder_wake( 200, absorbing, steps, columns );
+        const std::vector<double> wake_equilibrium = cylinder_wake( 400, equilibrium, steps, columns );
+        const std::vector<double> wake = cylinder_wake( 1400, equilibrium, steps, columns );
+
+        double error_short = 0.0;
+        double error_equilibrium = 0.0;
+
+        for ( size_t y = 1; y < 63; ++y ) {
+            for ( size_t x = 20; x < columns; ++x ) {
+
+                // the velocity along x
+                const size_t i = ( x + y * columns ) * 2 + 1;
+
+                ASSERT_TRUE( std::isfinite( wake_short[ i ] ) );
+
+                error_short = std::max( error_short, std::abs( wake_short[ i ] - wake[ i ] ) );
+                error_equilibrium = std::max( error_equilibrium, std::abs( wake_equilibrium[ i ] - wake[ i ] ) );
+            }
+        }
+
+        EXPECT_LT( error_short, error_equilibrium );
+    }
+}
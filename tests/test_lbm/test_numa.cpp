@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, NUMAPartitionRows ) {
+
+    fs::lbm::numa_partition numa;
+
+    ASSERT_GE( numa.nodes(), 1 );
+
+    // every row is visited exactly once
+    std::vector<std::atomic<int>> visits( 300 );
+
+    numa.parallel_rows( 1, 299,
+        [&]( const size_t y_begin, const size_t y_end ) {
+
+            for ( size_t y = y_begin; y < y_end; ++y )
+                ++visits[ y ];
+        }
+    );
+
+    for ( size_t y = 0; y < visits.size(); ++y )
+        EXPECT_EQ( visits[ y ].load(), ( y >= 1 && y < 299 ) ? 1 : 0 ) << "row " << y;
+
+    // the nodes' rows tile the range in order
+    size_t y_end = 1;
+
+    for ( size_t node = 0; node < numa.nodes(); ++node ) {
+
+        const auto rows = numa.node_rows( node, 1, 299 );
+
+        EXPECT_EQ( rows.first, y_end );
+
+        y_end = rows.second;
+    }
+
+    EXPECT_EQ( y_end, 299 );
+
+    /*
+        the grid rows are visited exactly once, split as the interior rows, so the interior of each
+        subrange is within the rows of one node
+    */
+    std::vector<std::atomic<int>> grid_visits( 300 );
+    std::atomic<int> split = 0;
+
+    numa.parallel_grid_rows( 300,
+        [&]( const size_t y_begin, const size_t y_end ) {
+
+            for ( size_t y = y_begin; y < y_end; ++y )
+                ++grid_visits[ y ];
+
+            const size_t y_b = std::max<size_t>( y_begin, 1 );
+            const size_t y_e = std::min<size_t>( y_end, 299 );
+
+            bool within = false;
+
+            for ( size_t node = 0; node < numa.nodes(); ++node ) {
+
+                const auto rows = numa.node_rows( node, 1, 299 );
+
+                within = within || ( rows.first <= y_b && y_e <= rows.second );
+            }
+
+            if ( !within )
+                ++split;
+        }
+    );
+
+    for ( size_t y = 0; y < grid_visits.size(); ++y )
+        EXPECT_EQ( grid_visits[ y ].load(), 1 ) << "row " << y;
+
+    EXPECT_EQ( split.load(), 0 );
+}
+
+TEST( LBMTests, NUMABandwidth ) {
+
+    fs::lbm::numa_partition numa;
+
+    const std::vector<double> ceiling = fs::lbm::numa_triad_ceiling( numa, size_t( 1 ) << 16, 2 );
+
+    ASSERT_EQ( ceiling.size(), numa.nodes() );
+
+    for ( const double gb_s : ceiling )
+        EXPECT_GT( gb_s, 0.0 );
+
+    const size_t ydim = 64;
+    const size_t xdim = 128;
+
+    std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+    std::vector<unsigned char> barrier = test::block_obstacle( ydim, xdim );
+
+    auto cs = fs::lbm::init_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02, fs::lbm::cs_kernel::fused );
+
+    const std::vector<double> achieved = fs::lbm::numa_kernel_bandwidth( cs, 10 );
+
+    ASSERT_EQ( achieved.size(), cs.numa.nodes() );
+
+    for ( const double gb_s : achieved )
+        EXPECT_GT( gb_s, 0.0 );
+}
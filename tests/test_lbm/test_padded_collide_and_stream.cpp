@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+#include <vector>
+
+#include "test_constants.hpp"
+
+namespace {
+
+    // equilibrium of a shear flow u_x( y ) at unit density
+    template<typename U>
+    std::vector<double> shear_flow( const size_t ydim, const size_t xdim, U u_x ) {
+
+        std::vector<double> D2Q9( ydim * xdim * 9 );
+
+        for ( size_t y = 0; y < ydim; ++y )
+            for ( size_t x = 0; x < xdim; ++x )
+                for ( size_t q = 0; q < 9; ++q )
+                    D2Q9[ ( x + y * xdim ) * 9 + q ] = fs::lbm::calculate_f_eq( q, 1.0, u_x( y ), 0.0 );
+
+        return D2Q9;
+    }
+
+}
+
+TEST( LBMTests, PaddedCollideAndStream ) {
+
+    /*
+        the ghost ring in place of the edge-cells: the grid without its edges updates as the interior
+        of cs_state_tbb, to rounding, the two kernels don't compute in the same order and the compiler
+        may contract either into fused multiply-adds
+    */
+    {
+        const size_t ydim = 60;
+        const size_t xdim = 150;
+
+        std::vector<unsigned char> barrier = test::block_obstacle( ydim, xdim );
+
+        const fs::lbm::boundary_conditions bc = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::zero_gradient );
+
+        std::vector<double> D2Q9 = shear_flow( ydim, xdim, []( size_t ) { return 0.1; } );
+
+        std::vector<double> D2Q9_i( ( ydim - 2 ) * ( xdim - 2 ) * 9 );
+        std::vector<unsigned char> barrier_i( ( ydim - 2 ) * ( xdim - 2 ) );
+
+        for ( size_t y = 1; y < ydim - 1; ++y ) {
+            for ( size_t x = 1; x < xdim - 1; ++x ) {
+
+                const size_t i = ( x - 1 ) + ( y - 1 ) * ( xdim - 2 );
+
+                barrier_i[ i ] = barrier[ x + y * xdim ];
+
+                for ( size_t q = 0; q < 9; ++q )
+                    D2Q9_i[ i * 9 + q ] = D2Q9[ ( x + y * xdim ) * 9 + q ];
+            }
+        }
+
+        auto fused = fs::lbm::init_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, 0.02, fs::lbm::cs_kernel::fused );
+        auto padded = fs::lbm::init_padded_cs_tbb( D2Q9_i.data(), barrier_i.data(), ydim - 2, xdim - 2, 0.02, fs::lbm::make_ghost_boundaries( bc ) );
+
+        fs::lbm::set_boundary_conditions( fused, bc );
+
+        fs::lbm::stateful_collide_and_stream_tbb( fused, 150 );
+        fs::lbm::stateful_collide_and_stream_tbb( padded, 150 );
+
+        fs::lbm::export_D2Q9( padded, D2Q9_i.data() );
+
+        const double* D2Q9_fused = fs::lbm::get_D2Q9( fused );
+
+        double max_difference = 0.0;
+
+        for ( size_t y = 1; y < ydim - 1; ++y )
+            for ( size_t x = 1; x < xdim - 1; ++x )
+                for ( size_t q = 0; q < 9; ++q )
+                    max_difference = std::max( max_difference, std::abs( D2Q9_i[ ( ( x - 1 ) + ( y - 1 ) * ( xdim - 2 ) ) * 9 + q ] - D2Q9_fused[ ( x + y * xdim ) * 9 + q ] ) );
+
+        EXPECT_LT( max_difference, 1e-13 );
+    }
+
+    // the ghost ring has no non_reflecting outlet or sponge layer
+    {
+        fs::lbm::boundary_conditions bc = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+        EXPECT_THROW( fs::lbm::make_ghost_boundaries( bc ), std::invalid_argument );
+
+        bc.outlet = fs::lbm::outlet_bc::zero_gradient;
+        bc.sponge.width = 16;
+
+        EXPECT_THROW( fs::lbm::make_ghost_boundaries( bc ), std::invalid_argument );
+    }
+
+    const double visc = 0.05;
+    const double u_0 = 0.01;
+    const size_t steps = 500;
+
+    auto mass = []( const std::vector<double>& D2Q9 ) {
+
+        double m = 0.0;
+
+        for ( const double f : D2Q9 )
+            m += f;
+
+        return m;
+    };
+
+    /*
+        a shear wave across a box periodic on every side decays at the rate of the viscosity,
+        exp( -nu k^2 t ), without losing mass
+    */
+    {
+        const size_t ydim = 32;
+        const size_t xdim = 8;
+
+        const double k = 2.0 * std::numbers::pi / ydim;
+
+        std::vector<double> D2Q9 = shear_flow( ydim, xdim, [&]( size_t y ) { return u_0 * std::sin( k * y ); } );
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        fs::lbm::ghost_boundaries gb = fs::lbm::make_periodic_channel();
+
+        gb.top = gb.bottom = fs::lbm::ghost_fill::periodic;
+
+        auto cs = fs::lbm::init_padded_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, visc, gb );
+
+        const double m = mass( D2Q9 );
+
+        std::vector<double> u_x( ydim * xdim );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, steps, { nullptr, u_x.data(), nullptr } );
+
+        fs::lbm::export_D2Q9( cs, D2Q9.data() );
+
+        EXPECT_NEAR( mass( D2Q9 ), m, 1e-12 * m );
+
+        const double decay = std::exp( -visc * k * k * steps );
+
+        for ( size_t y = 0; y < ydim; ++y )
+            for ( size_t x = 0; x < xdim; ++x )
+                EXPECT_NEAR( u_x[ x + y * xdim ], u_0 * decay * std::sin( k * y ), 0.01 * u_0 * decay );
+    }
+
+    /*
+        between the walls of a periodic channel the slowest mode, sin( pi ( y + 1/2 ) / ydim ) with the
+        walls half-way between the grid and the ghost cells, decays as exp( -nu ( pi / ydim )^2 t )
+    */
+    {
+        const size_t ydim = 24;
+        const size_t xdim = 8;
+
+        const double k = std::numbers::pi / ydim;
+
+        std::vector<double> D2Q9 = shear_flow( ydim, xdim, [&]( size_t y ) { return u_0 * std::sin( k * ( y + 0.5 ) ); } );
+        std::vector<unsigned char> barrier( ydim * xdim, 0 );
+
+        auto cs = fs::lbm::init_padded_cs_tbb( D2Q9.data(), barrier.data(), ydim, xdim, visc, fs::lbm::make_periodic_channel() );
+
+        const double m = mass( D2Q9 );
+
+        std::vector<double> u_x( ydim * xdim );
+
+        fs::lbm::stateful_collide_and_stream_tbb( cs, steps, { nullptr, u_x.data(), nullptr } );
+
+        fs::lbm::export_D2Q9( cs, D2Q9.data() );
+
+        EXPECT_NEAR( mass( D2Q9 ), m, 1e-12 * m );
+
+        const double decay = std::exp( -visc * k * k * steps );
+
+        for ( size_t y = 0; y < ydim; ++y )
+            for ( size_t x = 0; x < xdim; ++x )
+                EXPECT_NEAR( u_x[ x + y * xdim ], u_0 * decay * std::sin( k * ( y + 0.5 ) ), 0.02 * u_0 * decay );
+    }
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <vector>
+
+#include "test_constants.hpp"
+
+// largest moment difference from the double kernel over a few frames
+template<typename Storage>
+double storage_error( const fs::lbm::cs_kernel kernel ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    auto reference = fs::lbm::init_cs_tbb( grid, barrier, 0.005, kernel );
+    auto reduced = fs::lbm::init_cs_tbb<fs::lbm::layout_aos, Storage>( grid, barrier, 0.005, kernel );
+
+    std::vector<double> exported( reference.vec_len * 9 );
+
+    double max_difference{};
+
+    for ( size_t frame = 0; frame < 5; ++frame ) {
+
+        fs::lbm::set_grid_boundaries( reference );
+        fs::lbm::set_grid_boundaries( reduced );
+
+        fs::lbm::stateful_collide_and_stream_tbb( reference, 20 );
+        fs::lbm::stateful_collide_and_stream_tbb( reduced, 20 );
+
+        fs::lbm::export_D2Q9( reduced, exported.data() );
+
+        max_difference = std::max( max_difference, test::max_moment_difference( fs::lbm::get_D2Q9( reference ), exported.data(),
+                                                                                reference.vec_len, barrier.data() ) );
+    }
+
+    return max_difference;
+}
+
+TEST( LBMTests, FloatStorage ) {
+
+    static_assert( sizeof( fs::lbm::cs_state_tbb<fs::lbm::layout_aos, float>::storage_type ) == 4 );
+
+    EXPECT_LT( storage_error<float>( fs::lbm::cs_kernel::fused ), 1e-6 );
+    EXPECT_LT( storage_error<float>( fs::lbm::cs_kernel::aa ), 1e-6 );
+}
+
+#ifdef __FLT16_MAX__
+TEST( LBMTests, Float16Storage ) {
+
+    static_assert( sizeof( fs::lbm::cs_state_tbb<fs::lbm::layout_aos, fs::lbm::float16>::storage_type ) == 2 );
+
+    EXPECT_LT( storage_error<fs::lbm::float16>( fs::lbm::cs_kernel::fused ), 2e-3 );
+    EXPECT_LT( storage_error<fs::lbm::float16>( fs::lbm::cs_kernel::aa ), 2e-3 );
+}
+#endif
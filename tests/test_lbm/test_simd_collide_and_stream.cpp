@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, SIMDCollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    std::vector<unsigned char> barrier = test::block_obstacle( fs::settings::ydim, fs::settings::xdim );
+
+    const size_t ydim = fs::settings::ydim;
+    const size_t xdim = fs::settings::xdim;
+    const size_t vec_len = ydim * xdim;
+
+    std::vector<double> exported( vec_len * 9 );
+
+    // a state with the simd kernel, at the instruction set of the CPU, against a separate fused state
+    {
+        auto fused = fs::lbm::init_cs_tbb<fs::lbm::layout_soa>( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+        auto simd = fs::lbm::init_cs_tbb<fs::lbm::layout_soa>( grid, barrier, 0.005, fs::lbm::cs_kernel::simd );
+
+        ASSERT_EQ( simd.kernel, fs::lbm::cs_kernel::simd );
+
+        for ( size_t frame = 0; frame < 3; ++frame ) {
+
+            fs::lbm::set_grid_boundaries( fused );
+            fs::lbm::set_grid_boundaries( simd );
+
+            fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+            fs::lbm::stateful_collide_and_stream_tbb( simd, 20 );
+
+            // fused multiply-add and the order of operations may differ from the scalar kernel
+            double max_difference{};
+
+            for ( size_t i = 0; i < vec_len * 9; ++i )
+                max_difference = std::max( max_difference, std::fabs( simd.D2Q9[ i ] - fused.D2Q9[ i ] ) );
+
+            EXPECT_LT( max_difference, 1e-12 ) << "frame " << frame;
+        }
+    }
+
+    // the simd kernel only runs on layout_soa with double storage, it isn't taken on another state
+    {
+        EXPECT_THROW( fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::simd ), std::invalid_argument );
+        EXPECT_THROW( ( fs::lbm::init_cs_tbb<fs::lbm::layout_soa, float>( grid, barrier, 0.005, fs::lbm::cs_kernel::simd ) ), std::invalid_argument );
+
+        auto fused = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+        EXPECT_THROW( fs::lbm::set_kernel( fused, fs::lbm::cs_kernel::simd ), std::invalid_argument );
+        EXPECT_EQ( fused.kernel, fs::lbm::cs_kernel::fused );
+    }
+
+    // each instruction set the CPU supports, through the kernel entry point on the buffers of a simd state
+    for ( auto isa : { fs::lbm::simd_isa::scalar, fs::lbm::simd_isa::sse4_2, fs::lbm::simd_isa::avx2, fs::lbm::simd_isa::avx512 } ) {
+
+        if ( !fs::lbm::simd_isa_supported( isa ) )
+            continue;
+
+        // the current kernel
+        auto split = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::split );
+        auto fused = fs::lbm::init_cs_tbb<fs::lbm::layout_soa>( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+        auto simd = fs::lbm::init_cs_tbb<fs::lbm::layout_soa>( grid, barrier, 0.005, fs::lbm::cs_kernel::simd );
+
+        for ( size_t frame = 0; frame < 3; ++frame ) {
+
+            fs::lbm::set_grid_boundaries( split );
+            fs::lbm::set_grid_boundaries( fused );
+            fs::lbm::set_grid_boundaries( simd );
+
+            fs::lbm::stateful_collide_and_stream_tbb( split, 20 );
+            fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+
+            for ( size_t z = 0; z < 20; ++z ) {
+
+                fs::lbm::fused_collide_and_stream_simd_tbb( simd.D2Q9, simd.D2Q9_n, simd.obstacle.data(), ydim, xdim, simd.omega, isa );
+
+                std::swap( simd.D2Q9, simd.D2Q9_n );
+            }
+
+            // fused multiply-add and the order of operations may differ from the scalar kernel
+            double max_difference{};
+
+            for ( size_t i = 0; i < vec_len * 9; ++i )
+                max_difference = std::max( max_difference, std::fabs( simd.D2Q9[ i ] - fused.D2Q9[ i ] ) );
+
+            EXPECT_LT( max_difference, 1e-12 ) << "isa " << static_cast<int>( isa ) << " frame " << frame;
+
+            fs::lbm::export_D2Q9( simd, exported.data() );
+
+            EXPECT_LT( test::max_moment_difference( fs::lbm::get_D2Q9( split ), exported.data(), vec_len, barrier.data() ), 1e-12 )
+                << "isa " << static_cast<int>( isa ) << " frame " << frame;
+        }
+    }
+}
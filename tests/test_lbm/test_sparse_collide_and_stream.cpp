@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, SparseCollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    const size_t ydim = fs::settings::ydim;
+    const size_t xdim = fs::settings::xdim;
+
+    std::vector<unsigned char> barrier = test::block_obstacle( ydim, xdim );
+
+    // a large solid body whose tiles aren't stored, with edges that don't line up with the tiles
+    for ( size_t y = 37; y < ydim - 41; ++y )
+        for ( size_t x = xdim / 2 + 3; x < xdim - 29; ++x )
+            barrier[ x + y * xdim ] = 1;
+
+    fs::lbm::boundary_conditions absorbing = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+    absorbing.sponge.width = 16;
+
+    // the boundary conditions are applied every step, as by the fused engine
+    for ( const auto& bc : { fs::lbm::make_boundary_conditions(), absorbing } ) {
+
+        auto fused = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+        auto sparse = fs::lbm::init_sparse_cs_tbb( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005 );
+
+        EXPECT_LT( sparse.tiles(), sparse.tiles_y * sparse.tiles_x );
+
+        fs::lbm::set_boundary_conditions( fused, bc );
+        fs::lbm::set_boundary_conditions( sparse, bc );
+
+        std::vector<double> D2Q9_fused( ydim * xdim * 9 );
+        std::vector<double> D2Q9_sparse( ydim * xdim * 9 );
+
+        for ( size_t frame = 0; frame < 3; ++frame ) {
+
+            fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+            fs::lbm::stateful_collide_and_stream_tbb( sparse, 20 );
+
+            fs::lbm::export_D2Q9( fused, D2Q9_fused.data() );
+            fs::lbm::export_D2Q9( sparse, D2Q9_sparse.data() );
+
+            /*
+                the fluid cells are updated as by the fused kernel, to rounding, the tile kernel isn't the
+                same instruction stream and the compiler may contract either into fused multiply-adds
+            */
+            double max_difference = 0.0;
+
+            for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+                if ( barrier[ i ] )
+                    continue;
+
+                for ( size_t q = 0; q < 9; ++q )
+                    max_difference = std::max( max_difference, std::abs( D2Q9_fused[ i * 9 + q ] - D2Q9_sparse[ i * 9 + q ] ) );
+            }
+
+            EXPECT_LT( max_difference, 1e-13 ) << "frame " << frame;
+        }
+    }
+}
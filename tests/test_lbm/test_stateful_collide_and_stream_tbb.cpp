@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <cmath>
+
+#include <vector>
+
+TEST( LBMTests, StatefulCollideAndStreamTBB ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> stateful_grid( fs::lbm::D2Q9_states );
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> stateless_grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( stateful_grid );
+    fs::lbm::initialize_grid( stateless_grid );
+
+    std::vector<unsigned char> barrier( fs::settings::ydim * fs::settings::xdim, 0 );
+
+    barrier[ 100 + 100 * fs::settings::xdim ] = 1;
+    barrier[ 101 + 100 * fs::settings::xdim ] = 1;
+    barrier[ 100 + 101 * fs::settings::xdim ] = 1;
+
+    auto cs = fs::lbm::init_cs_tbb( stateful_grid, barrier, 0.005 );
+
+    // two frames, so the second call starts from whichever buffer the first one left current
+    for ( size_t frame = 0; frame < 2; ++frame ) {
+
+        fs::lbm::set_boundaries( stateless_grid );
+        fs::lbm::set_grid_boundaries( cs );
+
+        fs::lbm::collide_and_stream_tbb( stateless_grid.get_data_handle(), barrier.data(), 20 );
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 20 );
+
+        const double* stateful = fs::lbm::get_D2Q9( cs );
+        const double* stateless = stateless_grid.get_data_handle();
+
+        size_t mismatches = 0;
+
+        for ( size_t i = 0; i < fs::settings::ydim * fs::settings::xdim * 9; ++i ) {
+
+            if ( std::fabs( stateful[ i ] - stateless[ i ] ) > 1e-12 )
+                ++mismatches;
+        }
+
+        ASSERT_EQ( mismatches, 0 ) << "stateful and stateless results differ after frame " << frame;
+    }
+}
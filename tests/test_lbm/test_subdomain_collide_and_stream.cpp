@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <settings.hpp>
+#include <grid.hpp>
+
+#include <vector>
+
+#include "test_constants.hpp"
+
+TEST( LBMTests, SubdomainCollideAndStream ) {
+
+    sim::grid<std::vector<double>, fs::lbm::D2Q9_view> grid( fs::lbm::D2Q9_states );
+
+    fs::lbm::initialize_grid( grid );
+
+    const size_t ydim = fs::settings::ydim;
+    const size_t xdim = fs::settings::xdim;
+
+    std::vector<unsigned char> barrier = test::block_obstacle( ydim, xdim );
+
+    auto fused = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+
+    // more subdomains than the machine may have threads, and one per row of a thin slab
+    auto subdomains = fs::lbm::init_subdomain_cs_tbb( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005,
+                                                      fs::lbm::subdomain_balance::rows, 5 );
+    auto thin = fs::lbm::init_subdomain_cs_tbb( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005,
+                                                fs::lbm::subdomain_balance::rows, ydim - 2 );
+
+    fs::lbm::set_grid_boundaries( fused );
+    fs::lbm::set_grid_boundaries( subdomains );
+    fs::lbm::set_grid_boundaries( thin );
+
+    std::vector<double> D2Q9_fused( ydim * xdim * 9 );
+    std::vector<double> D2Q9_subdomains( ydim * xdim * 9 );
+
+    // the halo exchange gives every cell what the fused kernel pulls on the whole grid
+    auto expect_equal = [&]( const fs::lbm::subdomain_cs_state_tbb& cs ) {
+
+        fs::lbm::export_D2Q9( fused, D2Q9_fused.data() );
+        fs::lbm::export_D2Q9( cs, D2Q9_subdomains.data() );
+
+        EXPECT_EQ( D2Q9_fused, D2Q9_subdomains );
+    };
+
+    fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+    fs::lbm::stateful_collide_and_stream_tbb( subdomains, 20 );
+    fs::lbm::stateful_collide_and_stream_tbb( thin, 20 );
+
+    expect_equal( subdomains );
+    expect_equal( thin );
+
+    // subdomain 0 took three times as long per row, so it gets fewer rows and the others more
+    for ( auto& sd : subdomains.subdomains )
+        sd.seconds = sd.rows();
+
+    subdomains.subdomains[ 0 ].seconds *= 3.0;
+
+    const size_t rows_0 = subdomains.subdomains[ 0 ].rows();
+
+    EXPECT_TRUE( fs::lbm::rebalance_subdomains( subdomains ) );
+
+    EXPECT_EQ( subdomains.subdomains.size(), 5 );
+    EXPECT_LT( subdomains.subdomains[ 0 ].rows(), rows_0 / 2 );
+    EXPECT_EQ( subdomains.subdomains.front().y_begin, 1 );
+    EXPECT_EQ( subdomains.subdomains.back().y_end, ydim - 1 );
+
+    for ( size_t k = 1; k < 5; ++k )
+        EXPECT_EQ( subdomains.subdomains[ k ].y_begin, subdomains.subdomains[ k - 1 ].y_end );
+
+    // within the tolerance nothing changes
+    for ( auto& sd : subdomains.subdomains )
+        sd.seconds = 1.0;
+
+    EXPECT_FALSE( fs::lbm::rebalance_subdomains( subdomains ) );
+
+    // the split moved, the results didn't
+    fs::lbm::stateful_collide_and_stream_tbb( fused, 20 );
+    fs::lbm::stateful_collide_and_stream_tbb( subdomains, 20 );
+
+    expect_equal( subdomains );
+
+    // rebalancing as it runs gives the same results too
+    auto measured = fs::lbm::init_subdomain_cs_tbb( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005,
+                                                    fs::lbm::subdomain_balance::measured, 3 );
+
+    fs::lbm::set_grid_boundaries( measured );
+
+    fs::lbm::stateful_collide_and_stream_tbb( measured, 40 + 2 * fs::lbm::rebalance_steps + 10 );
+
+    fs::lbm::stateful_collide_and_stream_tbb( fused, 2 * fs::lbm::rebalance_steps + 10 );
+
+    expect_equal( measured );
+
+    // the boundary conditions are applied every step, as by the fused engine
+    fs::lbm::boundary_conditions absorbing = fs::lbm::make_boundary_conditions( fs::lbm::inlet_bc::zou_he, fs::lbm::outlet_bc::non_reflecting );
+
+    absorbing.sponge.width = 16;
+
+    auto fused_absorbing = fs::lbm::init_cs_tbb( grid, barrier, 0.005, fs::lbm::cs_kernel::fused );
+    auto thin_absorbing = fs::lbm::init_subdomain_cs_tbb( grid.get_data_handle(), barrier.data(), ydim, xdim, 0.005,
+                                                          fs::lbm::subdomain_balance::rows, ydim - 2 );
+
+    fs::lbm::set_boundary_conditions( fused_absorbing, absorbing );
+    fs::lbm::set_boundary_conditions( thin_absorbing, absorbing );
+
+    fs::lbm::stateful_collide_and_stream_tbb( fused_absorbing, 40 );
+    fs::lbm::stateful_collide_and_stream_tbb( thin_absorbing, 40 );
+
+    fs::lbm::export_D2Q9( fused_absorbing, D2Q9_fused.data() );
+    fs::lbm::export_D2Q9( thin_absorbing, D2Q9_subdomains.data() );
+
+    EXPECT_EQ( D2Q9_fused, D2Q9_subdomains );
+}
@@ -0,0 +1,214 @@
+#include <gtest/gtest.h>
+
+#include <fs/lbm/lbm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "test_constants.hpp"
+
+namespace {
+
+    std::vector<unsigned char> cylinder( const size_t ydim, const size_t xdim, const double c_y, const double c_x, const double r ) {
+
+        std::vector<unsigned char> obstacle( ydim * xdim, 0 );
+
+        for ( size_t y = 1; y < ydim - 1; ++y )
+            for ( size_t x = 1; x < xdim - 1; ++x )
+                obstacle[ x + y * xdim ] = ( y - c_y ) * ( y - c_y ) + ( x - c_x ) * ( x - c_x ) < r * r;
+
+        return obstacle;
+    }
+
+    void moments( const double* f, double& rho, double& u_x, double& u_y ) {
+
+        rho = 0.0;
+
+        for ( size_t q = 0; q < 9; ++q )
+            rho += f[ q ];
+
+        u_x = ( f[ 1 ] + f[ 5 ] + f[ 8 ] - f[ 3 ] - f[ 6 ] - f[ 7 ] ) / rho;
+        u_y = ( f[ 2 ] + f[ 5 ] + f[ 6 ] - f[ 4 ] - f[ 7 ] - f[ 8 ] ) / rho;
+    }
+
+    // run from D2Q9 until the velocity stops changing, leaving the result in D2Q9
+    size_t converge( std::vector<double>& D2Q9, const std::vector<unsigned char>& obstacle,
+                     const size_t ydim, const size_t xdim, const double visc ) {
+
+        auto cs = fs::lbm::init_cs_tbb( D2Q9.data(), obstacle.data(), ydim, xdim, visc, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_grid_boundaries( cs );
+
+        const fs::lbm::convergence_result result = fs::lbm::collide_and_stream_to_convergence_tbb( cs, { fs::lbm::convergence_field::velocity, 100, 1e-6, 20000 } );
+
+        EXPECT_TRUE( result.converged );
+
+        fs::lbm::export_D2Q9( cs, D2Q9.data() );
+
+        return result.steps;
+    }
+
+}
+
+TEST( LBMTests, WarmStart ) {
+
+    const size_t ydim = 64;
+    const size_t xdim = 192;
+
+    const fs::lbm::boundary_conditions bc = fs::lbm::make_boundary_conditions();
+
+    /*
+        the obstacle moved: cells fluid before and after are copied, the new obstacle cells are the
+        free stream and the cells it uncovered are filled from the cells around them
+    */
+    {
+        const std::vector<unsigned char> before = cylinder( ydim, xdim, 31.7, 40.0, 6.0 );
+        const std::vector<unsigned char> after = cylinder( ydim, xdim, 33.7, 42.0, 6.0 );
+
+        std::vector<double> D2Q9 = test::free_stream( ydim, xdim );
+
+        auto cs = fs::lbm::init_cs_tbb( D2Q9.data(), before.data(), ydim, xdim, 0.05, fs::lbm::cs_kernel::fused );
+
+        fs::lbm::set_grid_boundaries( cs );
+        fs::lbm::stateful_collide_and_stream_tbb( cs, 300 );
+        fs::lbm::export_D2Q9( cs, D2Q9.data() );
+
+        std::vector<double> D2Q9_warm( ydim * xdim * 9 );
+
+        fs::lbm::warm_start_D2Q9( D2Q9.data(), before.data(), ydim, xdim, D2Q9_warm.data(), after.data(), ydim, xdim );
+
+        // the range of the density before
+        double rho_min = 2.0;
+        double rho_max = 0.0;
+
+        for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+            if ( before[ i ] )
+                continue;
+
+            double rho, u_x, u_y;
+
+            moments( D2Q9.data() + i * 9, rho, u_x, u_y );
+
+            rho_min = std::min( rho_min, rho );
+            rho_max = std::max( rho_max, rho );
+        }
+
+        size_t uncovered = 0;
+
+        for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+            const double* f = D2Q9_warm.data() + i * 9;
+
+            if ( after[ i ] ) {
+
+                for ( size_t q = 0; q < 9; ++q )
+                    ASSERT_EQ( f[ q ], bc.f_eq[ q ] );
+
+            } else if ( !before[ i ] ) {
+
+                for ( size_t q = 0; q < 9; ++q )
+                    ASSERT_EQ( f[ q ], D2Q9[ i * 9 + q ] );
+
+            } else {
+
+                ++uncovered;
+
+                double rho, u_x, u_y;
+
+                moments( f, rho, u_x, u_y );
+
+                // within the field around, and slower than the free stream next to the obstacle
+                EXPECT_GE( rho, rho_min );
+                EXPECT_LE( rho, rho_max );
+                EXPECT_LT( std::abs( u_x ), bc.u_x );
+                EXPECT_LT( std::abs( u_y ), bc.u_x );
+            }
+        }
+
+        EXPECT_GT( uncovered, 0 );
+    }
+
+    // a linear field is interpolated exactly onto grids of other dimensions
+    {
+        const size_t ydim_prev = 21;
+        const size_t xdim_prev = 41;
+
+        auto u_x = []( const double y, const double x ) { return 0.05 + 0.001 * x + 0.0005 * y; };
+        auto u_y = []( const double y, const double x ) { return 0.002 * x - 0.001 * y; };
+
+        std::vector<double> D2Q9_prev( ydim_prev * xdim_prev * 9 );
+        std::vector<unsigned char> obstacle_prev( ydim_prev * xdim_prev, 0 );
+
+        for ( size_t y = 0; y < ydim_prev; ++y )
+            for ( size_t x = 0; x < xdim_prev; ++x )
+                for ( size_t q = 0; q < 9; ++q )
+                    D2Q9_prev[ ( x + y * xdim_prev ) * 9 + q ] = fs::lbm::calculate_f_eq( q, 1.0, u_x( y, x ), u_y( y, x ) );
+
+        for ( const auto& [ ydim_n, xdim_n ] : { std::pair<size_t, size_t>{ 41, 81 }, { 30, 50 } } ) {
+
+            std::vector<double> D2Q9( ydim_n * xdim_n * 9 );
+            std::vector<unsigned char> obstacle( ydim_n * xdim_n, 0 );
+
+            fs::lbm::warm_start_D2Q9( D2Q9_prev.data(), obstacle_prev.data(), ydim_prev, xdim_prev, D2Q9.data(), obstacle.data(), ydim_n, xdim_n );
+
+            for ( size_t y = 0; y < ydim_n; ++y ) {
+                for ( size_t x = 0; x < xdim_n; ++x ) {
+
+                    const double y_p = static_cast<double>( y ) * ( ydim_prev - 1 ) / ( ydim_n - 1 );
+                    const double x_p = static_cast<double>( x ) * ( xdim_prev - 1 ) / ( xdim_n - 1 );
+
+                    double rho, u_x_c, u_y_c;
+
+                    moments( D2Q9.data() + ( x + y * xdim_n ) * 9, rho, u_x_c, u_y_c );
+
+                    ASSERT_NEAR( rho, 1.0, 1e-14 );
+                    ASSERT_NEAR( u_x_c, u_x( y_p, x_p ), 1e-14 );
+                    ASSERT_NEAR( u_y_c, u_y( y_p, x_p ), 1e-14 );
+                }
+            }
+        }
+    }
+
+    /*
+        the next case of a sweep of the viscosity, started from the converged previous one, reaches the
+        steady state in around half the steps it takes from the free stream
+    */
+    {
+        const std::vector<unsigned char> obstacle = cylinder( ydim, xdim, 31.7, 40.0, 6.0 );
+
+        std::vector<double> previous = test::free_stream( ydim, xdim );
+
+        converge( previous, obstacle, ydim, xdim, 0.05 );
+
+        std::vector<double> cold = test::free_stream( ydim, xdim );
+        std::vector<double> warm( ydim * xdim * 9 );
+
+        fs::lbm::warm_start_D2Q9( previous.data(), obstacle.data(), ydim, xdim, warm.data(), obstacle.data(), ydim, xdim );
+
+        const size_t steps_cold = converge( cold, obstacle, ydim, xdim, 0.06 );
+        const size_t steps_warm = converge( warm, obstacle, ydim, xdim, 0.06 );
+
+        EXPECT_LT( steps_warm, 0.7 * steps_cold );
+
+        // the same steady state
+        double difference = 0.0;
+
+        for ( size_t i = 0; i < ydim * xdim; ++i ) {
+
+            if ( obstacle[ i ] )
+                continue;
+
+            double rho_c, u_x_c, u_y_c;
+            double rho_w, u_x_w, u_y_w;
+
+            moments( cold.data() + i * 9, rho_c, u_x_c, u_y_c );
+            moments( warm.data() + i * 9, rho_w, u_x_w, u_y_w );
+
+            difference = std::max( difference, std::abs( u_x_c - u_x_w ) );
+        }
+
+        EXPECT_LT( difference, 1e-3 );
+    }
+}